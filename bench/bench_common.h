@@ -0,0 +1,190 @@
+#ifndef BENCH_COMMON_H
+#define BENCH_COMMON_H
+
+/*!
+ * @file bench_common.h
+ * @description
+ * Helpers shared by the benchmark programs: synthetic input, robust statistics over repeated
+ * runs, and the JSON result files used as regression baselines.
+ */
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/// Returns about `size` bytes of C++ mixing code, comments, doc blocks and blanks.
+inline std::string synthetic_source(std::size_t size) {
+  const std::string chunk = "/**\n"
+                            " * @brief Generated function.\n"
+                            " */\n"
+                            "int generated(int a, int b) {\n"
+                            "  // Add both values.\n"
+                            "  int c = a + b;  /* inline */\n"
+                            "\n"
+                            "  return c * 2;\n"
+                            "}\n"
+                            "/* block comment\n"
+                            "   spanning two lines */\n"
+                            "/// Doc line.\n"
+                            "const char* s = \"/* not a comment */\";\n\n";
+  std::string text;
+  text.reserve(size + chunk.size());
+  while (text.size() < size) {
+    text += chunk;
+  }
+  return text;
+}
+
+/// Median of a list of samples (by copy, since it reorders them).
+inline double median(std::vector<double> v) {
+  if (v.empty())
+    return 0;
+  std::sort(v.begin(), v.end());
+  std::size_t mid = v.size() / 2;
+  return v.size() % 2 == 1 ? v[mid] : (v[mid - 1] + v[mid]) / 2;
+}
+
+/// Median absolute deviation from `center`.
+inline double mad(const std::vector<double>& v, double center) {
+  std::vector<double> dev;
+  dev.reserve(v.size());
+  for (double x : v) {
+    dev.push_back(std::fabs(x - center));
+  }
+  return median(std::move(dev));
+}
+
+/// Samples of one benchmark case; higher is better.
+struct BenchResult {
+  std::string name;
+  std::string unit;
+  std::vector<double> samples;
+
+  double median() const { return ::median(samples); }
+  double mad() const { return ::mad(samples, median()); }
+};
+
+/// Writes the results in the format read back by load_baseline().
+inline void write_results_json(std::ostream& out,
+                               const std::string& benchmark,
+                               const std::vector<BenchResult>& results) {
+  out << "{\n  \"benchmark\": \"" << benchmark << "\",\n  \"results\": [";
+  for (std::size_t i = 0; i < results.size(); ++i) {
+    const auto& r = results[i];
+    out << (i == 0 ? "\n" : ",\n") << std::fixed << std::setprecision(3) << "    { \"name\": \""
+        << r.name << "\", \"unit\": \"" << r.unit << "\", \"median\": " << r.median()
+        << ", \"mad\": " << r.mad() << ", \"samples\": [";
+    for (std::size_t k = 0; k < r.samples.size(); ++k) {
+      out << (k == 0 ? "" : ", ") << r.samples[k];
+    }
+    out << "] }";
+  }
+  out << "\n  ]\n}\n";
+}
+
+/// Median and MAD of a case, as stored in a baseline file.
+struct BaselineEntry {
+  double median = 0;
+  double mad = 0;
+};
+
+/**
+ * @brief Reads a file written by write_results_json().
+ *
+ * This is not a general JSON parser: it only looks for the "name", "median" and "mad" members
+ * of each entry, in the order write_results_json() writes them.
+ *
+ * @param path: The baseline file.
+ * @param baseline: Receives one entry per case name.
+ * @return false if the file could not be read.
+ */
+inline bool load_baseline(const std::string& path, std::map<std::string, BaselineEntry>& baseline) {
+  std::ifstream in(path);
+  if (!in.is_open())
+    return false;
+  std::stringstream ss;
+  ss << in.rdbuf();
+  const std::string text = ss.str();
+
+  auto number_after = [&](std::size_t from, const std::string& key, std::size_t& end) -> double {
+    std::size_t k = text.find("\"" + key + "\"", from);
+    if (k == std::string::npos) {
+      end = std::string::npos;
+      return 0;
+    }
+    k = text.find(':', k) + 1;
+    char* stop = nullptr;
+    double v = std::strtod(text.c_str() + k, &stop);
+    end = static_cast<std::size_t>(stop - text.c_str());
+    return v;
+  };
+
+  std::size_t pos = 0;
+  while ((pos = text.find("\"name\"", pos)) != std::string::npos) {
+    std::size_t open = text.find('"', text.find(':', pos) + 1);
+    std::size_t close = text.find('"', open + 1);
+    if (open == std::string::npos or close == std::string::npos)
+      return false;
+    std::string name = text.substr(open + 1, close - open - 1);
+    std::size_t end = 0;
+    BaselineEntry entry;
+    entry.median = number_after(close, "median", end);
+    if (end == std::string::npos)
+      return false;
+    entry.mad = number_after(end, "mad", end);
+    if (end == std::string::npos)
+      return false;
+    baseline[name] = entry;
+    pos = end;
+  }
+  return true;
+}
+
+/**
+ * @brief Compares current results against a baseline and reports each case.
+ *
+ * A case regresses when its median throughput dropped by more than `threshold_pct` percent and
+ * the drop is also larger than the noise of both runs (3 scaled MADs, i.e. about 3 standard
+ * deviations for normally distributed samples). Cases missing from the baseline are reported
+ * but never fail.
+ *
+ * @return the number of regressed cases.
+ */
+inline int compare_with_baseline(const std::vector<BenchResult>& results,
+                                 const std::map<std::string, BaselineEntry>& baseline,
+                                 double threshold_pct,
+                                 std::ostream& report) {
+  constexpr double MAD_TO_SIGMA = 1.4826;
+  int regressions = 0;
+  report << std::left << std::setw(20) << "Case" << std::setw(16) << "Baseline"
+         << std::setw(16) << "Current" << std::setw(10) << "Change" << "Verdict\n";
+  for (const auto& r : results) {
+    auto it = baseline.find(r.name);
+    report << std::left << std::setw(20) << r.name;
+    if (it == baseline.end()) {
+      report << std::setw(16) << "-" << std::setw(16) << r.median() << std::setw(10) << "-"
+             << "new\n";
+      continue;
+    }
+    double base = it->second.median;
+    double now = r.median();
+    double change_pct = base > 0 ? 100.0 * (now - base) / base : 0;
+    double noise = 3 * MAD_TO_SIGMA * std::max(it->second.mad, r.mad());
+    bool regressed = -change_pct > threshold_pct and base - now > noise;
+    regressions += regressed ? 1 : 0;
+    std::ostringstream change;
+    change << std::showpos << std::fixed << std::setprecision(1) << change_pct << '%';
+    report << std::fixed << std::setprecision(1) << std::setw(16) << base << std::setw(16) << now
+           << std::setw(10) << change.str() << (regressed ? "REGRESSION" : "ok") << '\n';
+  }
+  return regressions;
+}
+
+#endif
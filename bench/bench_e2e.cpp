@@ -0,0 +1,249 @@
+/*!
+ * @file bench_e2e.cpp
+ * @description
+ * End-to-end benchmark driver: runs the sloc executable over generated corpora at several
+ * thread counts, with the page cache warm and cold, and reports the results as JSON.
+ *
+ * Cold runs evict every corpus file from the page cache with posix_fadvise(POSIX_FADV_DONTNEED)
+ * right before the run, so no root privileges are needed. Directory entries and inodes stay
+ * cached; only file contents are dropped.
+ *
+ * Usage: bench_e2e [--sloc path] [--files 10000,1000000,10000000] [--threads 1,2,4]
+ *                  [--corpus-dir dir] [--repeat N] [--json out.json]
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+/// # of files per generated directory.
+constexpr std::size_t FILES_PER_DIR = 1000;
+
+/// A generated corpus on disk.
+struct Corpus {
+  fs::path root;
+  std::size_t n_files = 0;
+  std::uintmax_t n_bytes = 0;
+};
+
+/// One measured run of the sloc executable.
+struct RunResult {
+  std::size_t n_files;
+  std::uintmax_t n_bytes;
+  const char* cache;
+  unsigned threads;
+  double seconds;
+  long peak_rss_kb;
+  double scaling_efficiency = 0;
+};
+
+/// Splits a comma separated list of positive integers.
+std::vector<std::size_t> parse_list(const std::string& arg) {
+  std::vector<std::size_t> values;
+  std::istringstream iss{ arg };
+  std::string item;
+  while (std::getline(iss, item, ',')) {
+    std::size_t v = std::strtoull(item.c_str(), nullptr, 10);
+    if (v > 0)
+      values.push_back(v);
+  }
+  return values;
+}
+
+/// Source file body; the index varies the contents a bit so files are not all identical.
+std::string source_text(std::size_t index) {
+  std::ostringstream oss;
+  oss << "/**\n * @file gen_" << index << ".cpp\n */\n#include <cstdio>\n\n";
+  for (std::size_t f = 0; f < 3 + index % 5; ++f) {
+    oss << "/// Generated function " << f << ".\n"
+        << "int gen_" << index << '_' << f << "(int a) {\n"
+        << "  // Comment line.\n"
+        << "  int b = a * " << f << ";  /* trailing */\n"
+        << "\n"
+        << "  return b;\n"
+        << "}\n\n";
+  }
+  return oss.str();
+}
+
+/**
+ * @brief Generates `n_files` sources under `root`, or reuses them if they are already there.
+ *
+ * A marker file records a complete corpus, so an interrupted generation is redone.
+ */
+Corpus make_corpus(const fs::path& root, std::size_t n_files) {
+  Corpus corpus{ root, n_files, 0 };
+  fs::path marker = root / ".bench_corpus_complete";
+  if (!fs::exists(marker)) {
+    std::cerr << "Generating " << n_files << " files under " << root << "...\n";
+    fs::remove_all(root);
+    for (std::size_t i = 0; i < n_files; ++i) {
+      fs::path dir = root / ("d" + std::to_string(i / FILES_PER_DIR / FILES_PER_DIR))
+                     / ("d" + std::to_string(i / FILES_PER_DIR));
+      if (i % FILES_PER_DIR == 0)
+        fs::create_directories(dir);
+      std::ofstream{ dir / ("gen_" + std::to_string(i) + ".cpp") } << source_text(i);
+    }
+    std::ofstream{ marker } << n_files << '\n';
+  }
+  for (const auto& entry : fs::recursive_directory_iterator{ root }) {
+    if (entry.is_regular_file() and entry.path().extension() == ".cpp")
+      corpus.n_bytes += entry.file_size();
+  }
+  return corpus;
+}
+
+/// Drops the contents of every corpus file from the page cache.
+void evict_corpus(const Corpus& corpus) {
+  for (const auto& entry : fs::recursive_directory_iterator{ corpus.root }) {
+    if (!entry.is_regular_file())
+      continue;
+    int fd = ::open(entry.path().c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+      continue;
+    ::fdatasync(fd);
+    ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    ::close(fd);
+  }
+}
+
+/**
+ * @brief Runs `sloc -r -j <threads> <corpus>` with stdout discarded.
+ *
+ * @return wall time in seconds and the peak RSS of the child, or a negative time on failure.
+ */
+std::pair<double, long> run_sloc(const std::string& sloc, const Corpus& corpus, unsigned threads) {
+  std::string jobs = std::to_string(threads);
+  std::string root = corpus.root.string();
+  auto start = std::chrono::steady_clock::now();
+  pid_t pid = ::fork();
+  if (pid < 0) {
+    std::perror("fork");
+    return { -1.0, 0 };
+  }
+  if (pid == 0) {
+    int devnull = ::open("/dev/null", O_WRONLY);
+    ::dup2(devnull, STDOUT_FILENO);
+    ::execl(sloc.c_str(), sloc.c_str(), "-r", "-j", jobs.c_str(), root.c_str(), nullptr);
+    ::_exit(127);
+  }
+  int status = 0;
+  struct rusage usage {};
+  pid_t waited = ::wait4(pid, &status, 0, &usage);
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  if (waited != pid or !WIFEXITED(status) or WEXITSTATUS(status) != 0)
+    return { -1.0, 0 };
+  return { elapsed.count(), usage.ru_maxrss };
+}
+
+void write_json(std::ostream& out, const std::string& sloc, const std::vector<RunResult>& results) {
+  char host[256] = "unknown";
+  ::gethostname(host, sizeof host - 1);
+  out << "{\n  \"benchmark\": \"e2e\",\n  \"sloc\": \"" << sloc << "\",\n  \"host\": \"" << host
+      << "\",\n  \"hardware_threads\": " << std::thread::hardware_concurrency()
+      << ",\n  \"results\": [";
+  for (std::size_t i = 0; i < results.size(); ++i) {
+    const auto& r = results[i];
+    out << (i == 0 ? "\n" : ",\n") << std::fixed << std::setprecision(3) << "    { \"files\": "
+        << r.n_files << ", \"bytes\": " << r.n_bytes << ", \"cache\": \"" << r.cache
+        << "\", \"threads\": " << r.threads << ", \"seconds\": " << r.seconds
+        << ", \"files_per_s\": " << r.n_files / r.seconds
+        << ", \"bytes_per_s\": " << r.n_bytes / r.seconds
+        << ", \"scaling_efficiency\": " << r.scaling_efficiency
+        << ", \"peak_rss_kb\": " << r.peak_rss_kb << " }";
+  }
+  out << "\n  ]\n}\n";
+}
+
+int main(int argc, char* argv[]) {
+  std::string sloc = (fs::path{ argv[0] }.parent_path() / "sloc").string();
+  std::vector<std::size_t> sizes{ 10000 };
+  std::vector<std::size_t> threads;
+  fs::path corpus_dir = fs::temp_directory_path() / "sloc_bench_corpus";
+  int repeat = 3;
+  std::string json_path;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--sloc" and i + 1 < argc) {
+      sloc = argv[++i];
+    } else if (arg == "--files" and i + 1 < argc) {
+      sizes = parse_list(argv[++i]);
+    } else if (arg == "--threads" and i + 1 < argc) {
+      threads = parse_list(argv[++i]);
+    } else if (arg == "--corpus-dir" and i + 1 < argc) {
+      corpus_dir = argv[++i];
+    } else if (arg == "--repeat" and i + 1 < argc) {
+      repeat = std::max(1, std::atoi(argv[++i]));
+    } else if (arg == "--json" and i + 1 < argc) {
+      json_path = argv[++i];
+    } else {
+      std::cerr << "Usage: " << argv[0]
+                << " [--sloc path] [--files 10000,1000000,10000000] [--threads 1,2,4]\n"
+                << "       [--corpus-dir dir] [--repeat N] [--json out.json]\n";
+      return EXIT_FAILURE;
+    }
+  }
+  if (threads.empty()) {
+    // Default: powers of two up to the # of hardware threads, plus that number itself.
+    unsigned hw = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned t = 1; t < hw; t *= 2)
+      threads.push_back(t);
+    threads.push_back(hw);
+  }
+
+  std::vector<RunResult> results;
+  for (std::size_t n_files : sizes) {
+    Corpus corpus = make_corpus(corpus_dir / std::to_string(n_files), n_files);
+    for (const char* cache : { "warm", "cold" }) {
+      bool cold = std::strcmp(cache, "cold") == 0;
+      double single_thread = 0;
+      for (std::size_t t : threads) {
+        RunResult best{ n_files, corpus.n_bytes, cache, static_cast<unsigned>(t), 1e300, 0 };
+        if (!cold)
+          run_sloc(sloc, corpus, best.threads);  // warm-up
+        for (int r = 0; r < repeat; ++r) {
+          if (cold)
+            evict_corpus(corpus);
+          auto [seconds, rss] = run_sloc(sloc, corpus, best.threads);
+          if (seconds < 0) {
+            std::cerr << "[ERROR] " << sloc << " failed on " << corpus.root << '\n';
+            return EXIT_FAILURE;
+          }
+          if (seconds < best.seconds)
+            best.seconds = seconds;
+          best.peak_rss_kb = std::max(best.peak_rss_kb, rss);
+        }
+        if (t == 1)
+          single_thread = best.seconds;
+        if (single_thread > 0)
+          best.scaling_efficiency = single_thread / best.seconds / static_cast<double>(t);
+        std::cerr << n_files << " files, " << cache << ", " << t << " thread(s): " << best.seconds
+                  << " s\n";
+        results.push_back(best);
+      }
+    }
+  }
+
+  if (json_path.empty()) {
+    write_json(std::cout, sloc, results);
+  } else {
+    std::ofstream out(json_path);
+    write_json(out, sloc, results);
+  }
+  return EXIT_SUCCESS;
+}
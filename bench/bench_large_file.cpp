@@ -0,0 +1,124 @@
+/*!
+ * @file bench_large_file.cpp
+ * @description
+ * Measures large-file throughput of the three read paths sloc can use: the original
+ * ifstream/getline loop, the read-only mapping and the huge-page backed buffer.
+ *
+ * Usage: bench_large_file [--size-mb N] [--passes N] [--file path]
+ * Without --file a synthetic C++ source of the given size is generated in the temp directory.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+#include "bench_common.h"
+#include "code_parser.h"
+#include "file_buffer.h"
+
+/// Writes a source file of roughly `size_mb` MB mixing code, comments, doc blocks and blanks.
+void generate_source(const std::string& path, std::size_t size_mb) {
+  const std::string block = synthetic_source(std::size_t{ 1 } << 20);
+  std::ofstream out(path, std::ios::binary);
+  for (std::size_t i = 0; i < size_mb; ++i) {
+    out << block;
+  }
+}
+
+/// Result of one read path over the whole file.
+struct PassResult {
+  double seconds;
+  int lines;
+};
+
+PassResult run_stream(const std::string& path) {
+  auto start = std::chrono::steady_clock::now();
+  std::ifstream in(path);
+  CodeParser parser;
+  std::string line;
+  while (std::getline(in, line)) {
+    parser.parse_line(line);
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  return { elapsed.count(),
+           parser.get_blank_lines() + parser.get_code_lines() + parser.get_comment_lines()
+             + parser.get_doc_comment_lines() };
+}
+
+PassResult run_buffer(FileBuffer& buffer, const std::string& path) {
+  auto start = std::chrono::steady_clock::now();
+  buffer.load(path);
+  CodeParser parser;
+  std::string line;
+  for_each_line(buffer.view(), [&](std::string_view l) {
+    line.assign(l);
+    parser.parse_line(line);
+  });
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  return { elapsed.count(),
+           parser.get_blank_lines() + parser.get_code_lines() + parser.get_comment_lines()
+             + parser.get_doc_comment_lines() };
+}
+
+int main(int argc, char* argv[]) {
+  std::size_t size_mb = 512;
+  int passes = 3;
+  std::string path;
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--size-mb") == 0 and i + 1 < argc) {
+      size_mb = std::strtoul(argv[++i], nullptr, 10);
+    } else if (std::strcmp(argv[i], "--passes") == 0 and i + 1 < argc) {
+      passes = std::max(1, std::atoi(argv[++i]));
+    } else if (std::strcmp(argv[i], "--file") == 0 and i + 1 < argc) {
+      path = argv[++i];
+    } else {
+      std::cerr << "Usage: " << argv[0] << " [--size-mb N] [--passes N] [--file path]\n";
+      return EXIT_FAILURE;
+    }
+  }
+
+  bool generated = path.empty();
+  if (generated) {
+    path = (std::filesystem::temp_directory_path() / "sloc_bench_large.cpp").string();
+    std::cout << "Generating " << size_mb << " MB source at " << path << "...\n";
+    generate_source(path, size_mb);
+  }
+  double mb = static_cast<double>(std::filesystem::file_size(path)) / (1 << 20);
+
+  FileBuffer mapped{ false };
+  FileBuffer huge{ true };
+  struct Mode {
+    const char* name;
+    std::function<PassResult()> run;
+  };
+  Mode modes[] = {
+    { "stream", [&] { return run_stream(path); } },
+    { "mmap", [&] { return run_buffer(mapped, path); } },
+    { "huge-pages", [&] { return run_buffer(huge, path); } },
+  };
+
+  std::cout << std::left << std::setw(12) << "Mode" << std::setw(12) << "Best (s)"
+            << std::setw(12) << "MB/s" << "Lines\n";
+  for (auto& mode : modes) {
+    PassResult best{ 1e300, 0 };
+    for (int p = 0; p < passes; ++p) {
+      PassResult r = mode.run();
+      if (r.seconds < best.seconds)
+        best = r;
+    }
+    std::cout << std::left << std::setw(12) << mode.name << std::setw(12) << std::fixed
+              << std::setprecision(3) << best.seconds << std::setw(12) << std::setprecision(1)
+              << mb / best.seconds << best.lines << '\n';
+  }
+  std::cout << "Huge-page buffer in use: " << (huge.on_huge_pages() ? "yes" : "no") << '\n';
+
+  if (generated)
+    std::filesystem::remove(path);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,158 @@
+/*!
+ * @file bench_regress.cpp
+ * @description
+ * Micro-benchmarks of the parser, the marker scanner and the output path, meant to catch
+ * performance regressions.
+ *
+ * Every case is run several times; the median and the median absolute deviation (MAD) of the
+ * samples are written as JSON. Given a previous result file with --baseline, the program
+ * compares both runs and exits with a non-zero status if a case regressed (see
+ * compare_with_baseline()).
+ *
+ * Usage: bench_regress [--repeat N] [--size-mb N] [--json out.json]
+ *                      [--baseline base.json] [--threshold PCT]
+ */
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+#include "bench_common.h"
+#include "code_parser.h"
+#include "file_buffer.h"
+#include "file_info.h"
+#include "marker_scanner.h"
+#include "table_report.h"
+
+/// Stream buffer that throws everything away, so only formatting is measured.
+class NullBuffer : public std::streambuf {
+protected:
+  int overflow(int c) override { return c; }
+  std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+};
+
+/// Seconds taken by `fn`.
+double time_it(const std::function<void()>& fn) {
+  auto start = std::chrono::steady_clock::now();
+  fn();
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+/// A list of files as the traversal would produce it, with plausible counters.
+FileList synthetic_file_list(std::size_t n_files) {
+  FileList files;
+  files.reserve(n_files);
+  for (std::size_t i = 0; i < n_files; ++i) {
+    FileInfo f{ "src/module" + std::to_string(i % 97) + "/file" + std::to_string(i) + ".cpp",
+                static_cast<lang_type_e>(i % UNDEF) };
+    f.n_blank = i % 40;
+    f.n_comments = i % 70;
+    f.n_doc = i % 30;
+    f.n_loc = 100 + i % 900;
+    f.n_lines = f.n_blank + f.n_comments + f.n_doc + f.n_loc;
+    files.push_back(std::move(f));
+  }
+  return files;
+}
+
+int main(int argc, char* argv[]) {
+  int repeat = 11;
+  std::size_t size_mb = 32;
+  std::string json_path;
+  std::string baseline_path;
+  double threshold_pct = 5.0;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--repeat" and i + 1 < argc) {
+      repeat = std::max(3, std::atoi(argv[++i]));
+    } else if (arg == "--size-mb" and i + 1 < argc) {
+      size_mb = std::max(1ul, std::strtoul(argv[++i], nullptr, 10));
+    } else if (arg == "--json" and i + 1 < argc) {
+      json_path = argv[++i];
+    } else if (arg == "--baseline" and i + 1 < argc) {
+      baseline_path = argv[++i];
+    } else if (arg == "--threshold" and i + 1 < argc) {
+      threshold_pct = std::atof(argv[++i]);
+    } else {
+      std::cerr << "Usage: " << argv[0] << " [--repeat N] [--size-mb N] [--json out.json]\n"
+                << "       [--baseline base.json] [--threshold PCT]\n";
+      return EXIT_FAILURE;
+    }
+  }
+
+  const std::string text = synthetic_source(size_mb << 20);
+  const double mb = static_cast<double>(text.size()) / (1 << 20);
+  const FileList files = synthetic_file_list(100000);
+  NullBuffer null_buffer;
+  std::ostream null_out{ &null_buffer };
+
+  struct Case {
+    const char* name;
+    const char* unit;
+    double work;  //!< Amount of work per run, in `unit` seconds.
+    std::function<void()> run;
+  };
+  std::vector<Case> cases{
+    { "parse_line", "MB/s", mb,
+      [&] {
+        CodeParser parser;
+        std::string line;
+        for_each_line(text, [&](std::string_view l) {
+          line.assign(l);
+          parser.parse_line(line);
+        });
+        if (parser.get_code_lines() == 0)
+          std::abort();
+      } },
+    { "marker_scan", "MB/s", mb,
+      [&] {
+        const MarkerScanner scanner{ { "TODO", "FIXME", "HACK", "XXX" } };
+        count_t counts[4] = {};
+        for_each_line(text, [&](std::string_view l) { scanner.scan(l, counts); });
+        if (counts[0] != 0)
+          std::abort();
+      } },
+    { "print_table", "rows/s", static_cast<double>(files.size()),
+      [&] { print_table(files, ".", null_out); } },
+  };
+
+  std::vector<BenchResult> results;
+  for (const auto& c : cases) {
+    BenchResult r{ c.name, c.unit, {} };
+    c.run();  // warm-up
+    for (int k = 0; k < repeat; ++k) {
+      r.samples.push_back(c.work / time_it(c.run));
+    }
+    std::cerr << c.name << ": median " << r.median() << ' ' << c.unit << ", MAD " << r.mad()
+              << '\n';
+    results.push_back(std::move(r));
+  }
+
+  if (!json_path.empty()) {
+    std::ofstream out(json_path);
+    write_results_json(out, "regress", results);
+  } else if (baseline_path.empty()) {
+    write_results_json(std::cout, "regress", results);
+  }
+
+  if (!baseline_path.empty()) {
+    std::map<std::string, BaselineEntry> baseline;
+    if (!load_baseline(baseline_path, baseline)) {
+      std::cerr << "[ERROR] Could not read baseline " << baseline_path << '\n';
+      return EXIT_FAILURE;
+    }
+    int regressions = compare_with_baseline(results, baseline, threshold_pct, std::cout);
+    if (regressions > 0) {
+      std::cout << regressions << " case(s) regressed by more than " << threshold_pct << "%.\n";
+      return EXIT_FAILURE;
+    }
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,96 @@
+/*!
+ * @file cases.cpp
+ * @description
+ * Fixed regression cases for the readers and scanners that the randomised testers do not reach:
+ * inputs a reviewer found miscounted, kept so they stay fixed.
+ *
+ * Usage: cases
+ * Prints every failed check and exits with a non-zero status if there was one.
+ */
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <unistd.h>
+
+#include "build_deps.h"
+#include "marker_scanner.h"
+
+namespace fs = std::filesystem;
+
+/// # of failed checks so far.
+int n_failed = 0;
+
+/// Reports the failed condition and goes on with the next check.
+#define CHECK(cond)                                                                    \
+  do {                                                                                 \
+    if (!(cond)) {                                                                     \
+      std::cerr << "[FAILED] " << __FILE__ << ':' << __LINE__ << ": " << #cond << '\n'; \
+      ++n_failed;                                                                      \
+    }                                                                                  \
+  } while (false)
+
+void write_file(const fs::path& path, const std::string& text) {
+  fs::create_directories(path.parent_path());
+  std::ofstream{ path } << text;
+}
+
+/// A header named by its absolute path in one .d file and relative to the build directory in
+/// another is one file.
+void deps_mixed_spellings(const fs::path& root) {
+  write_file(root / "src/a.c", "int a;\n");
+  write_file(root / "src/b.c", "int b;\n");
+  write_file(root / "src/c.h", "int c;\n");
+  write_file(root / "src/d.h", "int d;\n");
+  write_file(root / "build/b.d", "b.o: " + (root / "src/b.c").string() + ' '
+                                   + (root / "src/c.h").string() + '\n');
+  write_file(root / "build/sub/a.d", "sub/a.o: ../src/a.c ../src/c.h \\\n ../src/d.h\n");
+
+  // Relative to the working directory, as `sloc --deps build` is run.
+  fs::path cwd = fs::current_path();
+  fs::current_path(root);
+  DepsGraph graph;
+  std::string error;
+  CHECK(graph.read_build_dir("build", error));
+  fs::current_path(cwd);
+  CHECK(graph.files().size() == 4);
+  CHECK(graph.units().size() == 2);
+  for (const auto& unit : graph.units()) {
+    CHECK(unit.inputs.size() == (unit.output == "b.o" ? 2u : 3u));
+  }
+  for (const auto& file : graph.files()) {
+    CHECK(fs::path{ file }.is_absolute());
+  }
+  CHECK(deps_key(root / "build/../src/c.h") == deps_key(root / "src/./c.h"));
+}
+
+/// Markers in the comment that ends a code line count; those in literals and code do not.
+void markers_in_code_lines() {
+  const MarkerScanner scanner{ { "TODO", "FIXME" } };
+  auto count = [&](std::string_view line) {
+    count_t counts[2] = {};
+    scanner.scan_code(line, counts);
+    return std::to_string(counts[0]) + ' ' + std::to_string(counts[1]);
+  };
+  CHECK(count("int x; // TODO fix") == "1 0");
+  CHECK(count("int x; /* FIXME */ int y; // TODO") == "1 1");
+  CHECK(count("f(\"// TODO\", '\"'); // FIXME") == "0 1");
+  CHECK(count("int TODO = 1; /* FIXME: unterminated") == "0 1");
+  CHECK(count("int x = 1 / 2; // TODOS") == "0 0");
+}
+
+int main() {
+  fs::path root = fs::temp_directory_path() / ("sloc_cases_" + std::to_string(::getpid()));
+  deps_mixed_spellings(root / "deps");
+  markers_in_code_lines();
+  fs::remove_all(root);
+
+  if (n_failed != 0) {
+    std::cerr << n_failed << " check(s) failed.\n";
+    return EXIT_FAILURE;
+  }
+  std::cout << "All cases passed.\n";
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,40 @@
+/*!
+ * @file fuzz_parser.cpp
+ * @description
+ * libFuzzer entry point comparing every registered fast path against the reference CodeParser
+ * loop. Aborts on the first mismatch so the fuzzer saves the input.
+ *
+ * Built with -fsanitize=fuzzer when the compiler is Clang. Otherwise it gets a small main() that
+ * replays the files passed on the command line, which is handy to reproduce a saved crash.
+ */
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string_view>
+
+#include "parser_diff.h"
+
+extern "C" int LLVMFuzzerTestOneInput(const std::uint8_t* data, std::size_t size) {
+  std::string_view text{ reinterpret_cast<const char*>(data), size };
+  if (!check_fast_paths(text, std::cerr)) {
+    std::abort();
+  }
+  return 0;
+}
+
+#ifdef SLOC_FUZZ_REPLAY_MAIN
+# include <fstream>
+# include <iterator>
+# include <string>
+
+int main(int argc, char* argv[]) {
+  for (int i = 1; i < argc; ++i) {
+    std::ifstream in(argv[i], std::ios::binary);
+    std::string data{ std::istreambuf_iterator<char>{ in }, std::istreambuf_iterator<char>{} };
+    std::cout << argv[i] << '\n';
+    LLVMFuzzerTestOneInput(reinterpret_cast<const std::uint8_t*>(data.data()), data.size());
+  }
+  return EXIT_SUCCESS;
+}
+#endif
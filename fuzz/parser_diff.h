@@ -0,0 +1,221 @@
+#ifndef PARSER_DIFF_H
+#define PARSER_DIFF_H
+
+/*!
+ * @file parser_diff.h
+ * @description
+ * Differential check between the reference line-by-line CodeParser loop (std::getline over the
+ * text, exactly as sloc used to read files) and every alternative parsing path in the tree.
+ *
+ * Any new fast path (SIMD, DFA, chunk-parallel, ...) must be registered in fast_paths() so the
+ * fuzz targets compare it against the reference.
+ */
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <unistd.h>
+#include <vector>
+
+#include "code_parser.h"
+#include "file_buffer.h"
+#include "line_index.h"
+#include "patch_counter.h"
+
+/// Per-category line counts produced by one parsing path.
+struct LineCounts {
+  int blank = 0;
+  int comment = 0;
+  int doc = 0;
+  int code = 0;
+
+  bool operator==(const LineCounts& o) const {
+    return blank == o.blank and comment == o.comment and doc == o.doc and code == o.code;
+  }
+  bool operator!=(const LineCounts& o) const { return !(*this == o); }
+};
+
+inline std::ostream& operator<<(std::ostream& os, const LineCounts& c) {
+  return os << "blank=" << c.blank << " comment=" << c.comment << " doc=" << c.doc
+            << " code=" << c.code;
+}
+
+/// Collects the counters of a parser after the whole text went through it.
+inline LineCounts counts_of(const CodeParser& parser) {
+  return { parser.get_blank_lines(),
+           parser.get_comment_lines(),
+           parser.get_doc_comment_lines(),
+           parser.get_code_lines() };
+}
+
+/// The reference: std::getline over a stream and one parse_line() call per line.
+inline LineCounts reference_counts(std::string_view text) {
+  std::istringstream in{ std::string{ text } };
+  CodeParser parser;
+  std::string line;
+  while (std::getline(in, line)) {
+    parser.parse_line(line);
+  }
+  return counts_of(parser);
+}
+
+/// In-memory buffer split by for_each_line(), as the main loop does after FileBuffer::load().
+inline LineCounts buffer_counts(std::string_view text) {
+  CodeParser parser;
+  std::string line;
+  for_each_line(text, [&](std::string_view l) {
+    line.assign(l);
+    parser.parse_line(line);
+  });
+  return counts_of(parser);
+}
+
+/// Every stretch between two checkpoints classified on its own, resuming from the checkpoint
+/// (see line_index.h). A short stride puts checkpoints inside most comment blocks.
+inline LineCounts checkpoint_counts(std::string_view text) {
+  constexpr std::uint32_t stride = 3;
+  CodeParser parser;
+  LineIndexBuilder builder{ stride };
+  std::string line;
+  std::uint64_t n_lines = 0;
+  for_each_line(text, [&](std::string_view l) {
+    line.assign(l);
+    parser.parse_line(line);
+    builder.add(static_cast<std::uint64_t>(l.data() + l.size() + 1 - text.data()), parser.state());
+    ++n_lines;
+  });
+  LineCounts counts;
+  for (std::uint64_t first = 0; first < n_lines; first += stride) {
+    classify_lines(text, builder.index(), stride, first, first + stride,
+                   [&](std::uint64_t, line_category_e category) {
+                     switch (category) {
+                     case LINE_BLANK:
+                       counts.blank++;
+                       break;
+                     case LINE_CODE:
+                       counts.code++;
+                       break;
+                     case LINE_COMMENT:
+                       counts.comment++;
+                       break;
+                     case LINE_DOC:
+                       counts.doc++;
+                       break;
+                     }
+                   });
+  }
+  return counts;
+}
+
+/// `sloc --patch` over diffs that rewrite every third line in place, with the text as the new
+/// file in the working tree. The lines between the hunks go through PatchCounter's skip, which
+/// only parses the lines holding a '/'; the '+' lines are classified from the state it leaves.
+inline LineCounts patch_counts(std::string_view text) {
+  constexpr std::size_t stride = 3;
+  auto dir = std::filesystem::temp_directory_path();
+  std::string name = "sloc_patch_" + std::to_string(::getpid()) + ".cpp";
+  {
+    std::ofstream out(dir / name, std::ios::binary);
+    out.write(text.data(), static_cast<std::streamsize>(text.size()));
+  }
+  std::vector<std::string_view> lines;
+  for_each_line(text, [&](std::string_view l) { lines.push_back(l); });
+
+  LineCounts counts;
+  for (std::size_t first = 0; first < stride; ++first) {
+    PatchCounter patch{ dir.string(), 1, [](const std::string&) {
+                         return std::optional<lang_type_e>{ CPP };
+                       } };
+    patch.add("--- a/" + name);
+    patch.add("+++ b/" + name);
+    for (std::size_t i = first; i < lines.size(); i += stride) {
+      std::string n = std::to_string(i + 1);
+      patch.add("@@ -" + n + ",1 +" + n + ",1 @@");
+      patch.add('-' + std::string{ lines[i] });
+      patch.add('+' + std::string{ lines[i] });
+    }
+    patch.finish();
+    for (const auto& f : patch.files()) {
+      counts.blank += static_cast<int>(f.added.n_blank);
+      counts.comment += static_cast<int>(f.added.n_comments);
+      counts.doc += static_cast<int>(f.added.n_doc);
+      counts.code += static_cast<int>(f.added.n_loc);
+    }
+  }
+  std::filesystem::remove(dir / name);
+  return counts;
+}
+
+/// A parsing path that has to agree with reference_counts() on every input.
+struct FastPath {
+  const char* name;
+  LineCounts (*count)(std::string_view);
+};
+
+/// Every alternative parsing path in the tree.
+inline const std::vector<FastPath>& fast_paths() {
+  static const std::vector<FastPath> paths{
+    { "buffer", buffer_counts },
+    { "checkpoints", checkpoint_counts },
+    { "patch", patch_counts },
+  };
+  return paths;
+}
+
+/**
+ * @brief Runs `text` through the reference and every fast path.
+ *
+ * @param text: The input to classify.
+ * @param report: Receives a description of each mismatch.
+ * @return true if every fast path matched the reference.
+ */
+inline bool check_fast_paths(std::string_view text, std::ostream& report) {
+  LineCounts expected = reference_counts(text);
+  bool ok = true;
+  for (const auto& path : fast_paths()) {
+    LineCounts got = path.count(text);
+    if (got != expected) {
+      report << "[MISMATCH] " << path.name << ": " << got << " (reference: " << expected << ")\n";
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+/**
+ * @brief Same as check_fast_paths(), but reading `text` back from a file through FileBuffer.
+ *
+ * Slower, since it goes through the file system; meant for the standalone tester.
+ */
+inline bool check_file_paths(std::string_view text, std::ostream& report) {
+  LineCounts expected = reference_counts(text);
+  auto path = std::filesystem::temp_directory_path()
+              / ("sloc_diff_" + std::to_string(::getpid()) + ".cpp");
+  {
+    std::ofstream out(path, std::ios::binary);
+    out.write(text.data(), static_cast<std::streamsize>(text.size()));
+  }
+  bool ok = true;
+  for (bool huge : { false, true }) {
+    FileBuffer buffer{ huge };
+    if (!buffer.load(path.string())) {
+      report << "[MISMATCH] FileBuffer could not read " << path << '\n';
+      ok = false;
+      break;
+    }
+    LineCounts got = buffer_counts(buffer.view());
+    if (got != expected) {
+      report << "[MISMATCH] file" << (huge ? "/huge-pages" : "") << ": " << got
+             << " (reference: " << expected << ")\n";
+      ok = false;
+    }
+  }
+  std::filesystem::remove(path);
+  return ok;
+}
+
+#endif
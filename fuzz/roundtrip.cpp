@@ -0,0 +1,411 @@
+/*!
+ * @file roundtrip.cpp
+ * @description
+ * Standalone randomised round-trip tester for the result files. Writes random runs with
+ * write_slocbin(), append_history() and write_line_map() and checks that SlocbinReader,
+ * HistoryReader and LineMapReader give back what went in: every row, sort permutation and line
+ * index of a slocbin file, every snapshot and per-file series of an archive long enough to
+ * cross a keyframe, and the category of every line of a line map.
+ *
+ * Each file is then damaged (truncated, bytes flipped, offsets and lengths set so their sums
+ * wrap around, a permutation entry pointed past the rows) and read again: the readers have to
+ * reject it, or read it without going out of bounds.
+ * Build with -fsanitize=address for the latter to be checked.
+ *
+ * Usage: roundtrip [--iterations N] [--seed S]
+ * Exits with a non-zero status and prints the seed of the failing case on the first mismatch.
+ */
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "history_archive.h"
+#include "line_index.h"
+#include "line_map.h"
+#include "slocbin.h"
+
+/// Base directory of the generated runs; it does not need to exist.
+const std::string base_dir = "/sloc_roundtrip";
+
+/// Scratch files, removed on exit.
+const std::filesystem::path tmp_dir = std::filesystem::temp_directory_path();
+const std::string pid = std::to_string(::getpid());
+const std::string slocbin_file = (tmp_dir / ("sloc_rt_" + pid + ".slocbin")).string();
+const std::string history_file = (tmp_dir / ("sloc_rt_" + pid + ".hist")).string();
+const std::string line_map_file = (tmp_dir / ("sloc_rt_" + pid + ".map")).string();
+const std::string damaged_file = (tmp_dir / ("sloc_rt_" + pid + ".damaged")).string();
+
+std::string read_file(const std::string& filename) {
+  std::ifstream in(filename, std::ios::binary);
+  std::stringstream ss;
+  ss << in.rdbuf();
+  return ss.str();
+}
+
+void write_file(const std::string& filename, const std::string& data) {
+  std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+  out.write(data.data(), static_cast<std::streamsize>(data.size()));
+}
+
+/// A copy of `data` truncated, or with a few bytes overwritten.
+std::string damage(std::string data, std::mt19937_64& rng) {
+  std::uniform_int_distribution<int> byte{ 0, 255 };
+  if (data.empty() or rng() % 4 == 0) {
+    data.resize(data.empty() ? 0 : rng() % data.size());
+    return data;
+  }
+  for (unsigned n = 1 + rng() % 4; n > 0; --n) {
+    data[rng() % data.size()] = static_cast<char>(byte(rng));
+  }
+  return data;
+}
+
+/// Random counters for a file; the license fields exercise all_comment_lines/all_doc_lines.
+FileInfo random_file(std::mt19937_64& rng, const std::string& path) {
+  std::uniform_int_distribution<count_t> count{ 0, 2000 };
+  FileInfo f{ base_dir + '/' + path, static_cast<lang_type_e>(rng() % UNDEF), count(rng),
+              count(rng), count(rng), count(rng) };
+  f.n_license = rng() % 3 == 0 ? count(rng) % 40 : 0;
+  f.n_license_doc = f.n_license == 0 ? 0 : rng() % (f.n_license + 1);
+  f.n_comments -= std::min(f.n_comments, f.n_license - f.n_license_doc);
+  f.n_doc -= std::min(f.n_doc, f.n_license_doc);
+  f.n_lines = f.n_blank + all_comment_lines(f) + all_doc_lines(f) + f.n_loc;
+  return f;
+}
+
+/// A path out of a small tree, so prefixes are shared.
+std::string random_path(std::mt19937_64& rng) {
+  static const char* const dirs[] = { "src", "src/core", "lib", "include/sloc", "tests" };
+  static const char* const exts[] = { ".c", ".cpp", ".h", ".hpp" };
+  return std::string{ dirs[rng() % std::size(dirs)] } + "/f" + std::to_string(rng() % 500)
+         + exts[rng() % std::size(exts)];
+}
+
+/// Reports the failed condition and fails the case.
+#define CHECK(cond)                                                                    \
+  do {                                                                                 \
+    if (!(cond)) {                                                                     \
+      std::cerr << "[MISMATCH] " << __FILE__ << ':' << __LINE__ << ": " << #cond << '\n'; \
+      return false;                                                                    \
+    }                                                                                  \
+  } while (false)
+
+/// Touches everything a reader of a slocbin file can reach.
+void read_all(const SlocbinReader& reader) {
+  volatile std::size_t sink = reader.base_dir().size();
+  for (std::uint64_t r = 0; r < reader.size(); ++r) {
+    sink = sink + reader.path(r).size() + reader.line_index(r).size()
+           + reader.line_index_matches(r, "x");
+    for (char c : std::string_view{ SLOCBIN_CRITERIA }) {
+      sink = sink + reader.row(reader.permutation(c)[r]).n_lines;
+    }
+    sink = sink + reader.find(reader.path(r));
+  }
+  auto [first, last] = reader.prefix_range("src/");
+  sink = sink + first + last;
+}
+
+bool check_slocbin(std::mt19937_64& rng) {
+  std::map<std::string, std::string> texts;  // indexed file contents, by path
+  FileList files;
+  for (unsigned n = rng() % 60; n > 0; --n) {
+    std::string path = random_path(rng);
+    if (texts.count(path) != 0)
+      continue;
+    FileInfo f = random_file(rng, path);
+    std::string& text = texts[path];
+    text = std::to_string(rng());
+    f.line_index.assign(rng() % 16, static_cast<char>(rng()));
+    f.indexed_size = text.size();
+    f.indexed_hash = content_hash(text);
+    files.push_back(f);
+  }
+  const std::uint32_t stride = rng() % 2 == 0 ? 0 : 1 + rng() % 8;
+  const bool partial = rng() % 2 == 0;
+  const std::size_t found = files.size() + rng() % 10;
+  {
+    std::ofstream out(slocbin_file, std::ios::binary | std::ios::trunc);
+    write_slocbin(out, files, base_dir, partial ? SLOCBIN_FLAG_PARTIAL : 0, stride, found);
+  }
+
+  SlocbinReader reader;
+  std::string error;
+  CHECK(reader.open(slocbin_file, error));
+  CHECK(reader.size() == files.size());
+  CHECK(reader.base_dir() == base_dir);
+  CHECK(reader.line_index_stride() == stride);
+  CHECK(reader.files_found() == (partial ? found : 0));
+  for (std::uint64_t r = 0; r < reader.size(); ++r) {
+    const FileInfo& f = files[r];
+    const SlocbinRow& row = reader.row(r);
+    std::string path = relative_basename(f.filename, base_dir);
+    CHECK(reader.path(r) == path);
+    CHECK(row.type == f.type and row.n_blank == f.n_blank and row.n_loc == f.n_loc);
+    CHECK(row.n_comments == all_comment_lines(f) and row.n_doc == all_doc_lines(f));
+    CHECK(row.n_lines == f.n_lines);
+    CHECK(reader.find(path) == r);
+    if (stride != 0) {
+      CHECK(reader.line_index(r) == f.line_index);
+      CHECK(reader.line_index_matches(r, texts[path]));
+      CHECK(!reader.line_index_matches(r, texts[path] + ' '));
+    }
+  }
+  for (char c : std::string_view{ SLOCBIN_CRITERIA }) {
+    const std::uint32_t* perm = reader.permutation(c);
+    std::vector<bool> seen(reader.size());
+    for (std::uint64_t i = 0; i < reader.size(); ++i) {
+      CHECK(perm[i] < reader.size() and !seen[perm[i]]);
+      seen[perm[i]] = true;
+      if (i > 0 and c == 'f') {
+        CHECK(reader.path(perm[i - 1]) < reader.path(perm[i]));
+      } else if (i > 0) {
+        CHECK(slocbin_key(reader.row(perm[i - 1]), c) <= slocbin_key(reader.row(perm[i]), c));
+      }
+    }
+  }
+  std::string prefix = random_path(rng).substr(0, 1 + rng() % 8);
+  auto [first, last] = reader.prefix_range(prefix);
+  auto n_prefixed = std::count_if(files.begin(), files.end(), [&](const FileInfo& f) {
+    return relative_basename(f.filename, base_dir).compare(0, prefix.size(), prefix) == 0;
+  });
+  CHECK(last - first == static_cast<std::uint64_t>(n_prefixed));
+
+  const std::string data = read_file(slocbin_file);
+  if (!files.empty()) {
+    // A permutation entry past the rows has to be caught on open.
+    std::string bad = data;
+    const auto& footer = *reinterpret_cast<const SlocbinFooter*>(bad.data() + bad.size()
+                                                                  - sizeof(SlocbinFooter));
+    auto entry = footer.index_offset[rng() % SLOCBIN_N_CRITERIA]
+                 + rng() % files.size() * sizeof(std::uint32_t);
+    auto past = static_cast<std::uint32_t>(files.size() + rng() % 1000);
+    std::memcpy(&bad[entry], &past, sizeof past);
+    write_file(damaged_file, bad);
+    SlocbinReader damaged;
+    CHECK(!damaged.open(damaged_file, error));
+    CHECK(error == damaged_file + " is corrupt");
+  }
+  {
+    // So does a base directory whose offset and length wrap around.
+    std::string bad = data;
+    std::uint64_t wrap = ~0ull;
+    std::memcpy(&bad[offsetof(SlocbinHeader, base_dir_offset)], &wrap, sizeof wrap);
+    write_file(damaged_file, bad);
+    SlocbinReader damaged;
+    CHECK(!damaged.open(damaged_file, error));
+  }
+  for (int i = 0; i < 8; ++i) {
+    write_file(damaged_file, damage(data, rng));
+    SlocbinReader damaged;
+    if (damaged.open(damaged_file, error))
+      read_all(damaged);
+  }
+  return true;
+}
+
+bool check_history(std::mt19937_64& rng) {
+  std::filesystem::remove(history_file);
+  // Expected contents of each snapshot, by path.
+  std::vector<std::map<std::string, HistoryCounts>> expected;
+  std::map<std::string, FileInfo> tree;
+  const std::size_t n_snapshots = 1 + rng() % (2 * HISTORY_KEYFRAME_INTERVAL + 8);
+  for (std::size_t s = 0; s < n_snapshots; ++s) {
+    // Files come and go, some change, most stay as they were.
+    for (unsigned n = rng() % 4; n > 0; --n) {
+      std::string path = random_path(rng);
+      tree[path] = random_file(rng, path);
+    }
+    for (auto it = tree.begin(); it != tree.end();) {
+      if (rng() % 20 == 0) {
+        it = tree.erase(it);
+        continue;
+      }
+      if (rng() % 5 == 0)
+        it->second = random_file(rng, it->first);
+      ++it;
+    }
+    FileList files;
+    std::map<std::string, HistoryCounts>& snapshot = expected.emplace_back();
+    for (const auto& [path, f] : tree) {
+      files.push_back(f);
+      snapshot[path] = HistoryCounts{ true,
+                                      static_cast<std::uint8_t>(f.type),
+                                      f.n_blank,
+                                      all_comment_lines(f),
+                                      all_doc_lines(f),
+                                      f.n_loc,
+                                      f.n_lines };
+    }
+    std::shuffle(files.begin(), files.end(), rng);
+    std::string error;
+    CHECK(append_history(history_file, files, base_dir, error));
+  }
+
+  HistoryReader reader;
+  std::string error;
+  CHECK(reader.open(history_file, error));
+  CHECK(reader.size() == n_snapshots);
+  // Rebuild each snapshot on its own, from the keyframe before it.
+  for (std::size_t s = 0; s < n_snapshots; ++s) {
+    HistoryState state;
+    CHECK(reader.snapshot(s, state));
+    CHECK(reader.base_dir(s) == base_dir);
+    std::size_t n_present = 0;
+    for (std::size_t id = 0; id < state.size(); ++id) {
+      if (!state[id].present)
+        continue;
+      ++n_present;
+      auto it = expected[s].find(reader.paths()[id]);
+      CHECK(it != expected[s].end() and it->second == state[id]);
+    }
+    CHECK(n_present == expected[s].size());
+  }
+  for (std::size_t id = 0; id < reader.paths().size(); ++id) {
+    std::vector<HistoryCounts> series;
+    CHECK(reader.series(id, series));
+    CHECK(series.size() == n_snapshots);
+    for (std::size_t s = 0; s < n_snapshots; ++s) {
+      auto it = expected[s].find(reader.paths()[id]);
+      CHECK(series[s] == (it == expected[s].end() ? HistoryCounts{} : it->second));
+    }
+  }
+  CHECK(reader.find("no/such/file.c") == reader.paths().size());
+
+  const std::string data = read_file(history_file);
+  for (int i = 0; i < 8; ++i) {
+    write_file(damaged_file, damage(data, rng));
+    HistoryReader damaged;
+    if (!damaged.open(damaged_file, error))
+      continue;
+    HistoryState state;
+    std::vector<HistoryCounts> series;
+    for (std::size_t s = 0; s < damaged.size(); ++s) {
+      damaged.snapshot(s, state);
+    }
+    for (std::size_t id = 0; id < damaged.paths().size(); id += 7) {
+      damaged.series(id, series);
+    }
+  }
+  return true;
+}
+
+/// Touches everything a reader of a line map can reach.
+void read_all(const LineMapReader& reader) {
+  volatile std::size_t sink = reader.base_dir().size();
+  for (std::uint64_t i = 0; i < reader.size(); ++i) {
+    sink = sink + reader.path(i).size() + reader.find(reader.path(i));
+    for (std::uint64_t l = 0; l < reader.entry(i).n_lines; ++l) {
+      sink = sink + reader.category(i, l);
+    }
+  }
+}
+
+bool check_line_map(std::mt19937_64& rng) {
+  std::map<std::string, std::vector<line_category_e>> expected;
+  FileList files;
+  for (unsigned n = rng() % 40; n > 0; --n) {
+    std::string path = random_path(rng);
+    if (expected.count(path) != 0)
+      continue;
+    std::vector<line_category_e>& lines = expected[path];
+    lines.resize(rng() % 300);
+    FileInfo f{ base_dir + '/' + path, CPP };
+    for (std::size_t l = 0; l < lines.size(); ++l) {
+      lines[l] = static_cast<line_category_e>(rng() % 4);
+      append_line_category(f.line_map, l, lines[l]);
+    }
+    f.n_lines = lines.size();
+    files.push_back(f);
+  }
+  const bool partial = rng() % 2 == 0;
+  const std::uint64_t found = files.size() + rng() % 10;
+  std::string error;
+  CHECK(write_line_map(line_map_file, files, base_dir, error,
+                       partial ? LINE_MAP_FLAG_PARTIAL : 0, found));
+
+  LineMapReader reader;
+  CHECK(reader.open(line_map_file, error));
+  CHECK(reader.size() == files.size());
+  CHECK(reader.base_dir() == base_dir);
+  CHECK(reader.partial() == partial);
+  CHECK(reader.files_found() == (partial ? found : 0));
+  for (std::uint64_t i = 1; i < reader.size(); ++i) {
+    CHECK(reader.path(i - 1) < reader.path(i));
+  }
+  for (const auto& [path, lines] : expected) {
+    std::uint64_t i = reader.find(path);
+    CHECK(i < reader.size() and reader.entry(i).n_lines == lines.size());
+    for (std::size_t l = 0; l < lines.size(); ++l) {
+      CHECK(reader.category(i, l) == lines[l]);
+    }
+  }
+  CHECK(reader.find("no/such/file.c") == reader.size());
+
+  const std::string data = read_file(line_map_file);
+  LineMapHeader header;
+  std::memcpy(&header, data.data(), sizeof header);
+  // Offsets and lengths whose sums wrap around have to be caught on open.
+  auto wrapped = [&](std::size_t offset, std::uint64_t value) {
+    std::string bad = data;
+    std::memcpy(&bad[offset], &value, sizeof value);
+    write_file(damaged_file, bad);
+    LineMapReader damaged;
+    return !damaged.open(damaged_file, error);
+  };
+  CHECK(wrapped(offsetof(LineMapHeader, base_dir_offset), ~0ull));
+  if (!files.empty()) {
+    std::size_t e = header.entries_offset + rng() % files.size() * sizeof(LineMapEntry);
+    CHECK(wrapped(e + offsetof(LineMapEntry, path_offset), ~0ull));
+    CHECK(wrapped(e + offsetof(LineMapEntry, n_lines), ~0ull));
+    CHECK(wrapped(e + offsetof(LineMapEntry, n_lines), ~0ull - 2));
+  }
+  for (int i = 0; i < 8; ++i) {
+    write_file(damaged_file, damage(data, rng));
+    LineMapReader damaged;
+    if (damaged.open(damaged_file, error))
+      read_all(damaged);
+  }
+  return true;
+}
+
+int main(int argc, char* argv[]) {
+  long iterations = 200;
+  unsigned long long seed = std::random_device{}();
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--iterations") == 0 and i + 1 < argc) {
+      iterations = std::atol(argv[++i]);
+    } else if (std::strcmp(argv[i], "--seed") == 0 and i + 1 < argc) {
+      seed = std::strtoull(argv[++i], nullptr, 10);
+    } else {
+      std::cerr << "Usage: " << argv[0] << " [--iterations N] [--seed S]\n";
+      return EXIT_FAILURE;
+    }
+  }
+
+  std::cout << "seed " << seed << '\n';
+  std::mt19937_64 rng{ seed };
+  bool ok = true;
+  long i = 0;
+  for (; ok and i < iterations; ++i) {
+    ok = check_slocbin(rng) and check_history(rng) and check_line_map(rng);
+  }
+  for (const auto& f : { slocbin_file, history_file, line_map_file, damaged_file }) {
+    std::filesystem::remove(f);
+  }
+  if (!ok) {
+    std::cerr << "iteration " << i - 1 << " of seed " << seed << '\n';
+    return EXIT_FAILURE;
+  }
+  std::cout << iterations << " cases: slocbin, history and line map round trips match.\n";
+  return EXIT_SUCCESS;
+}
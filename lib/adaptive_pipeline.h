@@ -0,0 +1,340 @@
+#ifndef ADAPTIVE_PIPELINE_H
+#define ADAPTIVE_PIPELINE_H
+
+/*!
+ * @file adaptive_pipeline.h
+ * @description
+ * Two-stage read/parse pipeline whose thread counts tune themselves at runtime (`-j auto`).
+ *
+ * How many concurrent reads it takes to keep the parsers busy depends on the storage: one or two
+ * on a warm page cache, many more over NFS, where each read mostly waits on the network. Reader
+ * threads load files into buffers and queue them; parser threads take them from the queue. Both
+ * pools are started at their maximum size, but only the first `io_limit` readers and
+ * `parse_limit` parsers work; the others sleep until the limits grow.
+ *
+ * A controller samples the queue every few ms and, every CONTROL_PERIOD, looks at the last
+ * window (files/s, queue occupancy, time the readers spent reading and the parsers waiting). A
+ * queue that stays full means the parsers are the bottleneck: one more parser, or one reader
+ * less when the parsers are at their maximum. Parsers that wait on an empty queue mean the
+ * reads are: one more reader, or one parser less. A change after which the throughput drops by
+ * more than 10% is undone, and the controller then holds for a while. Every change is kept,
+ * with its reason, for --stats.
+ */
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "cancellation.h"
+#include "file_buffer.h"
+
+/// Runs the read and parse stages of a list of files with self-tuning thread counts.
+class AdaptivePipeline {
+public:
+  /// Time between two decisions of the controller.
+  static constexpr std::chrono::milliseconds CONTROL_PERIOD{ 100 };
+  /// Time between two samples of the queue.
+  static constexpr std::chrono::milliseconds SAMPLE_PERIOD{ 10 };
+
+  /// A change of the thread counts, and what led to it.
+  struct Decision {
+    double at;           //!< Seconds since the start.
+    unsigned io_limit;   //!< Readers after the change.
+    unsigned parse_limit;  //!< Parsers after the change.
+    double files_per_s;  //!< Throughput of the window before the change.
+    double queue_fill;   //!< Mean fraction of the queue in use in that window.
+    double io_busy;      //!< Fraction of the readers' time spent in reads.
+    double starved;      //!< Fraction of the parsers' time spent waiting for a file.
+    std::string reason;
+  };
+
+  /**
+   * @brief Ctro.
+   *
+   * @param max_io: Most readers at once.
+   * @param max_parse: Most parsers at once.
+   * @param huge_pages: Passed to the FileBuffers.
+   */
+  AdaptivePipeline(unsigned max_io, unsigned max_parse, bool huge_pages)
+      : m_max_io{ std::max(1u, max_io) }, m_max_parse{ std::max(1u, max_parse) },
+        m_huge_pages{ huge_pages } {
+    m_io_limit = std::min(m_max_io, 2u);
+    m_parse_limit = std::max(1u, m_max_parse / 2);
+    m_capacity = 2 * m_max_parse + 4;
+  }
+
+  /**
+   * @brief Reads and processes `n` files.
+   *
+   * @param n: # of files.
+   * @param path_of: The path of file i.
+   * @param process: Called on a parser thread with each file index and its contents.
+   * @return false if a file could not be read; the remaining files are then dropped. They are
+   * also dropped, without an error, once stop_requested().
+   */
+  bool run(std::size_t n,
+           const std::function<const std::string&(std::size_t)>& path_of,
+           const std::function<void(std::size_t, std::string_view)>& process) {
+    m_n = n;
+    m_start = Clock::now();
+    m_loaders_running = m_max_io;
+    std::vector<std::thread> threads;
+    for (unsigned k = 0; k < m_max_io; ++k) {
+      threads.emplace_back([this, k, &path_of] { read_loop(k, path_of); });
+    }
+    for (unsigned k = 0; k < m_max_parse; ++k) {
+      threads.emplace_back([this, k, &process] { parse_loop(k, process); });
+    }
+    control_loop();
+    for (auto& t : threads) {
+      t.join();
+    }
+    m_seconds = seconds_since_start();
+    return !m_failed;
+  }
+
+  const std::vector<Decision>& decisions() const { return m_decisions; }
+
+  /// Prints the decisions and the final thread counts, for --stats.
+  void print(std::ostream& out) const {
+    out << "Adaptive jobs (max " << m_max_io << " readers, " << m_max_parse << " parsers):\n";
+    out << std::fixed << std::setprecision(2);
+    for (const auto& d : m_decisions) {
+      out << "  " << std::setw(7) << d.at << "s  readers " << std::setw(2) << d.io_limit
+          << "  parsers " << std::setw(2) << d.parse_limit << "  " << std::setprecision(0)
+          << std::setw(8) << d.files_per_s << " files/s  queue " << std::setw(3)
+          << d.queue_fill * 100 << "%  reading " << std::setw(3) << d.io_busy * 100
+          << "%  starved " << std::setw(3) << d.starved * 100 << "%  "
+          << d.reason << '\n'
+          << std::setprecision(2);
+    }
+    out << "  final: " << m_io_limit << " readers, " << m_parse_limit << " parsers, "
+        << std::setprecision(0) << (m_seconds > 0 ? static_cast<double>(m_n) / m_seconds : 0)
+        << " files/s overall\n";
+    out.unsetf(std::ios::floatfield);
+  }
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  double seconds_since_start() const {
+    return std::chrono::duration<double>(Clock::now() - m_start).count();
+  }
+
+  std::uint64_t ns_since_start() const {
+    return static_cast<std::uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - m_start).count());
+  }
+
+  bool finished() const { return m_failed or (m_loaders_running == 0 and m_queue.empty()); }
+
+  /// Buffer for a reader: a free one, or a new one while under the bound.
+  FileBuffer* take_buffer(std::unique_lock<std::mutex>& lock) {
+    m_space.wait(lock, [&] {
+      return m_failed or !m_free.empty() or m_buffers.size() < m_capacity + m_max_io + m_max_parse;
+    });
+    if (m_failed)
+      return nullptr;
+    if (!m_free.empty()) {
+      FileBuffer* b = m_free.back();
+      m_free.pop_back();
+      return b;
+    }
+    m_buffers.push_back(std::make_unique<FileBuffer>(m_huge_pages));
+    return m_buffers.back().get();
+  }
+
+  void read_loop(unsigned k, const std::function<const std::string&(std::size_t)>& path_of) {
+    MemScope scope{ mem_tag_e::PARSE };
+    for (;;) {
+      std::unique_lock<std::mutex> lock{ m_mutex };
+      m_limits.wait(lock, [&] {
+        return k < m_io_limit or m_failed or m_next >= m_n or stop_requested();
+      });
+      // Once a stop is requested no new file is read; those read already are parsed.
+      if (m_failed or m_next >= m_n or stop_requested())
+        break;
+      std::size_t i = m_next++;
+      FileBuffer* buffer = take_buffer(lock);
+      // The queue must have room once the file is read, so a full queue holds the reader here.
+      m_space.wait(lock, [&] { return m_failed or m_queue.size() < m_capacity; });
+      if (buffer == nullptr or m_failed)
+        break;
+      lock.unlock();
+      std::uint64_t t0 = ns_since_start();
+      bool ok = buffer->load(path_of(i));
+      std::uint64_t t1 = ns_since_start();
+      lock.lock();
+      m_io_ns += t1 - t0;
+      if (!ok) {
+        m_failed = true;
+        m_ready.notify_all();
+        m_space.notify_all();
+        m_limits.notify_all();
+        break;
+      }
+      m_queue.emplace_back(i, buffer);
+      m_ready.notify_one();
+    }
+    std::lock_guard<std::mutex> lock{ m_mutex };
+    m_loaders_running--;
+    m_ready.notify_all();
+    m_limits.notify_all();
+  }
+
+  void parse_loop(unsigned k, const std::function<void(std::size_t, std::string_view)>& process) {
+    MemScope scope{ mem_tag_e::PARSE };
+    for (;;) {
+      std::unique_lock<std::mutex> lock{ m_mutex };
+      m_limits.wait(lock, [&] { return k < m_parse_limit or finished(); });
+      std::uint64_t t0 = ns_since_start();
+      m_ready.wait(lock, [&] { return !m_queue.empty() or finished() or k >= m_parse_limit; });
+      m_starved_ns += ns_since_start() - t0;
+      if (finished())
+        break;
+      if (m_queue.empty())
+        continue;  // this parser was retired while it waited
+      auto [i, buffer] = m_queue.front();
+      m_queue.pop_front();
+      m_space.notify_one();
+      lock.unlock();
+      process(i, buffer->view());
+      m_done.fetch_add(1, std::memory_order_relaxed);
+      lock.lock();
+      m_free.push_back(buffer);
+      m_space.notify_one();
+    }
+    std::lock_guard<std::mutex> lock{ m_mutex };
+    m_limits.notify_all();
+    m_ready.notify_all();
+  }
+
+  void decide(const Decision& d) {
+    m_decisions.push_back(d);
+    m_limits.notify_all();
+    m_ready.notify_all();
+  }
+
+  void control_loop() {
+    std::uint64_t last_done = 0, last_io = 0, last_starved = 0;
+    double last_t = 0, fill_sum = 0;
+    unsigned n_samples = 0;
+    // The last change, undone if the throughput drops after it.
+    double rate_before_change = 0;
+    unsigned prev_io = 0, prev_parse = 0;
+    bool trial = false;
+    // After an undo, the controller holds for `backoff` windows, twice as long each time in a
+    // row, so it does not keep flipping between two settings.
+    unsigned hold = 0, backoff = 1;
+    for (;;) {
+      std::this_thread::sleep_for(SAMPLE_PERIOD);
+      std::unique_lock<std::mutex> lock{ m_mutex };
+      if (finished())
+        break;
+      if (stop_requested())
+        m_limits.notify_all();  // wake the idle readers, so they quit
+      fill_sum += static_cast<double>(m_queue.size()) / static_cast<double>(m_capacity);
+      if (++n_samples * SAMPLE_PERIOD < CONTROL_PERIOD)
+        continue;
+
+      double t = seconds_since_start();
+      std::uint64_t done = m_done.load(std::memory_order_relaxed);
+      std::uint64_t io_ns = m_io_ns;
+      std::uint64_t starved_ns = m_starved_ns;
+      Decision d{ t,
+                  m_io_limit,
+                  m_parse_limit,
+                  static_cast<double>(done - last_done) / (t - last_t),
+                  fill_sum / n_samples,
+                  static_cast<double>(io_ns - last_io) / 1e9 / (t - last_t) / m_io_limit,
+                  static_cast<double>(starved_ns - last_starved) / 1e9 / (t - last_t)
+                    / m_parse_limit,
+                  {} };
+      last_done = done;
+      last_io = io_ns;
+      last_starved = starved_ns;
+      last_t = t;
+      fill_sum = 0;
+      n_samples = 0;
+
+      if (trial and d.files_per_s < 0.9 * rate_before_change) {
+        trial = false;
+        m_io_limit = d.io_limit = prev_io;
+        m_parse_limit = d.parse_limit = prev_parse;
+        d.reason = "undo: throughput fell";
+        decide(d);
+        hold = backoff;
+        backoff = std::min(2 * backoff, 64u);
+        continue;
+      }
+      if (trial)
+        backoff = 1;
+      trial = false;
+      if (hold > 0) {
+        hold--;
+        continue;
+      }
+      prev_io = m_io_limit;
+      prev_parse = m_parse_limit;
+      if (d.queue_fill > 0.75 and m_parse_limit < m_max_parse) {
+        d.parse_limit = ++m_parse_limit;
+        d.reason = "queue full: parse-bound, one more parser";
+      } else if (d.queue_fill > 0.75 and m_io_limit > 1) {
+        d.io_limit = --m_io_limit;
+        d.reason = "queue full, parsers at max: one reader less";
+      } else if (d.starved > 0.5 and m_io_limit < m_max_io) {
+        d.io_limit = ++m_io_limit;
+        d.reason = "parsers starved: I/O-bound, one more reader";
+      } else if (d.starved > 0.5 and m_parse_limit > 1) {
+        d.parse_limit = --m_parse_limit;
+        d.reason = "parsers starved, readers at max: one parser less";
+      } else {
+        continue;
+      }
+      trial = true;
+      rate_before_change = d.files_per_s;
+      decide(d);
+    }
+  }
+
+  const unsigned m_max_io;
+  const unsigned m_max_parse;
+  const bool m_huge_pages;
+  std::size_t m_capacity;  //!< Most files read and waiting for a parser.
+  std::size_t m_n = 0;
+  Clock::time_point m_start;
+  double m_seconds = 0;
+
+  // Guarded by m_mutex.
+  std::mutex m_mutex;
+  std::condition_variable m_ready;   //!< A file was queued, or the run is over.
+  std::condition_variable m_space;   //!< The queue has room, or a buffer was freed.
+  std::condition_variable m_limits;  //!< The limits changed, or the run is over.
+  unsigned m_io_limit;
+  unsigned m_parse_limit;
+  std::size_t m_next = 0;  //!< Next file to read.
+  unsigned m_loaders_running = 0;
+  bool m_failed = false;
+  std::deque<std::pair<std::size_t, FileBuffer*>> m_queue;
+  std::vector<std::unique_ptr<FileBuffer>> m_buffers;
+  std::vector<FileBuffer*> m_free;
+  std::uint64_t m_io_ns = 0;       //!< Time spent in reads.
+  std::uint64_t m_starved_ns = 0;  //!< Time active parsers spent waiting for a file.
+  std::vector<Decision> m_decisions;
+
+  std::atomic<std::uint64_t> m_done{ 0 };  //!< Files processed.
+};
+
+#endif
@@ -0,0 +1,432 @@
+#ifndef ARROW_WRITER_H
+#define ARROW_WRITER_H
+
+/*!
+ * @file arrow_writer.h
+ * @description
+ * Writes the results as an Arrow IPC stream (`--format arrow`), without depending on the Arrow
+ * libraries. The stream can be read directly by pyarrow, DuckDB, Spark, polars, etc.
+ *
+ * Columns:
+ * - path: utf8, relative to the base directory
+ * - directory: dictionary<int32, utf8>, the parent directory of `path`
+ * - language: dictionary<int8, utf8>
+ * - blank, comments, doc, code, lines: int64
+ *
+ * Rows are written in record batches as soon as they are final. The directory dictionary grows
+ * with delta dictionary batches, so every batch only carries the directories it introduced.
+ *
+ * Reference: "Serialization and Interprocess Communication (IPC)" in
+ * https://arrow.apache.org/docs/format/Columnar.html
+ */
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "file_info.h"
+#include "table_report.h"
+
+/// # of rows per record batch.
+constexpr std::size_t ARROW_BATCH_ROWS = 64 * 1024;
+
+/**
+ * Minimal FlatBuffers builder, enough for the Arrow IPC metadata.
+ *
+ * Like the official builder, the buffer is built back to front: children are written first and
+ * referred to by their distance from the end of the buffer. Assumes a little-endian host.
+ */
+class FlatBuilder {
+public:
+  /// Position of an object, counted from the end of the buffer.
+  using Offset = std::uint32_t;
+
+  Offset size() const { return static_cast<Offset>(m_buf.size()); }
+
+  /// Pads so that, after `additional` more bytes, the size is a multiple of `alignment`.
+  void align(std::size_t alignment, std::size_t additional = 0) {
+    m_minalign = std::max(m_minalign, alignment);
+    std::size_t pad = (alignment - (m_buf.size() + additional) % alignment) % alignment;
+    m_buf.insert(m_buf.begin(), pad, 0);
+  }
+
+  template <typename T>
+  void prepend_scalar(T value) {
+    align(sizeof(T));
+    std::uint8_t bytes[sizeof(T)];
+    std::memcpy(bytes, &value, sizeof(T));
+    m_buf.insert(m_buf.begin(), bytes, bytes + sizeof(T));
+  }
+
+  /// Writes a reference to an object that is already in the buffer.
+  void prepend_offset(Offset target) {
+    align(4);
+    prepend_scalar<std::uint32_t>(size() + 4 - target);
+  }
+
+  Offset create_string(std::string_view s) {
+    align(4, s.size() + 1);
+    m_buf.insert(m_buf.begin(), 0);
+    m_buf.insert(m_buf.begin(), s.begin(), s.end());
+    prepend_scalar<std::uint32_t>(static_cast<std::uint32_t>(s.size()));
+    return size();
+  }
+
+  Offset create_offset_vector(const std::vector<Offset>& items) {
+    align(4, 4 * items.size());
+    for (auto it = items.rbegin(); it != items.rend(); ++it) {
+      prepend_offset(*it);
+    }
+    prepend_scalar<std::uint32_t>(static_cast<std::uint32_t>(items.size()));
+    return size();
+  }
+
+  /// Vector of 16-byte structs made of two int64 (Arrow's FieldNode and Buffer).
+  Offset create_pair_vector(const std::vector<std::pair<std::int64_t, std::int64_t>>& items) {
+    align(4, 16 * items.size());
+    align(8, 16 * items.size());
+    for (auto it = items.rbegin(); it != items.rend(); ++it) {
+      std::int64_t pair[2] = { it->first, it->second };
+      auto bytes = reinterpret_cast<const std::uint8_t*>(pair);
+      m_buf.insert(m_buf.begin(), bytes, bytes + sizeof pair);
+    }
+    prepend_scalar<std::uint32_t>(static_cast<std::uint32_t>(items.size()));
+    return size();
+  }
+
+  void start_table() {
+    m_fields.clear();
+    m_table_start = size();
+  }
+
+  template <typename T>
+  void add_scalar(int slot, T value) {
+    prepend_scalar(value);
+    m_fields.emplace_back(slot, size());
+  }
+
+  void add_offset(int slot, Offset target) {
+    prepend_offset(target);
+    m_fields.emplace_back(slot, size());
+  }
+
+  Offset end_table() {
+    prepend_scalar<std::int32_t>(0);  // vtable offset, patched below
+    Offset object = size();
+    int n_slots = 0;
+    for (const auto& f : m_fields) {
+      n_slots = std::max(n_slots, f.first + 1);
+    }
+    std::vector<std::uint16_t> vtable(static_cast<std::size_t>(n_slots), 0);
+    for (const auto& f : m_fields) {
+      vtable[static_cast<std::size_t>(f.first)] = static_cast<std::uint16_t>(object - f.second);
+    }
+    for (auto it = vtable.rbegin(); it != vtable.rend(); ++it) {
+      prepend_scalar<std::uint16_t>(*it);
+    }
+    prepend_scalar<std::uint16_t>(static_cast<std::uint16_t>(object - m_table_start));
+    prepend_scalar<std::uint16_t>(static_cast<std::uint16_t>(4 + 2 * n_slots));
+    auto soffset = static_cast<std::int32_t>(size() - object);
+    std::memcpy(m_buf.data() + (size() - object), &soffset, sizeof soffset);
+    return object;
+  }
+
+  /// Writes the root reference and returns the finished buffer.
+  const std::vector<std::uint8_t>& finish(Offset root) {
+    align(std::max<std::size_t>(m_minalign, 8), 4);
+    prepend_offset(root);
+    return m_buf;
+  }
+
+private:
+  std::vector<std::uint8_t> m_buf;
+  std::size_t m_minalign = 1;
+  Offset m_table_start = 0;
+  std::vector<std::pair<int, Offset>> m_fields;  //!< (slot, position) of the open table's fields.
+};
+
+/// Streams FileInfo rows as an Arrow IPC stream.
+class ArrowStreamWriter {
+public:
+  /// Key/value pairs attached to the schema or to a message.
+  using Metadata = std::vector<std::pair<std::string, std::string>>;
+
+  /**
+   * @brief Ctro.
+   *
+   * @param out: The stream the IPC messages are written to.
+   * @param base_dir: Paths are written relative to this directory.
+   */
+  ArrowStreamWriter(std::ostream& out, std::string base_dir)
+      : m_out{ out }, m_base_dir{ std::move(base_dir) } {}
+
+  /**
+   * @brief Writes the schema, with `metadata` as key/value pairs of the schema.
+   */
+  void write_schema(const Metadata& metadata = {}) {
+    FlatBuilder b;
+    std::vector<FlatBuilder::Offset> fields;
+    fields.push_back(make_field(b, "path", TYPE_UTF8, -1));
+    fields.push_back(make_field(b, "directory", TYPE_UTF8, DIRECTORY_DICT, 32));
+    fields.push_back(make_field(b, "language", TYPE_UTF8, LANGUAGE_DICT, 8));
+    for (const char* name : { "blank", "comments", "doc", "code", "lines" }) {
+      fields.push_back(make_field(b, name, TYPE_INT, -1));
+    }
+    auto fields_vec = b.create_offset_vector(fields);
+
+    auto metadata_vec = make_key_values(b, metadata);
+
+    b.start_table();
+    b.add_scalar<std::int16_t>(0, 0);  // little endian
+    b.add_offset(1, fields_vec);
+    b.add_offset(2, metadata_vec);
+    write_message(b, HEADER_SCHEMA, b.end_table(), {});
+  }
+
+  /**
+   * @brief Writes files [begin, end) as one record batch, preceded by the dictionary batches it
+   * needs.
+   *
+   * @param metadata: If not empty, the custom metadata of the record batch message.
+   */
+  void write_batch(const FileInfo* begin, const FileInfo* end, const Metadata& metadata = {}) {
+    auto n = static_cast<std::size_t>(end - begin);
+    std::vector<std::string> paths;
+    std::vector<std::int32_t> directories;
+    std::vector<std::int8_t> languages;
+    std::vector<std::int64_t> counts[5];
+    std::vector<std::string> new_directories;
+    paths.reserve(n);
+    for (const FileInfo* f = begin; f != end; ++f) {
+      paths.push_back(relative_basename(f->filename, m_base_dir));
+      std::string dir = std::filesystem::path{ paths.back() }.parent_path().string();
+      if (dir.empty())
+        dir = ".";
+      auto [it, inserted] =
+        m_directory_ids.emplace(dir, static_cast<std::int32_t>(m_directory_ids.size()));
+      if (inserted)
+        new_directories.push_back(dir);
+      directories.push_back(it->second);
+      languages.push_back(static_cast<std::int8_t>(f->type));
+      counts[0].push_back(static_cast<std::int64_t>(f->n_blank));
+      counts[1].push_back(static_cast<std::int64_t>(all_comment_lines(*f)));
+      counts[2].push_back(static_cast<std::int64_t>(all_doc_lines(*f)));
+      counts[3].push_back(static_cast<std::int64_t>(f->n_loc));
+      counts[4].push_back(static_cast<std::int64_t>(f->n_lines));
+    }
+
+    if (!m_dictionaries_written) {
+      std::vector<std::string> names;
+      for (int t = 0; t <= UNDEF; ++t) {
+        names.push_back(lang_type_to_string(static_cast<lang_type_e>(t)));
+      }
+      write_dictionary(LANGUAGE_DICT, names, false);
+      write_dictionary(DIRECTORY_DICT, new_directories, false);
+      m_dictionaries_written = true;
+    } else if (!new_directories.empty()) {
+      write_dictionary(DIRECTORY_DICT, new_directories, true);
+    }
+
+    Body body;
+    body.add_utf8(paths);
+    body.add_fixed(directories);
+    body.add_fixed(languages);
+    for (const auto& column : counts) {
+      body.add_fixed(column);
+    }
+    write_record_batch(static_cast<std::int64_t>(n), body, metadata);
+  }
+
+  /**
+   * @brief Writes the end-of-stream marker.
+   *
+   * @param metadata: Facts only known at the end of the run (e.g. that the results are
+   * partial). The schema is long gone, so they go with a last record batch without rows, as the
+   * custom metadata of its message.
+   */
+  void finish(const Metadata& metadata = {}) {
+    if (!metadata.empty())
+      write_batch(nullptr, nullptr, metadata);
+    const std::uint32_t eos[2] = { 0xFFFFFFFF, 0 };
+    m_out.write(reinterpret_cast<const char*>(eos), sizeof eos);
+    m_out.flush();
+  }
+
+private:
+  // Values of the Arrow flatbuffer unions and enums used here (Schema.fbs, Message.fbs).
+  static constexpr std::uint8_t HEADER_SCHEMA = 1;
+  static constexpr std::uint8_t HEADER_DICTIONARY_BATCH = 2;
+  static constexpr std::uint8_t HEADER_RECORD_BATCH = 3;
+  static constexpr std::uint8_t TYPE_INT = 2;
+  static constexpr std::uint8_t TYPE_UTF8 = 5;
+  static constexpr std::int16_t METADATA_V5 = 4;
+  static constexpr std::int64_t DIRECTORY_DICT = 0;
+  static constexpr std::int64_t LANGUAGE_DICT = 1;
+
+  /// Message body: the buffers of every column, each padded to 8 bytes.
+  struct Body {
+    std::vector<std::uint8_t> bytes;
+    std::vector<std::pair<std::int64_t, std::int64_t>> buffers;  //!< (offset, length)
+    std::vector<std::pair<std::int64_t, std::int64_t>> nodes;    //!< (length, null count)
+
+    void add_buffer(const void* data, std::size_t len) {
+      buffers.emplace_back(static_cast<std::int64_t>(bytes.size()), static_cast<std::int64_t>(len));
+      auto p = static_cast<const std::uint8_t*>(data);
+      bytes.insert(bytes.end(), p, p + len);
+      bytes.resize((bytes.size() + 7) / 8 * 8, 0);
+    }
+
+    template <typename T>
+    void add_fixed(const std::vector<T>& values) {
+      nodes.emplace_back(static_cast<std::int64_t>(values.size()), 0);
+      add_buffer(nullptr, 0);  // no validity bitmap: no nulls
+      add_buffer(values.data(), values.size() * sizeof(T));
+    }
+
+    void add_utf8(const std::vector<std::string>& values) {
+      std::vector<std::int32_t> offsets{ 0 };
+      std::string data;
+      for (const auto& v : values) {
+        data += v;
+        offsets.push_back(static_cast<std::int32_t>(data.size()));
+      }
+      nodes.emplace_back(static_cast<std::int64_t>(values.size()), 0);
+      add_buffer(nullptr, 0);
+      add_buffer(offsets.data(), offsets.size() * sizeof(std::int32_t));
+      add_buffer(data.data(), data.size());
+    }
+  };
+
+  std::ostream& m_out;
+  std::string m_base_dir;
+  std::unordered_map<std::string, std::int32_t> m_directory_ids;
+  bool m_dictionaries_written = false;
+
+  /// Builds an Int type table.
+  static FlatBuilder::Offset make_int(FlatBuilder& b, int bit_width) {
+    b.start_table();
+    b.add_scalar<std::int32_t>(0, bit_width);
+    b.add_scalar<std::uint8_t>(1, 1);  // signed
+    return b.end_table();
+  }
+
+  /**
+   * @brief Builds a Field table.
+   *
+   * @param dict_id: Dictionary id if the field is dictionary encoded, -1 otherwise.
+   * @param index_width: Bit width of the dictionary indices.
+   */
+  static FlatBuilder::Offset make_field(FlatBuilder& b,
+                                        const char* name,
+                                        std::uint8_t type,
+                                        std::int64_t dict_id,
+                                        int index_width = 0) {
+    auto name_off = b.create_string(name);
+    FlatBuilder::Offset type_off;
+    if (type == TYPE_INT) {
+      type_off = make_int(b, 64);
+    } else {
+      b.start_table();
+      type_off = b.end_table();
+    }
+    FlatBuilder::Offset dict_off = 0;
+    if (dict_id >= 0) {
+      auto index_type = make_int(b, index_width);
+      b.start_table();
+      b.add_scalar<std::int64_t>(0, dict_id);
+      b.add_offset(1, index_type);
+      dict_off = b.end_table();
+    }
+    auto children = b.create_offset_vector({});
+    b.start_table();
+    b.add_offset(0, name_off);
+    b.add_scalar<std::uint8_t>(1, 0);  // not nullable
+    b.add_scalar<std::uint8_t>(2, type);
+    b.add_offset(3, type_off);
+    if (dict_id >= 0)
+      b.add_offset(4, dict_off);
+    b.add_offset(5, children);
+    return b.end_table();
+  }
+
+  /// Builds a vector of KeyValue tables.
+  static FlatBuilder::Offset make_key_values(FlatBuilder& b, const Metadata& metadata) {
+    std::vector<FlatBuilder::Offset> pairs;
+    for (const auto& [key, value] : metadata) {
+      auto k = b.create_string(key);
+      auto v = b.create_string(value);
+      b.start_table();
+      b.add_offset(0, k);
+      b.add_offset(1, v);
+      pairs.push_back(b.end_table());
+    }
+    return b.create_offset_vector(pairs);
+  }
+
+  /// Builds a RecordBatch table describing `body`.
+  static FlatBuilder::Offset make_record_batch(FlatBuilder& b,
+                                               std::int64_t length,
+                                               const Body& body) {
+    auto nodes = b.create_pair_vector(body.nodes);
+    auto buffers = b.create_pair_vector(body.buffers);
+    b.start_table();
+    b.add_scalar<std::int64_t>(0, length);
+    b.add_offset(1, nodes);
+    b.add_offset(2, buffers);
+    return b.end_table();
+  }
+
+  void write_record_batch(std::int64_t length, const Body& body, const Metadata& metadata) {
+    FlatBuilder b;
+    auto batch = make_record_batch(b, length, body);
+    write_message(b, HEADER_RECORD_BATCH, batch, body.bytes, metadata);
+  }
+
+  void write_dictionary(std::int64_t id, const std::vector<std::string>& values, bool delta) {
+    Body body;
+    body.add_utf8(values);
+    FlatBuilder b;
+    auto batch = make_record_batch(b, static_cast<std::int64_t>(values.size()), body);
+    b.start_table();
+    b.add_scalar<std::int64_t>(0, id);
+    b.add_offset(1, batch);
+    b.add_scalar<std::uint8_t>(2, delta ? 1 : 0);
+    write_message(b, HEADER_DICTIONARY_BATCH, b.end_table(), body.bytes);
+  }
+
+  /// Wraps a header in a Message and writes it with its body, using the encapsulated format.
+  void write_message(FlatBuilder& b,
+                     std::uint8_t header_type,
+                     FlatBuilder::Offset header,
+                     const std::vector<std::uint8_t>& body,
+                     const Metadata& metadata = {}) {
+    auto custom_metadata = metadata.empty() ? 0 : make_key_values(b, metadata);
+    b.start_table();
+    if (!metadata.empty())
+      b.add_offset(4, custom_metadata);
+    b.add_scalar<std::int64_t>(3, static_cast<std::int64_t>(body.size()));
+    b.add_offset(2, header);
+    b.add_scalar<std::int16_t>(0, METADATA_V5);
+    b.add_scalar<std::uint8_t>(1, header_type);
+    const auto& meta = b.finish(b.end_table());
+
+    // Continuation marker, then the metadata length including the padding to 8 bytes.
+    std::size_t padded = (meta.size() + 7) / 8 * 8;
+    const std::uint32_t prefix[2] = { 0xFFFFFFFF, static_cast<std::uint32_t>(padded) };
+    m_out.write(reinterpret_cast<const char*>(prefix), sizeof prefix);
+    m_out.write(reinterpret_cast<const char*>(meta.data()),
+                static_cast<std::streamsize>(meta.size()));
+    static const char zeros[8] = {};
+    m_out.write(zeros, static_cast<std::streamsize>(padded - meta.size()));
+    m_out.write(reinterpret_cast<const char*>(body.data()),
+                static_cast<std::streamsize>(body.size()));
+  }
+};
+
+#endif
@@ -0,0 +1,307 @@
+#ifndef BUILD_DEPS_H
+#define BUILD_DEPS_H
+
+/*!
+ * @file build_deps.h
+ * @description
+ * Reads the dependency information a build left behind (`--deps`): Makefile-style `.d` files
+ * written by the compiler (-MD/-MMD), and ninja's `.ninja_deps` log, where ninja moves them.
+ *
+ * Each compiled object gives a translation unit: its source file followed by every header the
+ * compiler actually opened. That is the exact set of files that were built, without resolving
+ * #includes ourselves. Paths are interned, so a header shared by many units is one file.
+ */
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "file_info.h"
+
+/// Absolute, lexically normal form of `path`, the key a file is interned under.
+inline std::string deps_key(const std::filesystem::path& path) {
+  std::error_code ec;
+  std::filesystem::path full = std::filesystem::absolute(path, ec);
+  return (ec ? path : full).lexically_normal().string();
+}
+
+/// The translation units of a build and the files they read.
+class DepsGraph {
+public:
+  /// One compiled object.
+  struct Unit {
+    std::string output;               //!< The object file, as the build names it.
+    std::vector<std::uint32_t> inputs;  //!< Ids of the files read, the source first.
+  };
+
+  /// The absolute, normalized path of every file read by some unit, indexed by id.
+  const std::vector<std::string>& files() const { return m_files; }
+
+  /// The units, in the order they were first read.
+  const std::vector<Unit>& units() const { return m_units; }
+
+  /**
+   * @brief Reads the dependencies of a build directory: its `.d` files, recursively, and its
+   * `.ninja_deps` log, if any.
+   *
+   * @param build_dir: The build directory; relative paths of the dependencies are taken from it.
+   * @param error: Receives a description of the problem, if any.
+   * @return true if everything found could be read.
+   */
+  bool read_build_dir(const std::string& build_dir, std::string& error) {
+    m_dir = build_dir;
+    std::error_code ec;
+    std::filesystem::recursive_directory_iterator it{ build_dir, ec }, end;
+    if (ec) {
+      error = "could not read " + build_dir;
+      return false;
+    }
+    for (; it != end; it.increment(ec)) {
+      if (it->path().extension() == ".d" and it->is_regular_file(ec)
+          and !read_make_deps(it->path().string(), error)) {
+        return false;
+      }
+    }
+    std::filesystem::path log = m_dir / ".ninja_deps";
+    return !std::filesystem::exists(log, ec) or read_ninja_deps(log.string(), error);
+  }
+
+  /**
+   * @brief Reads a Makefile-style dependency file, "object: source header...".
+   *
+   * Rules without prerequisites (the phony targets of -MP) are skipped.
+   */
+  bool read_make_deps(const std::string& filename, std::string& error) {
+    std::ifstream in{ filename, std::ios::binary };
+    if (!in.is_open()) {
+      error = "could not open " + filename;
+      return false;
+    }
+    std::string text{ std::istreambuf_iterator<char>{ in }, std::istreambuf_iterator<char>{} };
+
+    // Splits the file into words, rule by rule. A backslash-newline continues the rule, "\ "
+    // and "\#" escape those characters in a path, and "$$" is a '$'.
+    std::vector<std::string> targets;
+    std::vector<std::uint32_t> inputs;
+    std::string word;
+    bool in_targets = true;
+    auto end_word = [&] {
+      if (word.empty())
+        return;
+      // The ':' ending the targets may stick to the last one.
+      if (in_targets and word.back() == ':') {
+        word.pop_back();
+        if (!word.empty())
+          targets.push_back(word);
+        in_targets = false;
+      } else if (in_targets) {
+        targets.push_back(word);
+      } else {
+        inputs.push_back(intern(word));
+      }
+      word.clear();
+    };
+    auto end_rule = [&] {
+      end_word();
+      if (!inputs.empty()) {
+        for (const auto& target : targets) {
+          add_unit(target, inputs);
+        }
+      }
+      targets.clear();
+      inputs.clear();
+      in_targets = true;
+    };
+    for (std::size_t i = 0; i < text.size(); ++i) {
+      char c = text[i];
+      if (c == '\\' and i + 1 < text.size()) {
+        char next = text[i + 1];
+        if (next == '\n' or (next == '\r' and i + 2 < text.size() and text[i + 2] == '\n')) {
+          end_word();
+          i += next == '\r' ? 2 : 1;
+          continue;
+        }
+        if (next == ' ' or next == '#' or next == '\\') {
+          word += next;
+          ++i;
+          continue;
+        }
+        word += c;
+      } else if (c == '$' and i + 1 < text.size() and text[i + 1] == '$') {
+        word += '$';
+        ++i;
+      } else if (c == '\n') {
+        end_rule();
+      } else if (c == ' ' or c == '\t' or c == '\r') {
+        end_word();
+      } else if (c == ':' and in_targets and (i + 1 == text.size() or text[i + 1] == ' '
+                                              or text[i + 1] == '\t' or text[i + 1] == '\n'
+                                              or text[i + 1] == '\r')) {
+        // "C:\..." is a path on Windows; only ':' before a blank ends the targets.
+        word += c;
+        end_word();
+        in_targets = false;
+      } else {
+        word += c;
+      }
+    }
+    end_rule();
+    return true;
+  }
+
+  /**
+   * @brief Reads a ninja deps log (versions 3 and 4).
+   *
+   * The log is a sequence of records: paths, numbered in order, and the dependencies of an
+   * output as path numbers. A later record for an output replaces the earlier ones.
+   */
+  bool read_ninja_deps(const std::string& filename, std::string& error) {
+    std::ifstream in{ filename, std::ios::binary };
+    std::string data{ std::istreambuf_iterator<char>{ in }, std::istreambuf_iterator<char>{} };
+    constexpr std::string_view signature = "# ninjadeps\n";
+    std::int32_t version = 0;
+    if (data.size() < signature.size() + 4 or data.compare(0, signature.size(), signature) != 0) {
+      error = filename + " is not a ninja deps log";
+      return false;
+    }
+    std::memcpy(&version, data.data() + signature.size(), 4);
+    if (version != 3 and version != 4) {
+      error = filename + ": unsupported ninja deps log version " + std::to_string(version);
+      return false;
+    }
+    const std::size_t mtime_size = version == 4 ? 8 : 4;
+
+    // The paths of the log, by number, and the last dependencies of each output. Paths are
+    // interned once the log is over, so those of replaced records are left out.
+    std::vector<std::string> paths;
+    std::vector<std::int32_t> outputs;
+    std::unordered_map<std::int32_t, std::vector<std::int32_t>> deps;
+    std::size_t pos = signature.size() + 4;
+    while (data.size() - pos >= 4) {
+      std::uint32_t header;
+      std::memcpy(&header, data.data() + pos, 4);
+      const bool is_deps = (header >> 31) != 0;
+      const std::size_t size = header & 0x7fffffffu;
+      pos += 4;
+      // A record cut short by an interrupted build ends the log.
+      if (size > data.size() - pos or size % 4 != 0 or size < 4)
+        break;
+      const char* record = data.data() + pos;
+      pos += size;
+      if (!is_deps) {
+        std::string_view path{ record, size - 4 };
+        while (!path.empty() and path.back() == '\0') {
+          path.remove_suffix(1);
+        }
+        paths.emplace_back(path);
+        continue;
+      }
+      if (size < 4 + mtime_size)
+        break;
+      std::int32_t out;
+      std::memcpy(&out, record, 4);
+      std::vector<std::int32_t> ids((size - 4 - mtime_size) / 4);
+      std::memcpy(ids.data(), record + 4 + mtime_size, ids.size() * 4);
+      bool ok = out >= 0 and static_cast<std::size_t>(out) < paths.size();
+      for (std::int32_t id : ids) {
+        ok = ok and id >= 0 and static_cast<std::size_t>(id) < paths.size();
+      }
+      if (!ok or ids.empty())
+        continue;
+      auto [it, added] = deps.try_emplace(out);
+      if (added)
+        outputs.push_back(out);
+      it->second = std::move(ids);
+    }
+
+    std::vector<std::uint32_t> inputs;
+    for (std::int32_t out : outputs) {
+      inputs.clear();
+      for (std::int32_t id : deps[out]) {
+        inputs.push_back(intern(paths[static_cast<std::size_t>(id)]));
+      }
+      add_unit(paths[static_cast<std::size_t>(out)], inputs);
+    }
+    return true;
+  }
+
+private:
+  /// Id of a path, relative to the build directory if it is not absolute. Paths are made
+  /// absolute, so a header listed as /x/src/c.h by one unit and ../src/c.h by another is one file.
+  std::uint32_t intern(const std::string& path) {
+    std::string normal = deps_key(m_dir / path);
+    auto [it, added] = m_ids.emplace(std::move(normal), static_cast<std::uint32_t>(m_files.size()));
+    if (added)
+      m_files.push_back(it->first);
+    return it->second;
+  }
+
+  /// Sets the inputs of a unit. A header reached by two spellings of its path is listed twice
+  /// by the compiler, but read once.
+  void add_unit(const std::string& output, const std::vector<std::uint32_t>& inputs) {
+    auto [it, added] = m_unit_ids.emplace(output, m_units.size());
+    if (added)
+      m_units.push_back(Unit{ output, {} });
+    std::vector<std::uint32_t>& unit_inputs = m_units[it->second].inputs;
+    unit_inputs.clear();
+    m_stamp.resize(m_files.size(), 0);
+    m_generation++;
+    for (std::uint32_t id : inputs) {
+      if (m_stamp[id] != m_generation) {
+        m_stamp[id] = m_generation;
+        unit_inputs.push_back(id);
+      }
+    }
+  }
+
+  std::filesystem::path m_dir;
+  std::vector<std::string> m_files;
+  std::unordered_map<std::string, std::uint32_t> m_ids;
+  std::vector<Unit> m_units;
+  std::unordered_map<std::string, std::size_t> m_unit_ids;  //!< Output -> index in m_units.
+  std::vector<std::uint64_t> m_stamp;  //!< Per file, the last m_generation it was seen in.
+  std::uint64_t m_generation = 0;
+};
+
+/// The code a translation unit puts through the compiler.
+struct UnitCounts {
+  std::string source;    //!< The source file of the unit.
+  std::size_t n_files;   //!< Source and headers read.
+  count_t n_loc = 0;     //!< Lines of code of all of them.
+  count_t n_lines = 0;   //!< Lines of all of them.
+};
+
+/**
+ * @brief Sums, for each unit, the counts of the files it reads.
+ *
+ * @param graph: The units.
+ * @param file_index: For each file of the graph, its index in `files`, or -1 if it was not
+ * counted.
+ * @param files: The counted files.
+ * @return the counts of the units, in the order of graph.units().
+ */
+inline std::vector<UnitCounts> unit_counts(const DepsGraph& graph,
+                                           const std::vector<std::int64_t>& file_index,
+                                           const FileList& files) {
+  std::vector<UnitCounts> units;
+  units.reserve(graph.units().size());
+  for (const auto& unit : graph.units()) {
+    UnitCounts counts{ graph.files()[unit.inputs.front()], unit.inputs.size() };
+    for (std::uint32_t id : unit.inputs) {
+      if (file_index[id] < 0)
+        continue;
+      const FileInfo& f = files[static_cast<std::size_t>(file_index[id])];
+      counts.n_loc += f.n_loc;
+      counts.n_lines += f.n_lines;
+    }
+    units.push_back(std::move(counts));
+  }
+  return units;
+}
+
+#endif
@@ -0,0 +1,139 @@
+#ifndef CANCELLATION_H
+#define CANCELLATION_H
+
+/*!
+ * @file cancellation.h
+ * @description
+ * Stopping a run early (`--deadline`, SIGINT, SIGTERM) and still getting the results counted so
+ * far.
+ *
+ * The signal handlers only set an atomic flag. The walk and the workers look at it before
+ * taking the next file: files being parsed are finished, no new ones are started. The files
+ * that were counted are then reported as partial results, with the share of the files found
+ * they cover, so nobody mistakes them for the whole tree.
+ *
+ * SIGINT and SIGTERM are handled once: a second one gets the default action, which still kills
+ * a run that takes too long to wind down.
+ */
+#include <atomic>
+#include <csignal>
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <sys/time.h>
+
+/// Why a run stopped before counting every file.
+enum stop_reason_e : int {
+  STOP_NONE = 0,  //!< It did not.
+  STOP_DEADLINE,  //!< --deadline expired.
+  STOP_SIGINT,
+  STOP_SIGTERM,
+};
+
+/// Set once, by the first signal; read by the walk and the workers.
+inline std::atomic<int>& stop_reason() {
+  static std::atomic<int> reason{ STOP_NONE };
+  return reason;
+}
+
+static_assert(std::atomic<int>::is_always_lock_free, "the stop flag is set by signal handlers");
+
+/// Whether the walk and the workers should stop taking new files.
+inline bool stop_requested() {
+  return stop_reason().load(std::memory_order_relaxed) != STOP_NONE;
+}
+
+/// Signal handler: records the first reason to stop.
+inline void on_stop_signal(int sig) {
+  int none = STOP_NONE;
+  stop_reason().compare_exchange_strong(
+    none, sig == SIGALRM ? STOP_DEADLINE : sig == SIGINT ? STOP_SIGINT : STOP_SIGTERM);
+}
+
+/**
+ * @brief Handles SIGINT and SIGTERM, and arms the deadline, if any.
+ *
+ * System calls are restarted after the handler, so the reads in flight complete.
+ *
+ * @param deadline: Seconds of wall time the run has; 0 for no deadline.
+ * @return false if the deadline timer could not be armed.
+ */
+inline bool install_stop_handlers(double deadline) {
+  stop_reason();  // the flag is created here, not in a handler
+  struct sigaction action {};
+  action.sa_handler = on_stop_signal;
+  sigemptyset(&action.sa_mask);
+  action.sa_flags = SA_RESTART | SA_RESETHAND;
+  sigaction(SIGINT, &action, nullptr);
+  sigaction(SIGTERM, &action, nullptr);
+  if (deadline <= 0)
+    return true;
+  action.sa_flags = SA_RESTART;
+  sigaction(SIGALRM, &action, nullptr);
+  struct itimerval timer {};
+  timer.it_value.tv_sec = static_cast<time_t>(deadline);
+  timer.it_value.tv_usec = static_cast<suseconds_t>((deadline - timer.it_value.tv_sec) * 1e6);
+  if (timer.it_value.tv_sec == 0 and timer.it_value.tv_usec == 0)
+    timer.it_value.tv_usec = 1;
+  return setitimer(ITIMER_REAL, &timer, nullptr) == 0;
+}
+
+/// How much of the tree a run counted.
+struct RunCoverage {
+  std::size_t n_found = 0;     //!< Files found by the walk.
+  std::size_t n_counted = 0;   //!< Files counted; the results only have these.
+  bool walk_complete = true;   //!< false if the walk was stopped too: more files may exist.
+  stop_reason_e reason = STOP_NONE;
+
+  /// Whether the results miss files: the run stopped before counting them all.
+  bool partial() const {
+    return reason != STOP_NONE and (n_counted < n_found or !walk_complete);
+  }
+
+  /// Share of the files found that were counted, in percent.
+  double percent() const {
+    return n_found == 0 ? 100.0 : 100.0 * static_cast<double>(n_counted) / n_found;
+  }
+
+  const char* reason_name() const {
+    switch (reason) {
+    case STOP_DEADLINE:
+      return "deadline";
+    case STOP_SIGINT:
+      return "SIGINT";
+    case STOP_SIGTERM:
+      return "SIGTERM";
+    default:
+      return "none";
+    }
+  }
+
+  /// One line for humans, e.g. "PARTIAL RESULTS: 812 of 70000 files counted (1.2%), stopped
+  /// by the deadline".
+  std::string describe() const {
+    char buf[160];
+    std::snprintf(buf, sizeof buf,
+                  "PARTIAL RESULTS: %zu of %zu files counted (%.1f%%), stopped by %s%s",
+                  n_counted, n_found, percent(),
+                  reason == STOP_DEADLINE ? "the deadline" : reason_name(),
+                  walk_complete ? "" : " while still looking for files");
+    return buf;
+  }
+
+  /// Exit status of a partial run: 124 for the deadline, as timeout(1), 128 + the signal
+  /// otherwise, as a shell reports a killed command.
+  int exit_status() const {
+    switch (reason) {
+    case STOP_DEADLINE:
+      return 124;
+    case STOP_SIGINT:
+      return 128 + SIGINT;
+    case STOP_SIGTERM:
+      return 128 + SIGTERM;
+    default:
+      return 0;
+    }
+  }
+};
+
+#endif
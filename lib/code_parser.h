@@ -0,0 +1,154 @@
+#ifndef CODE_PARSER_H
+#define CODE_PARSER_H
+
+/*!
+ * @file code_parser.h
+ * @description
+ * Line classifier shared by the sloc executable and its benchmark programs.
+ */
+#include <cstdint>
+#include <string>
+
+/// What parse_line() counted a line as.
+enum line_category_e : std::uint8_t {
+  LINE_BLANK = 0,  //!< Blank line.
+  LINE_CODE,       //!< Line of code.
+  LINE_COMMENT,    //!< Regular comment line.
+  LINE_DOC,        //!< Documentation comment line.
+};
+
+/// Those are auxiliar functions, but we need to implement here because we need those available in
+/// the next class scope
+/**
+ * @brief Trims whitespace to the left of a string.
+ *
+ * @param s: The string to trim.
+ * @param t: A C-string containing characters to trim (whitespace characters).
+ * @return a new string, left-trimmed.
+ */
+inline std::string ltrim(const std::string& s, const char* t = " \t\n\r\f\v") {
+  std::string clone{ s };
+  clone.erase(0, clone.find_first_not_of(t));
+  return clone;
+}
+
+/**
+ * @brief Trims whitespace to the right of a string.
+ *
+ * @param s: The string to trim.
+ * @param t: A C-string containing characters to trim (whitespace characters).
+ * @return a new string, right-trimmed.
+ */
+inline std::string rtrim(const std::string& s, const char* t = " \t\n\r\f\v") {
+  std::string clone{ s };
+  clone.erase(clone.find_last_not_of(t) + 1);
+  return clone;
+}
+
+/**
+ * @brief Trims whitespace on both sides of a string
+ *
+ * @param s The string to trim.
+ * @param t A C-string containing characters to trim (whitespace characters).
+ * @return a new string, trimmed from both sides.
+ */
+inline std::string trim(const std::string& s, const char* t = " \t\n\r\f\v") {
+  return rtrim(ltrim(s, t), t);
+}
+
+/// Class to parse each line, store the current state and the results.
+class CodeParser {
+private:
+  int blank_lines = 0;
+  int code_lines = 0;
+  int comment_lines = 0;
+  int doc_comment_lines = 0;
+
+  bool in_block_comment = false;
+  bool in_doc_block_comment = false;
+
+public:
+  /// Counts one line and returns what it was counted as.
+  line_category_e parse_line(const std::string& line) {
+    std::string trimmed = trim(line);
+    if (trimmed.empty()) {
+      blank_lines++;
+      return LINE_BLANK;
+    }
+
+    bool is_doc_line = false;
+    bool is_comment_line = false;
+    bool inside_string = false;
+    bool inside_char = false;
+    size_t i = 0;
+
+    // Check for Doxygen single-line comments (/// or //!)
+    if (trimmed.compare(0, 3, "///") == 0 || trimmed.compare(0, 3, "//!") == 0) {
+      doc_comment_lines++;
+      return LINE_DOC;
+    }
+
+    // Check for Doxygen block starters (/** or /*!)
+    if (trimmed.compare(0, 3, "/**") == 0 || trimmed.compare(0, 3, "/*!") == 0) {
+      doc_comment_lines++;
+      in_doc_block_comment = true;
+      return LINE_DOC;
+    }
+
+    // Handle in-progress Doxygen block
+    if (in_doc_block_comment) {
+      doc_comment_lines++;
+      if (trimmed.find("*/") != std::string::npos) {
+        in_doc_block_comment = false;
+      }
+      return LINE_DOC;
+    }
+
+    // Regular comment handling (/* ... */ or //)
+    if (in_block_comment) {
+      comment_lines++;
+      if (trimmed.find("*/") != std::string::npos) {
+        in_block_comment = false;
+      }
+      return LINE_COMMENT;
+    }
+
+    // Check for regular single-line comments (//)
+    if (trimmed.compare(0, 2, "//") == 0) {
+      comment_lines++;
+      return LINE_COMMENT;
+    }
+
+    // Check for regular block comments (/*)
+    if (trimmed.compare(0, 2, "/*") == 0) {
+      comment_lines++;
+      if (trimmed.find("*/", 2) == std::string::npos) {
+        in_block_comment = true;
+      }
+      return LINE_COMMENT;
+    }
+
+    // If none of the above, it's code
+    code_lines++;
+    return LINE_CODE;
+  }
+
+  int get_blank_lines() const { return blank_lines; }
+  int get_code_lines() const { return code_lines; }
+  int get_comment_lines() const { return comment_lines; }
+  int get_doc_comment_lines() const { return doc_comment_lines; }
+  /// Whether the next line starts inside a block comment.
+  bool in_comment() const { return in_block_comment or in_doc_block_comment; }
+
+  /// The state carried from one line to the next, in 2 bits; see set_state().
+  std::uint8_t state() const {
+    return static_cast<std::uint8_t>((in_block_comment ? 1 : 0) | (in_doc_block_comment ? 2 : 0));
+  }
+  /// Resumes parsing as if the previous line had left the parser in `s`, from state().
+  void set_state(std::uint8_t s) {
+    in_block_comment = (s & 1) != 0;
+    in_doc_block_comment = (s & 2) != 0;
+  }
+};
+
+#endif
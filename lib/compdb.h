@@ -0,0 +1,112 @@
+#ifndef COMPDB_H
+#define COMPDB_H
+
+/*!
+ * @file compdb.h
+ * @description
+ * Reads the translation units of a compilation database (compile_commands.json, `--compdb`), so
+ * only the files that are actually built get counted.
+ *
+ * Databases of large projects run into hundreds of megabytes, most of it command lines, and list
+ * a file once per configuration it is built in. The file is streamed through JsonSaxParser: only
+ * the "directory" and "file" of each entry are decoded, and memory grows with the number of
+ * distinct translation units, not with the size of the database.
+ */
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+
+#include "json_sax.h"
+
+/// What read_compdb() found.
+struct CompdbStats {
+  std::size_t n_entries = 0;     //!< Entries of the database.
+  std::size_t n_duplicates = 0;  //!< Entries for a file already listed.
+};
+
+/// JsonSaxParser handler collecting the "directory" and "file" of each entry.
+template <typename Fn>
+class CompdbHandler {
+public:
+  CompdbHandler(std::filesystem::path db_dir, Fn& fn, CompdbStats& stats)
+      : m_db_dir{ std::move(db_dir) }, m_fn{ fn }, m_stats{ stats } {}
+
+  void array_begin() { m_depth++; }
+  void array_end() { m_depth--; }
+  void object_begin() {
+    if (++m_depth == 2) {
+      m_directory.clear();
+      m_file.clear();
+    }
+  }
+  void object_end() {
+    if (m_depth-- == 2 and !m_file.empty())
+      end_entry();
+  }
+
+  bool key(std::string_view k) {
+    m_field = nullptr;
+    if (m_depth == 2 and k == "directory")
+      m_field = &m_directory;
+    else if (m_depth == 2 and k == "file")
+      m_field = &m_file;
+    return m_field != nullptr;
+  }
+  void string(std::string_view s) {
+    if (m_field != nullptr)
+      m_field->assign(s);
+    m_field = nullptr;
+  }
+  void scalar(std::string_view) { m_field = nullptr; }
+
+private:
+  void end_entry() {
+    m_stats.n_entries++;
+    // "file" may be relative to "directory", which should be absolute but is sometimes relative
+    // to the database itself.
+    std::filesystem::path path = m_db_dir / m_directory / m_file;
+    std::string normal = path.lexically_normal().string();
+    if (m_seen.insert(normal).second)
+      m_fn(normal);
+    else
+      m_stats.n_duplicates++;
+  }
+
+  std::filesystem::path m_db_dir;
+  Fn& m_fn;
+  CompdbStats& m_stats;
+  int m_depth = 0;                  //!< Open containers; entries are the objects at depth 2.
+  std::string* m_field = nullptr;   //!< Where the next string goes, if wanted.
+  std::string m_directory;
+  std::string m_file;
+  std::unordered_set<std::string> m_seen;  //!< Files already given to m_fn.
+};
+
+/**
+ * @brief Lists the translation units of a compilation database, each once.
+ *
+ * @param filename: The compile_commands.json file.
+ * @param fn: Called with the normalized path of each file, in order of first appearance.
+ * @param stats: Receives the # of entries and duplicates.
+ * @param error: Receives a description of the problem, if any.
+ * @return true if the database could be read.
+ */
+template <typename Fn>
+bool read_compdb(const std::string& filename, Fn&& fn, CompdbStats& stats, std::string& error) {
+  std::ifstream in{ filename, std::ios::binary };
+  if (!in.is_open()) {
+    error = "could not open " + filename;
+    return false;
+  }
+  CompdbHandler<Fn> handler{ std::filesystem::path{ filename }.parent_path(), fn, stats };
+  JsonSaxParser parser{ in };
+  if (!parser.parse(handler, error)) {
+    error = filename + ": " + error;
+    return false;
+  }
+  return true;
+}
+
+#endif
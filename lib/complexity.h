@@ -0,0 +1,451 @@
+#ifndef COMPLEXITY_H
+#define COMPLEXITY_H
+
+/*!
+ * @file complexity.h
+ * @description
+ * Cyclomatic complexity and brace nesting (`--complexity`), per function and per file.
+ *
+ * The code lines of a file are scanned as the parser classifies them, in the same pass. Each
+ * decision point (if, for, while, case, catch, &&, ||, ?: and the `and`/`or` alternative
+ * tokens) outside string literals and trailing comments adds one to the enclosing function;
+ * a function starts at 1. A file's complexity is the sum of its functions plus the decision
+ * points outside any function (e.g. in global initializers).
+ *
+ * Keywords are found by a scan for identifier boundaries: with SSE2, 16 positions are tested at
+ * once for the start of a word whose first letter can begin a keyword, or for one of the few
+ * punctuators that matter (braces, ';', quotes, '/', &, |, ?). Only those positions are looked
+ * at one by one. Without SSE2 the same positions are found through a table.
+ *
+ * Like doc_coverage.h, this is a heuristic, not a C++ front end: a brace opens a function body
+ * when, outside any function, the statement before it has a parameter list and is not a type,
+ * namespace or initializer. Nesting counts braces only, relative to the function body
+ * (`if (x) { ... }` inside a function is 1; a braceless `if` is 0). Preprocessor lines,
+ * including their continuations, are skipped.
+ */
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
+
+#include "code_parser.h"
+#include "file_info.h"
+
+/// Computes the complexity of the functions of one file, from its lines, in order.
+class ComplexityScanner {
+public:
+  ComplexityScanner() {
+    for (char c : std::string_view{ "ifwcao" }) {
+      m_candidate[static_cast<unsigned char>(c)] = WORD;
+    }
+    for (char c : std::string_view{ "&|?\"'/{};" }) {
+      m_candidate[static_cast<unsigned char>(c)] = PUNCT;
+    }
+  }
+
+  /**
+   * @brief Feeds the next line of the file.
+   *
+   * @param line: The line.
+   * @param category: What the parser counted it as; only code lines are scanned.
+   */
+  void add(std::string_view line, line_category_e category) {
+    ++m_line_no;
+    if (category != LINE_CODE) {
+      m_in_macro = false;
+      return;
+    }
+    std::size_t first = line.find_first_not_of(" \t\r\f\v");
+    if (m_in_macro or line[first] == '#') {
+      std::size_t last = line.find_last_not_of(" \t\r\f\v");
+      m_in_macro = line[last] == '\\';
+      return;
+    }
+    scan(line, first);
+  }
+
+  /// Totals of the file; functions left open at the end of the file are not counted.
+  ComplexityCounts counts() const {
+    ComplexityCounts c = m_counts;
+    for (const auto& f : m_functions) {
+      c.n_functions++;
+      c.complexity += f.complexity;
+      c.max_complexity = std::max(c.max_complexity, f.complexity);
+    }
+    return c;
+  }
+
+  /// The functions of the file, in the order they end.
+  std::vector<FunctionComplexity>& functions() { return m_functions; }
+
+private:
+  enum candidate_e : std::uint8_t { NONE = 0, WORD, PUNCT };
+
+  /// What an open brace belongs to.
+  enum scope_e : std::uint8_t {
+    TRANSPARENT,  //!< namespace or extern "C"; does not count as nesting.
+    TYPE,         //!< class, struct, union or enum.
+    FUNCTION,     //!< A function body.
+    BLOCK,        //!< A block inside a function.
+    OPAQUE,       //!< An initializer or anything else outside functions.
+    INIT,         //!< A brace initializer in a constructor's member initializer list.
+  };
+
+  struct Scope {
+    scope_e kind;
+    std::string name;  //!< For TYPE scopes, the name of the type.
+  };
+
+  /// Longest statement text kept to recognise what a brace opens.
+  static constexpr std::size_t MAX_PENDING = 1024;
+
+  static bool is_ident(char c) {
+    return (c >= 'a' and c <= 'z') or (c >= 'A' and c <= 'Z') or (c >= '0' and c <= '9')
+           or c == '_';
+  }
+
+  static bool starts_with_word(std::string_view s, std::string_view word) {
+    return s.substr(0, word.size()) == word
+           and (s.size() == word.size() or !is_ident(s[word.size()]));
+  }
+
+  static std::string_view trim(std::string_view s) {
+    std::size_t first = s.find_first_not_of(" \t\r\f\v");
+    if (first == std::string_view::npos)
+      return {};
+    return s.substr(first, s.find_last_not_of(" \t\r\f\v") - first + 1);
+  }
+
+  bool in_function() const { return m_function != NO_FUNCTION; }
+
+  /// Whether position `pos` of `line` must be looked at.
+  bool is_candidate(std::string_view line, std::size_t pos) const {
+    candidate_e c = m_candidate[static_cast<unsigned char>(line[pos])];
+    return c == PUNCT or (c == WORD and (pos == 0 or !is_ident(line[pos - 1])));
+  }
+
+  void scan(std::string_view line, std::size_t first) {
+    const char* p = line.data();
+    const std::size_t n = line.size();
+    m_seg = first;
+    m_skip_to = 0;
+    if (is_candidate(line, 0) and !handle(line, 0)) {
+      return;
+    }
+    std::size_t i = 1;
+#ifdef __SSE2__
+    // Loads p[i - 1 .. i + 15]: the byte before each position tells whether a word starts there.
+    auto ident = [](__m128i v) {
+      __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+      __m128i letter = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                                     _mm_cmplt_epi8(lower, _mm_set1_epi8('z' + 1)));
+      __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+                                    _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+      return _mm_or_si128(_mm_or_si128(letter, digit), _mm_cmpeq_epi8(v, _mm_set1_epi8('_')));
+    };
+    for (; i + 16 <= n; i += 16) {
+      __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+      __m128i prev = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i - 1));
+      // First letters of if, for, while, case, catch, and, or.
+      __m128i word = _mm_setzero_si128();
+      for (char c : { 'i', 'f', 'w', 'c', 'a', 'o' }) {
+        word = _mm_or_si128(word, _mm_cmpeq_epi8(a, _mm_set1_epi8(c)));
+      }
+      __m128i punct = _mm_setzero_si128();
+      for (char c : { '&', '|', '?', '"', '\'', '/', '{', '}', ';' }) {
+        punct = _mm_or_si128(punct, _mm_cmpeq_epi8(a, _mm_set1_epi8(c)));
+      }
+      __m128i hits = _mm_or_si128(_mm_andnot_si128(ident(prev), word), punct);
+      auto mask = static_cast<unsigned>(_mm_movemask_epi8(hits));
+      while (mask != 0) {
+        std::size_t pos = i + static_cast<std::size_t>(__builtin_ctz(mask));
+        mask &= mask - 1;
+        if (pos >= m_skip_to and !handle(line, pos))
+          return;
+      }
+    }
+#endif
+    for (; i < n; ++i) {
+      if (i >= m_skip_to and is_candidate(line, i) and !handle(line, i))
+        return;
+    }
+    flush(line, n);
+  }
+
+  /**
+   * @brief Looks at a candidate position.
+   *
+   * @return false if the rest of the line is a comment.
+   */
+  bool handle(std::string_view line, std::size_t pos) {
+    const std::size_t n = line.size();
+    char c = line[pos];
+    char next = pos + 1 < n ? line[pos + 1] : '\0';
+    switch (c) {
+    case '"':
+    case '\'': {
+      // A quote right after a digit is a digit separator (1'000'000).
+      if (c == '\'' and pos > 0 and line[pos - 1] >= '0' and line[pos - 1] <= '9')
+        break;
+      std::size_t j = pos + 1;
+      while (j < n and line[j] != c) {
+        j += line[j] == '\\' ? 2 : 1;
+      }
+      m_skip_to = j + 1;
+      break;
+    }
+    case '/':
+      if (next == '/') {
+        flush(line, pos);
+        return false;
+      }
+      if (next == '*') {
+        flush(line, pos);
+        std::size_t end = line.find("*/", pos + 2);
+        if (end == std::string_view::npos)
+          return false;
+        m_skip_to = end + 2;
+        m_seg = m_skip_to;
+      }
+      break;
+    case '&':
+    case '|':
+      if (next == c) {
+        decision();
+        m_skip_to = pos + 2;
+      }
+      break;
+    case '?':
+      decision();
+      break;
+    case ';':
+      if (!in_function() and (m_scopes.empty() or m_scopes.back().kind != INIT)) {
+        m_pending.clear();
+        m_seg = pos + 1;
+      }
+      break;
+    case '{':
+      open(line, pos);
+      break;
+    case '}':
+      close(line, pos);
+      break;
+    default:
+      for (std::string_view keyword : { "if", "for", "while", "case", "catch", "and", "or" }) {
+        if (line.compare(pos, keyword.size(), keyword) == 0
+            and (pos + keyword.size() == n or !is_ident(line[pos + keyword.size()]))) {
+          decision();
+          break;
+        }
+      }
+      // Whatever the word, the rest of it cannot start another one.
+      std::size_t j = pos + 1;
+      while (j < n and is_ident(line[j])) {
+        ++j;
+      }
+      m_skip_to = j;
+    }
+    return true;
+  }
+
+  void decision() {
+    if (in_function())
+      m_current.complexity++;
+    else
+      m_counts.complexity++;
+  }
+
+  /// Appends line[m_seg, end) to the statement being read, outside functions.
+  void flush(std::string_view line, std::size_t end) {
+    std::string_view seg = m_seg < end ? trim(line.substr(m_seg, end - m_seg)) : "";
+    if (!in_function() and !seg.empty() and m_pending.size() < MAX_PENDING) {
+      if (m_pending.empty())
+        m_pending_line = m_line_no;
+      else
+        m_pending += ' ';
+      m_pending.append(seg.substr(0, MAX_PENDING));
+      // An access specifier alone does not start the next declaration.
+      for (std::string_view label : { "public:", "protected:", "private:" }) {
+        if (m_pending == label)
+          m_pending.clear();
+      }
+    }
+    m_seg = end;
+  }
+
+  void open(std::string_view line, std::size_t pos) {
+    flush(line, pos);
+    scope_e kind = BLOCK;
+    std::string name;
+    if (!in_function()) {
+      kind = m_scopes.empty() or m_scopes.back().kind == TRANSPARENT
+                 or m_scopes.back().kind == TYPE
+               ? classify(name)
+               : OPAQUE;
+    }
+    m_scopes.push_back(Scope{ kind, std::move(name) });
+    if (kind != TRANSPARENT) {
+      m_depth++;
+      m_counts.max_nesting = std::max(m_counts.max_nesting, m_depth);
+    }
+    if (kind == FUNCTION) {
+      m_function = m_depth;
+      m_current = FunctionComplexity{};
+      m_current.name = function_name();
+      m_current.line = m_pending_line;
+      m_current.complexity = 1;
+    } else if (in_function()) {
+      m_current.max_nesting = std::max<count_t>(m_current.max_nesting, m_depth - m_function);
+    }
+    if (kind == INIT) {
+      m_pending += '{';
+    } else {
+      m_pending.clear();
+    }
+    m_seg = pos + 1;
+  }
+
+  void close(std::string_view line, std::size_t pos) {
+    if (m_scopes.empty())
+      return;
+    flush(line, pos);
+    scope_e kind = m_scopes.back().kind;
+    m_scopes.pop_back();
+    if (kind != TRANSPARENT)
+      m_depth--;
+    if (kind == FUNCTION) {
+      m_function = NO_FUNCTION;
+      m_functions.push_back(std::move(m_current));
+    }
+    if (kind == INIT) {
+      m_pending += '}';
+    } else if (!in_function()) {
+      m_pending.clear();
+    }
+    m_seg = pos + 1;
+  }
+
+  /// What the brace ending the pending statement opens; `name` receives the name of a type.
+  scope_e classify(std::string& name) const {
+    std::string_view s = trim(m_pending);
+    // Access specifiers and template headers do not tell what follows them.
+    for (bool again = true; again;) {
+      again = false;
+      for (std::string_view label : { "public", "protected", "private" }) {
+        if (starts_with_word(s, label) and trim(s.substr(label.size())).substr(0, 1) == ":") {
+          s = trim(trim(s.substr(label.size())).substr(1));
+          again = true;
+        }
+      }
+      if (starts_with_word(s, "template")) {
+        std::size_t open = s.find('<');
+        int angle = 0;
+        std::size_t i = open;
+        for (; open != std::string_view::npos and i < s.size(); ++i) {
+          angle += s[i] == '<' ? 1 : s[i] == '>' ? -1 : 0;
+          if (angle == 0)
+            break;
+        }
+        if (open == std::string_view::npos or i >= s.size())
+          return OPAQUE;
+        s = trim(s.substr(i + 1));
+        again = true;
+      }
+    }
+    if (starts_with_word(s, "inline"))
+      s = trim(s.substr(6));
+    if (starts_with_word(s, "namespace") or starts_with_word(s, "extern"))
+      return TRANSPARENT;
+
+    std::size_t paren = s.find('(');
+    for (std::string_view key : { "class", "struct", "union", "enum" }) {
+      if (starts_with_word(s, key) and paren == std::string_view::npos) {
+        // The name is the last word before the base clause, other than the keywords.
+        std::string_view rest = s.substr(0, s.find(':'));
+        for (std::size_t i = 0; i < rest.size();) {
+          std::size_t j = i;
+          while (j < rest.size() and is_ident(rest[j])) {
+            ++j;
+          }
+          std::string_view word = rest.substr(i, j - i);
+          if (!word.empty() and word != key and word != "class" and word != "final")
+            name.assign(word);
+          i = j == i ? i + 1 : j;
+        }
+        return TYPE;
+      }
+    }
+    std::size_t close = s.rfind(')');
+    if (paren == std::string_view::npos or close == std::string_view::npos)
+      return OPAQUE;
+    // An '=' before the parameter list is an initializer (`auto f = [](int x) {`), unless it
+    // is the name of the function (`operator=`).
+    std::size_t assign = s.find('=');
+    if (assign < paren and s.find("operator") > assign)
+      return OPAQUE;
+    // `A() : x(1), y{ 2 } {`: the first brace after the ':' initializes a member.
+    std::size_t colon = s.find(':', s.find(')'));
+    while (colon != std::string_view::npos and colon + 1 < s.size() and s[colon + 1] == ':') {
+      colon = s.find(':', colon + 2);
+    }
+    if (colon != std::string_view::npos and s[colon - 1] != ':') {
+      char last = s.back();
+      if (is_ident(last) or last == '>')
+        return INIT;
+    }
+    return FUNCTION;
+  }
+
+  /// The name of the function whose body is opening, prefixed by the enclosing types.
+  std::string function_name() const {
+    std::string_view s = m_pending;
+    std::size_t paren = s.find('(');
+    std::size_t op = s.rfind("operator", paren);
+    std::string_view name;
+    if (paren == 0) {
+      // No name before the parameter list.
+    } else if (op != std::string_view::npos and (op == 0 or !is_ident(s[op - 1]))) {
+      // operator() takes two pairs of parentheses.
+      std::size_t end = s.compare(paren, 2, "()") == 0 ? paren + 2 : paren;
+      name = trim(s.substr(op, end - op));
+    } else {
+      std::size_t end = s.find_last_not_of(" \t", paren - 1);
+      std::size_t begin = end + 1;
+      while (begin > 0 and (is_ident(s[begin - 1]) or s[begin - 1] == ':' or s[begin - 1] == '~')) {
+        --begin;
+      }
+      name = s.substr(begin, end + 1 - begin);
+    }
+    std::string qualified;
+    for (const auto& scope : m_scopes) {
+      if (scope.kind == TYPE and !scope.name.empty())
+        qualified += scope.name + "::";
+    }
+    qualified.append(name.empty() ? std::string_view{ "(anonymous)" } : name);
+    return qualified;
+  }
+
+  static constexpr count_t NO_FUNCTION = ~count_t{ 0 };
+
+  std::array<candidate_e, 256> m_candidate{};
+  std::vector<Scope> m_scopes;
+  count_t m_depth = 0;                 //!< # of open braces, namespace-like ones excluded.
+  count_t m_function = NO_FUNCTION;    //!< m_depth of the open function body, if any.
+  FunctionComplexity m_current;        //!< The open function.
+  std::vector<FunctionComplexity> m_functions;
+  ComplexityCounts m_counts;           //!< Decision points outside functions, max nesting.
+  std::string m_pending;               //!< The statement being read, outside functions.
+  count_t m_pending_line = 0;          //!< Line where m_pending starts.
+  count_t m_line_no = 0;
+  bool m_in_macro = false;             //!< The previous line was a continued preprocessor line.
+  std::size_t m_seg = 0;               //!< Start of the part of the line not yet in m_pending.
+  std::size_t m_skip_to = 0;           //!< Positions before this one were already handled.
+};
+
+#endif
@@ -0,0 +1,192 @@
+#ifndef DOC_COVERAGE_H
+#define DOC_COVERAGE_H
+
+/*!
+ * @file doc_coverage.h
+ * @description
+ * Documentation coverage of headers (`--doc-coverage`).
+ *
+ * A line-based scan, fed with the lines of a file as the parser classifies them, finds the
+ * top-level declarations (classes, structs, unions, enums and functions outside any class or
+ * function body; namespaces and extern "C" blocks do not count as nesting) and checks whether
+ * the line right before each one is a doc line.
+ *
+ * This is a heuristic, not a C++ front end. A declaration is only recognised on the line it
+ * starts: a class/struct/union/enum keyword that is not a forward declaration, or a '(' preceded
+ * by at least a type and a name (a lone `MACRO(...)` is not a function). Lines continuing an
+ * unfinished statement, typedefs, using-declarations and preprocessor lines are skipped.
+ */
+#include <string_view>
+#include <vector>
+
+#include "code_parser.h"
+#include "file_info.h"
+
+/// Finds the top-level declarations of a file and whether each one is documented.
+class DocCoverageScanner {
+public:
+  /**
+   * @brief Feeds the next line of the file.
+   *
+   * @param line: The line.
+   * @param category: What the parser counted it as.
+   */
+  void add(std::string_view line, line_category_e category) {
+    if (category == LINE_DOC) {
+      m_after_doc = true;
+      return;
+    }
+    if (category != LINE_CODE) {
+      m_after_doc = false;
+      return;
+    }
+    std::string_view code = strip(line);
+    if (code.empty() or code.front() == '#') {
+      m_after_doc = false;
+      return;
+    }
+
+    if (m_depth == 0 and !m_open_statement) {
+      // A template header belongs to the declaration that follows it.
+      std::string_view decl = skip_template(code);
+      if (decl.empty()) {
+        return;
+      }
+      if (is_declaration(decl)) {
+        (m_after_doc ? m_documented : m_undocumented)++;
+      }
+    }
+    m_after_doc = false;
+    track_braces(code);
+    // A lone word, like __BEGIN_DECLS, is a macro and does not start a statement.
+    char last = code.back();
+    bool lone_word = code.find_first_of(" \t(){};=") == std::string_view::npos;
+    m_open_statement = m_depth == 0 and !lone_word and last != ';' and last != '{' and last != '}';
+  }
+
+  count_t documented() const { return m_documented; }
+  count_t undocumented() const { return m_undocumented; }
+
+private:
+  static bool is_ident(char c) {
+    return (c >= 'a' and c <= 'z') or (c >= 'A' and c <= 'Z') or (c >= '0' and c <= '9')
+           or c == '_' or c == ':' or c == '~';
+  }
+
+  static bool starts_with_word(std::string_view s, std::string_view word) {
+    return s.substr(0, word.size()) == word
+           and (s.size() == word.size() or !is_ident(s[word.size()]));
+  }
+
+  /// The line without surrounding blanks and without a trailing // or /* comment.
+  static std::string_view strip(std::string_view s) {
+    bool in_string = false;
+    char quote = 0;
+    for (std::size_t i = 0; i < s.size(); ++i) {
+      char c = s[i];
+      if (in_string) {
+        if (c == '\\')
+          ++i;
+        else if (c == quote)
+          in_string = false;
+      } else if (c == '"' or c == '\'') {
+        in_string = true;
+        quote = c;
+      } else if (c == '/' and i + 1 < s.size() and (s[i + 1] == '/' or s[i + 1] == '*')) {
+        s = s.substr(0, i);
+        break;
+      }
+    }
+    std::size_t first = s.find_first_not_of(" \t\r\f\v");
+    if (first == std::string_view::npos)
+      return {};
+    std::size_t last = s.find_last_not_of(" \t\r\f\v");
+    return s.substr(first, last - first + 1);
+  }
+
+  /// Removes a leading `template <...>`; empty if the line is only that.
+  static std::string_view skip_template(std::string_view s) {
+    if (!starts_with_word(s, "template"))
+      return s;
+    std::size_t open = s.find('<');
+    if (open == std::string_view::npos)
+      return {};
+    int angle = 0;
+    for (std::size_t i = open; i < s.size(); ++i) {
+      angle += s[i] == '<' ? 1 : s[i] == '>' ? -1 : 0;
+      if (angle == 0) {
+        std::string_view rest = s.substr(i + 1);
+        std::size_t first = rest.find_first_not_of(" \t");
+        return first == std::string_view::npos ? std::string_view{} : rest.substr(first);
+      }
+    }
+    return {};
+  }
+
+  static bool is_declaration(std::string_view s) {
+    for (std::string_view skip : { "typedef", "using", "namespace", "static_assert", "return" }) {
+      if (starts_with_word(s, skip))
+        return false;
+    }
+    if (starts_with_word(s, "extern") and s.find('"') != std::string_view::npos)
+      return false;
+    for (std::string_view key : { "class", "struct", "union", "enum" }) {
+      if (starts_with_word(s, key)) {
+        // `class X;` is a forward declaration.
+        return s.back() != ';' or s.find('{') != std::string_view::npos;
+      }
+    }
+    // A function: at least two words (a type and a name) before the first '('.
+    std::size_t paren = s.find('(');
+    if (paren == std::string_view::npos or s.find('=') < paren)
+      return false;
+    int words = 0;
+    bool in_word = false;
+    for (std::size_t i = 0; i < paren; ++i) {
+      bool ident = is_ident(s[i]) or s[i] == '*' or s[i] == '&' or s[i] == '<' or s[i] == '>';
+      if (ident and !in_word)
+        ++words;
+      in_word = ident;
+    }
+    return words >= 2 and is_ident(s[s.find_last_not_of(" \t", paren - 1)]);
+  }
+
+  /// Updates the nesting with the braces of a line, outside string and character literals.
+  /// A namespace or extern "C" whose brace is on a later line (Allman style) is carried over.
+  void track_braces(std::string_view s) {
+    bool transparent = m_pending_transparent or starts_with_word(s, "namespace")
+                       or starts_with_word(s, "extern");
+    bool in_string = false;
+    char quote = 0;
+    for (std::size_t i = 0; i < s.size(); ++i) {
+      char c = s[i];
+      if (in_string) {
+        if (c == '\\')
+          ++i;
+        else if (c == quote)
+          in_string = false;
+      } else if (c == '"' or c == '\'') {
+        in_string = true;
+        quote = c;
+      } else if (c == '{') {
+        m_braces.push_back(transparent);
+        m_depth += transparent ? 0 : 1;
+        transparent = false;
+      } else if (c == '}' and !m_braces.empty()) {
+        m_depth -= m_braces.back() ? 0 : 1;
+        m_braces.pop_back();
+      }
+    }
+    m_pending_transparent = transparent and s.back() != ';' and s.back() != '}';
+  }
+
+  std::vector<bool> m_braces;     //!< Open braces; true for namespace-like ones.
+  int m_depth = 0;                //!< # of open braces that are not namespace-like.
+  bool m_pending_transparent = false;  //!< A namespace or extern "C" still waits for its '{'.
+  bool m_open_statement = false;  //!< The last top-level code line did not end a statement.
+  bool m_after_doc = false;       //!< The previous line is a doc line.
+  count_t m_documented = 0;
+  count_t m_undocumented = 0;
+};
+
+#endif
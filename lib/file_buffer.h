@@ -0,0 +1,253 @@
+#ifndef FILE_BUFFER_H
+#define FILE_BUFFER_H
+
+/*!
+ * @file file_buffer.h
+ * @description
+ * Read path that loads a whole source file into memory, so the parser can walk it line by
+ * line without going through an ifstream.
+ *
+ * Small files are read into a buffer that is reused from one file to the next. Large files are
+ * either mapped read-only or, when huge pages are requested, copied into an anonymous region
+ * backed by 2 MB pages (explicit MAP_HUGETLB pages when the system has a pool reserved,
+ * transparent huge pages through MADV_HUGEPAGE otherwise). The large region is kept and reused
+ * while it is big enough for the next file.
+ */
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include "mem_stats.h"
+
+/// Size of a huge page on x86-64 and aarch64 default configurations.
+constexpr std::size_t HUGE_PAGE_SIZE = std::size_t{ 2 } << 20;
+/// Files at least this large skip the reusable read buffer.
+constexpr std::size_t LARGE_FILE_THRESHOLD = std::size_t{ 1 } << 20;
+
+/// Holds the contents of the file currently being parsed.
+class FileBuffer {
+public:
+  /// Ctro. If `huge_pages` is true, large files are copied into huge-page backed memory.
+  explicit FileBuffer(bool huge_pages = false) : m_huge_pages{ huge_pages } {}
+  FileBuffer(const FileBuffer&) = delete;
+  FileBuffer& operator=(const FileBuffer&) = delete;
+  ~FileBuffer() {
+    unmap_file();
+    unmap_region();
+  }
+
+  /**
+   * @brief Loads a file, replacing the previous contents.
+   *
+   * @param filename: The file to read.
+   * @return true if the file could be opened and read, false otherwise.
+   */
+  bool load(const std::string& filename) {
+    unmap_file();
+    m_data = nullptr;
+    m_size = 0;
+
+    int fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      return false;
+    }
+    struct stat st {};
+    bool ok = ::fstat(fd, &st) == 0;
+    if (ok) {
+      auto size = static_cast<std::size_t>(st.st_size);
+      if (!S_ISREG(st.st_mode) or size < LARGE_FILE_THRESHOLD) {
+        ok = read_small(fd, size);
+      } else if (m_huge_pages) {
+        ok = read_huge(fd, size);
+      } else {
+        ok = map_file(fd, size);
+      }
+    }
+    ::close(fd);
+    return ok;
+  }
+
+  /// The contents of the last file loaded.
+  std::string_view view() const { return { m_data, m_size }; }
+
+  /// True if the last file loaded lives in huge-page backed memory.
+  bool on_huge_pages() const { return m_data != nullptr and m_data == m_region; }
+
+private:
+  bool m_huge_pages;
+  const char* m_data = nullptr;  //!< Start of the current contents.
+  std::size_t m_size = 0;        //!< # of bytes in the current contents.
+
+  std::vector<char> m_small;  //!< Reused for every file below the large file threshold.
+
+  char* m_file_map = nullptr;  //!< Read-only mapping of the current file, if any.
+  std::size_t m_file_map_len = 0;
+  std::size_t m_file_map_charged = 0;  //!< Bytes of the mapping charged to the parse buffers.
+
+  char* m_region = nullptr;  //!< Huge-page backed region, kept across files.
+  std::size_t m_region_len = 0;
+  std::size_t m_region_charged = 0;  //!< Bytes of the region charged to the parse buffers.
+
+  /// Mappings do not go through operator new, so they are charged here.
+  static std::size_t charge_mapping(std::size_t len) {
+    if (!mem_stats_enabled().load(std::memory_order_relaxed))
+      return 0;
+    mem_charge(mem_tag_e::PARSE, len);
+    return len;
+  }
+
+  /// Reads until EOF, so files that report a wrong size (e.g. /proc) are still read in full.
+  static bool read_all(int fd, char* dst, std::size_t capacity, std::size_t& got) {
+    got = 0;
+    while (got < capacity) {
+      ssize_t n = ::read(fd, dst + got, capacity - got);
+      if (n < 0) {
+        if (errno == EINTR)
+          continue;
+        return false;
+      }
+      if (n == 0)
+        break;
+      got += static_cast<std::size_t>(n);
+    }
+    return true;
+  }
+
+  bool read_small(int fd, std::size_t size_hint) {
+    std::size_t got = 0;
+    // Ask for one extra byte, so a full buffer means the file grew or its size was unknown.
+    m_small.resize(size_hint + 1);
+    while (true) {
+      std::size_t n = 0;
+      if (!read_all(fd, m_small.data() + got, m_small.size() - got, n))
+        return false;
+      got += n;
+      if (got < m_small.size())
+        break;
+      m_small.resize(m_small.size() * 2);
+    }
+    m_data = m_small.data();
+    m_size = got;
+    return true;
+  }
+
+  bool map_file(int fd, std::size_t size) {
+    void* p = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED) {
+      return read_small(fd, size);
+    }
+    ::madvise(p, size, MADV_SEQUENTIAL);
+    m_file_map = static_cast<char*>(p);
+    m_file_map_len = size;
+    m_file_map_charged = charge_mapping(size);
+    m_data = m_file_map;
+    m_size = size;
+    return true;
+  }
+
+  bool read_huge(int fd, std::size_t size) {
+    std::size_t len = (size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+    if (len > m_region_len) {
+      unmap_region();
+      if (!allocate_region(len)) {
+        return map_file(fd, size);
+      }
+    }
+    std::size_t got = 0;
+    if (!read_all(fd, m_region, size, got))
+      return false;
+    m_data = m_region;
+    m_size = got;
+    return true;
+  }
+
+  /// Tries explicit huge pages first, then a 2 MB aligned region marked for THP.
+  bool allocate_region(std::size_t len) {
+#ifdef MAP_HUGETLB
+    void* p = ::mmap(nullptr, len, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (p != MAP_FAILED) {
+      m_region = static_cast<char*>(p);
+      m_region_len = len;
+      m_region_charged = charge_mapping(len);
+      return true;
+    }
+#endif
+    // Over-allocate by one huge page and trim both ends, so the region starts on a 2 MB boundary
+    // and khugepaged can back all of it.
+    std::size_t padded = len + HUGE_PAGE_SIZE;
+    void* raw = ::mmap(nullptr, padded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED)
+      return false;
+    auto base = reinterpret_cast<std::uintptr_t>(raw);
+    auto aligned = (base + HUGE_PAGE_SIZE - 1) & ~(std::uintptr_t{ HUGE_PAGE_SIZE } - 1);
+    std::size_t head = aligned - base;
+    std::size_t tail = padded - head - len;
+    if (head > 0)
+      ::munmap(raw, head);
+    if (tail > 0)
+      ::munmap(reinterpret_cast<char*>(aligned + len), tail);
+#ifdef MADV_HUGEPAGE
+    ::madvise(reinterpret_cast<void*>(aligned), len, MADV_HUGEPAGE);
+#endif
+    m_region = reinterpret_cast<char*>(aligned);
+    m_region_len = len;
+    m_region_charged = charge_mapping(len);
+    return true;
+  }
+
+  void unmap_file() {
+    if (m_file_map != nullptr) {
+      ::munmap(m_file_map, m_file_map_len);
+      if (m_file_map_charged > 0)
+        mem_release(mem_tag_e::PARSE, m_file_map_charged);
+      m_file_map = nullptr;
+      m_file_map_len = 0;
+      m_file_map_charged = 0;
+    }
+  }
+
+  void unmap_region() {
+    if (m_region != nullptr) {
+      ::munmap(m_region, m_region_len);
+      if (m_region_charged > 0)
+        mem_release(mem_tag_e::PARSE, m_region_charged);
+      m_region = nullptr;
+      m_region_len = 0;
+      m_region_charged = 0;
+    }
+  }
+};
+
+/**
+ * @brief Calls `fn` for every line in `text`, splitting exactly like std::getline does.
+ *
+ * The line terminator is not included, a trailing '\r' is kept (trim() takes care of it), and
+ * text after the last '\n' only counts as a line if it is not empty.
+ *
+ * @param text: The buffer to split.
+ * @param fn: Callable receiving each line as a std::string_view.
+ */
+template <typename Fn>
+void for_each_line(std::string_view text, Fn&& fn) {
+  const char* p = text.data();
+  const char* end = p + text.size();
+  while (p < end) {
+    auto nl = static_cast<const char*>(std::memchr(p, '\n', static_cast<std::size_t>(end - p)));
+    const char* line_end = nl == nullptr ? end : nl;
+    fn(std::string_view{ p, static_cast<std::size_t>(line_end - p) });
+    if (nl == nullptr)
+      break;
+    p = nl + 1;
+  }
+}
+
+#endif
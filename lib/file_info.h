@@ -0,0 +1,138 @@
+#ifndef FILE_INFO_H
+#define FILE_INFO_H
+
+/*!
+ * @file file_info.h
+ * @description
+ * Per-file results collected by sloc, shared by the executable and its benchmark programs.
+ */
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "mem_stats.h"
+
+//== Enumerations
+
+/// This enumeration lists all the supported languages.
+enum lang_type_e : std::uint8_t {
+  C = 0,  //!< C language
+  CPP,    //!< C++ language
+  H,      //!< C/C++ header
+  HPP,    //!< C++ header
+  UNDEF,  //!< Undefined type.
+};
+
+//== Class/Struct declaration
+
+/// Integer type for counting lines.
+using count_t = unsigned long;
+
+/// Counters of a file under one classification profile (see profiles.h).
+struct ProfileCounts {
+  count_t n_blank = 0;
+  count_t n_comments = 0;
+  count_t n_doc = 0;
+  count_t n_loc = 0;
+};
+
+/// Halstead counts of a file or a module (see halstead.h).
+struct HalsteadCounts {
+  count_t n_operators = 0;           //!< n1: # of distinct operators.
+  count_t n_operands = 0;            //!< n2: # of distinct operands.
+  count_t total_operators = 0;       //!< N1: # of operators.
+  count_t total_operands = 0;        //!< N2: # of operands.
+};
+
+/// Cyclomatic complexity of a function (see complexity.h).
+struct FunctionComplexity {
+  std::string name;
+  count_t line = 0;         //!< Line where the function's declarator starts.
+  count_t complexity = 0;   //!< 1 + # of decision points.
+  count_t max_nesting = 0;  //!< Deepest brace nesting in the body, relative to it.
+};
+
+/// Complexity totals of a file (see complexity.h).
+struct ComplexityCounts {
+  count_t n_functions = 0;
+  count_t complexity = 0;      //!< Sum over the functions, plus decisions outside them.
+  count_t max_complexity = 0;  //!< Of the most complex function.
+  count_t max_nesting = 0;     //!< Deepest brace nesting, namespaces excluded.
+};
+
+/// Stores the file information we are collecting.
+class FileInfo {
+public:
+  std::string filename;  //!< the filename.
+  lang_type_e type;      //!< the language type.
+  count_t n_blank;       //!< # of blank lines in the file.
+  count_t n_comments;    //!< # of comment lines.
+  count_t n_doc;         //!< # of documentation lines
+  count_t n_loc;         //!< # lines of code.
+  count_t n_lines;       //!< # of lines.
+  count_t n_license{ 0 };  //!< # of license header lines, taken out of n_comments/n_doc.
+  count_t n_license_doc{ 0 };  //!< Of n_license, the lines taken out of n_doc.
+  std::vector<count_t> n_markers;  //!< # of each --markers marker found in comment lines.
+  std::vector<ProfileCounts> profiles;  //!< Counters of each --profile, in order.
+  count_t n_documented{ 0 };    //!< # of top-level declarations with a doc block (headers).
+  count_t n_undocumented{ 0 };  //!< # of top-level declarations without one (headers).
+  HalsteadCounts halstead;      //!< Halstead counts of the code lines (--halstead).
+  ComplexityCounts complexity;  //!< Complexity totals (--complexity).
+  std::vector<FunctionComplexity> functions;  //!< Functions of the file (--complexity).
+  std::string line_index;  //!< Encoded parser checkpoints (--line-index), see line_index.h.
+  std::uint64_t indexed_size{ 0 };  //!< Size of the file line_index describes.
+  std::uint64_t indexed_hash{ 0 };  //!< content_hash() of the file line_index describes.
+  std::string line_map;    //!< 2 bits per line (--emit-line-map), see line_map.h.
+  bool cached{ false };    //!< The counts come from the --cache file; the file is not read.
+  bool counted{ false };   //!< The counters are final; false if the run stopped before it.
+
+  /// Ctro.
+  FileInfo(std::string fn = "",
+           lang_type_e t = UNDEF,
+           count_t nb = 0,
+           count_t nc = 0,
+           count_t nl = 0,
+           count_t nd = 0,
+           count_t ni = 0)
+      : filename{ std::move(fn) }, type{ t }, n_blank{ nb }, n_comments{ nc }, n_loc{ nl },
+        n_doc{ nd }, n_lines{ ni } {}
+};
+
+/// Comment lines of a file, license header included. Outputs without a license column (all but
+/// the table) show these, so their counters still add up to the # of lines.
+inline count_t all_comment_lines(const FileInfo& f) {
+  return f.n_comments + f.n_license - f.n_license_doc;
+}
+
+/// Doc comment lines of a file, license header included, see all_comment_lines().
+inline count_t all_doc_lines(const FileInfo& f) { return f.n_doc + f.n_license_doc; }
+
+/// The vector storage is charged to the file list; filenames are charged where they are built.
+using FileList = std::vector<FileInfo, TaggedAllocator<FileInfo, mem_tag_e::FILE_LIST>>;
+
+/**
+ * @brief Converts a language type enum to its corresponding string representation, to be printed
+ * later.
+ *
+ * @param type: The language type enum value
+ * @return a string representing the name of the language.
+ */
+inline std::string lang_type_to_string(lang_type_e type) {
+  switch (type) {
+  case C:
+    return "C";
+  case CPP:
+    return "C++";
+  case H:
+    return "C Header";
+  case HPP:
+    return "C++ Header";
+  case UNDEF:
+    return "Unknown";
+  default:
+    return "Invalid";
+  }
+}
+
+#endif
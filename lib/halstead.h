@@ -0,0 +1,366 @@
+#ifndef HALSTEAD_H
+#define HALSTEAD_H
+
+/*!
+ * @file halstead.h
+ * @description
+ * Halstead metrics (`--halstead`): distinct and total operators and operands of the code lines,
+ * per file and per module (directory).
+ *
+ * Only the lines the parser counted as code are tokenized; trailing comments and preprocessor
+ * lines are skipped. Operators are the C/C++ punctuators (closing brackets excluded, since they
+ * pair with the opening ones) and keywords; operands are identifiers, numbers and literals.
+ *
+ * Operands are interned in an InternTable shared by all worker threads: each one gets a small
+ * integer id, so files and modules only keep sets of ids, and memory grows with the number of
+ * distinct operands, not with the number of tokens. Within a file, repeated operands are found
+ * in a local map of views into the file buffer, so the shared table is only touched once per
+ * distinct operand per file.
+ */
+#include <algorithm>
+#include <array>
+#include <bitset>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "file_info.h"
+#include "mem_stats.h"
+
+/// Operators: punctuators first (longest first, for maximal munch), then keywords.
+constexpr const char* HALSTEAD_OPERATORS[] = {
+  "<<=", ">>=", "->*", "...", "<=>",
+  "::", "->", "++", "--", "<<", ">>", "<=", ">=", "==", "!=", "&&", "||", "+=", "-=", "*=",
+  "/=", "%=", "&=", "|=", "^=", ".*",
+  "+", "-", "*", "/", "%", "=", "<", ">", "!", "~", "&", "|", "^", "?", ":", ";", ",", ".",
+  "(", "[", "{",
+  "alignas", "alignof", "and", "and_eq", "asm", "auto", "bitand", "bitor", "bool", "break",
+  "case", "catch", "char", "char8_t", "char16_t", "char32_t", "class", "compl", "concept",
+  "const", "consteval", "constexpr", "constinit", "const_cast", "continue", "co_await",
+  "co_return", "co_yield", "decltype", "default", "delete", "do", "double", "dynamic_cast",
+  "else", "enum", "explicit", "export", "extern", "float", "for", "friend", "goto", "if",
+  "inline", "int", "long", "mutable", "namespace", "new", "noexcept", "not", "not_eq",
+  "operator", "or", "or_eq", "private", "protected", "public", "register", "reinterpret_cast",
+  "requires", "restrict", "return", "short", "signed", "sizeof", "static", "static_assert",
+  "static_cast", "struct", "switch", "template", "thread_local", "throw", "try", "typedef",
+  "typeid", "typename", "union", "unsigned", "using", "virtual", "void", "volatile", "wchar_t",
+  "while", "xor", "xor_eq", "_Alignas", "_Alignof", "_Atomic", "_Bool", "_Complex", "_Generic",
+  "_Noreturn", "_Static_assert", "_Thread_local",
+};
+constexpr std::size_t HALSTEAD_N_OPERATORS = sizeof(HALSTEAD_OPERATORS) / sizeof(char*);
+/// Index of the first keyword in HALSTEAD_OPERATORS.
+constexpr std::size_t HALSTEAD_FIRST_KEYWORD = 47;
+static_assert(HALSTEAD_OPERATORS[HALSTEAD_FIRST_KEYWORD - 1][0] == '{'
+                and HALSTEAD_OPERATORS[HALSTEAD_FIRST_KEYWORD][0] == 'a',
+              "HALSTEAD_FIRST_KEYWORD does not match HALSTEAD_OPERATORS");
+
+using OperatorSet = std::bitset<HALSTEAD_N_OPERATORS>;
+
+/// Thread-safe table giving each distinct string a stable 32-bit id.
+class InternTable {
+public:
+  InternTable() = default;
+  InternTable(const InternTable&) = delete;
+  InternTable& operator=(const InternTable&) = delete;
+
+  /// Id of `s`, added to the table if needed.
+  std::uint32_t intern(std::string_view s) {
+    std::uint64_t h = std::hash<std::string_view>{}(s);
+    // The low bits pick the slot inside a shard; the high ones pick the shard.
+    std::size_t index = static_cast<std::size_t>(h >> (64 - SHARD_BITS));
+    Shard& shard = m_shards[index];
+    std::lock_guard<std::mutex> lock{ shard.mutex };
+    if ((shard.count + 1) * 2 > shard.slots.size())
+      shard.grow();
+    std::size_t mask = shard.slots.size() - 1;
+    for (std::size_t i = h & mask;; i = (i + 1) & mask) {
+      Slot& slot = shard.slots[i];
+      if (slot.data == nullptr) {
+        slot = Slot{ h, shard.store(s), static_cast<std::uint32_t>(s.size()),
+                     static_cast<std::uint32_t>(shard.count++ << SHARD_BITS | index) };
+        return slot.id;
+      }
+      if (slot.hash == h and std::string_view{ slot.data, slot.size } == s)
+        return slot.id;
+    }
+  }
+
+  /// # of distinct strings.
+  std::size_t size() const {
+    std::size_t n = 0;
+    for (auto& shard : m_shards) {
+      std::lock_guard<std::mutex> lock{ shard.mutex };
+      n += shard.count;
+    }
+    return n;
+  }
+
+private:
+  static constexpr unsigned SHARD_BITS = 6;
+  static constexpr std::size_t BLOCK_SIZE = 64 * 1024;
+
+  struct Slot {
+    std::uint64_t hash = 0;
+    const char* data = nullptr;  //!< nullptr for an empty slot.
+    std::uint32_t size = 0;
+    std::uint32_t id = 0;
+  };
+
+  /// An open-addressing table and the blocks holding its strings, charged to
+  /// mem_tag_e::INTERN. Aligned so that threads working on different shards do not share a
+  /// cache line.
+  struct alignas(64) Shard {
+    mutable std::mutex mutex;
+    std::vector<Slot> slots;
+    std::vector<std::unique_ptr<char[]>> blocks;
+    char* free = nullptr;
+    std::size_t left = 0;
+    std::size_t count = 0;
+
+    void grow() {
+      MemScope scope{ mem_tag_e::INTERN };
+      std::vector<Slot> old(std::max<std::size_t>(slots.size() * 2, 64));
+      old.swap(slots);
+      std::size_t mask = slots.size() - 1;
+      for (const Slot& s : old) {
+        if (s.data == nullptr)
+          continue;
+        std::size_t i = s.hash & mask;
+        while (slots[i].data != nullptr) {
+          i = (i + 1) & mask;
+        }
+        slots[i] = s;
+      }
+    }
+
+    const char* store(std::string_view s) {
+      if (s.size() > left) {
+        MemScope scope{ mem_tag_e::INTERN };
+        std::size_t size = std::max(BLOCK_SIZE, s.size());
+        blocks.emplace_back(new char[size]);
+        free = blocks.back().get();
+        left = size;
+      }
+      char* p = free;
+      std::memcpy(p, s.data(), s.size());
+      free += s.size();
+      left -= s.size();
+      return p;
+    }
+  };
+
+  std::array<Shard, std::size_t{ 1 } << SHARD_BITS> m_shards;
+};
+
+/// Tokenizes the code lines of one file and counts its operators and operands.
+class HalsteadScanner {
+public:
+  explicit HalsteadScanner(InternTable& table) : m_table{ table } {}
+
+  /**
+   * @brief Tokenizes a line of code.
+   *
+   * @param line: The line; it must stay valid until the scanner is done with the file.
+   */
+  void add(std::string_view line) {
+    std::size_t i = line.find_first_not_of(" \t\r\f\v");
+    if (i == std::string_view::npos or line[i] == '#')
+      return;
+    const std::size_t n = line.size();
+    while (i < n) {
+      char c = line[i];
+      if (c == ' ' or c == '\t' or c == '\r' or c == '\f' or c == '\v') {
+        ++i;
+      } else if (c == '/' and i + 1 < n and line[i + 1] == '/') {
+        return;
+      } else if (c == '/' and i + 1 < n and line[i + 1] == '*') {
+        std::size_t end = line.find("*/", i + 2);
+        if (end == std::string_view::npos)
+          return;
+        i = end + 2;
+      } else if (is_ident_start(c)) {
+        std::size_t j = i;
+        while (j < n and is_ident(line[j])) {
+          ++j;
+        }
+        std::string_view word = line.substr(i, j - i);
+        int op = keyword(word);
+        if (op >= 0)
+          add_operator(static_cast<std::size_t>(op));
+        else
+          add_operand(word);
+        i = j;
+      } else if ((c >= '0' and c <= '9') or (c == '.' and i + 1 < n and isdigit(line[i + 1]))) {
+        std::size_t j = i + 1;
+        while (j < n
+               and (is_ident(line[j]) or line[j] == '.' or line[j] == '\''
+                    or ((line[j] == '+' or line[j] == '-')
+                        and (line[j - 1] == 'e' or line[j - 1] == 'E' or line[j - 1] == 'p'
+                             or line[j - 1] == 'P')))) {
+          ++j;
+        }
+        add_operand(line.substr(i, j - i));
+        i = j;
+      } else if (c == '"' or c == '\'') {
+        std::size_t j = i + 1;
+        while (j < n and line[j] != c) {
+          j += line[j] == '\\' ? 2 : 1;
+        }
+        j = std::min(j + 1, n);
+        add_operand(line.substr(i, j - i));
+        i = j;
+      } else {
+        std::size_t len = 0;
+        for (std::size_t k = 0; k < HALSTEAD_FIRST_KEYWORD; ++k) {
+          std::size_t size = std::strlen(HALSTEAD_OPERATORS[k]);
+          if (line.compare(i, size, HALSTEAD_OPERATORS[k]) == 0) {
+            add_operator(k);
+            len = size;
+            break;
+          }
+        }
+        i += std::max<std::size_t>(len, 1);  // closing brackets and stray characters
+      }
+    }
+  }
+
+  /// Counts of the file so far.
+  HalsteadCounts counts() const {
+    return HalsteadCounts{ m_operators.count(), m_operands.size(), m_total_operators,
+                           m_total_operands };
+  }
+
+  /// Distinct operators of the file so far.
+  const OperatorSet& operators() const { return m_operators; }
+
+  /// Ids of the distinct operands of the file so far, in the InternTable.
+  std::vector<std::uint32_t> operand_ids() const {
+    std::vector<std::uint32_t> ids;
+    ids.reserve(m_operands.size());
+    for (const auto& [word, id] : m_operands) {
+      ids.push_back(id);
+    }
+    return ids;
+  }
+
+private:
+  static bool is_ident_start(char c) {
+    return (c >= 'a' and c <= 'z') or (c >= 'A' and c <= 'Z') or c == '_' or c == '$'
+           or static_cast<unsigned char>(c) >= 0x80;
+  }
+  static bool is_ident(char c) { return is_ident_start(c) or (c >= '0' and c <= '9'); }
+  static bool isdigit(char c) { return c >= '0' and c <= '9'; }
+
+  /// Index of `word` in HALSTEAD_OPERATORS if it is a keyword, -1 otherwise.
+  static int keyword(std::string_view word) {
+    static const std::unordered_map<std::string_view, int> keywords = [] {
+      std::unordered_map<std::string_view, int> map;
+      for (std::size_t k = HALSTEAD_FIRST_KEYWORD; k < HALSTEAD_N_OPERATORS; ++k) {
+        map.emplace(HALSTEAD_OPERATORS[k], static_cast<int>(k));
+      }
+      return map;
+    }();
+    auto it = keywords.find(word);
+    return it == keywords.end() ? -1 : it->second;
+  }
+
+  void add_operator(std::size_t op) {
+    m_operators.set(op);
+    m_total_operators++;
+  }
+
+  void add_operand(std::string_view word) {
+    m_total_operands++;
+    auto it = m_operands.find(word);
+    if (it == m_operands.end())
+      m_operands.emplace(word, m_table.intern(word));
+  }
+
+  InternTable& m_table;
+  OperatorSet m_operators;
+  std::unordered_map<std::string_view, std::uint32_t> m_operands;
+  count_t m_total_operators = 0;
+  count_t m_total_operands = 0;
+};
+
+/// Halstead counts of each module (directory), merged from the files as they are scanned, and
+/// the table their operands are interned in.
+class HalsteadModules {
+public:
+  /// The table the scanners of the run intern their operands in.
+  InternTable& table() { return m_table; }
+
+  /// # of distinct operands in the whole run.
+  std::size_t n_operands() const { return m_table.size(); }
+
+  /**
+   * @brief Adds a file to its module. Thread-safe.
+   *
+   * @param module: The module of the file.
+   * @param file: The scanner, done with the file.
+   */
+  void add(const std::string& module, const HalsteadScanner& file) {
+    std::vector<std::uint32_t> ids = file.operand_ids();
+    HalsteadCounts counts = file.counts();
+    std::lock_guard<std::mutex> lock{ m_mutex };
+    MemScope scope{ mem_tag_e::INTERN };
+    Module& m = m_modules[module];
+    m.operators |= file.operators();
+    m.operands.insert(ids.begin(), ids.end());
+    m.total_operators += counts.total_operators;
+    m.total_operands += counts.total_operands;
+  }
+
+  /// Counts of each module, by module name.
+  std::map<std::string, HalsteadCounts> counts() const {
+    std::lock_guard<std::mutex> lock{ m_mutex };
+    std::map<std::string, HalsteadCounts> result;
+    for (const auto& [name, m] : m_modules) {
+      result[name] =
+        HalsteadCounts{ m.operators.count(), m.operands.size(), m.total_operators,
+                        m.total_operands };
+    }
+    return result;
+  }
+
+private:
+  struct Module {
+    OperatorSet operators;
+    std::unordered_set<std::uint32_t> operands;
+    count_t total_operators = 0;
+    count_t total_operands = 0;
+  };
+
+  InternTable m_table;
+  mutable std::mutex m_mutex;
+  std::unordered_map<std::string, Module> m_modules;
+};
+
+/// Derived Halstead measures.
+struct HalsteadMeasures {
+  count_t vocabulary;  //!< n = n1 + n2
+  count_t length;      //!< N = N1 + N2
+  double volume;       //!< V = N log2(n)
+  double difficulty;   //!< D = n1 / 2 * N2 / n2
+  double effort;       //!< E = D * V
+};
+
+inline HalsteadMeasures halstead_measures(const HalsteadCounts& c) {
+  HalsteadMeasures m{};
+  m.vocabulary = c.n_operators + c.n_operands;
+  m.length = c.total_operators + c.total_operands;
+  m.volume = m.vocabulary > 0 ? static_cast<double>(m.length) * std::log2(m.vocabulary) : 0;
+  m.difficulty = c.n_operands > 0 ? c.n_operators / 2.0 * c.total_operands / c.n_operands : 0;
+  m.effort = m.difficulty * m.volume;
+  return m;
+}
+
+#endif
@@ -0,0 +1,356 @@
+#ifndef HISTORY_ARCHIVE_H
+#define HISTORY_ARCHIVE_H
+
+/*!
+ * @file history_archive.h
+ * @description
+ * Append-only archive of snapshots (`--history FILE`), read back by `sloc history`.
+ *
+ * Consecutive snapshots of a tree share most of their rows, so each snapshot only stores what
+ * changed since the previous one, as varints:
+ * - the paths seen for the first time, which get the next ids of a dictionary that grows over
+ *   the whole archive;
+ * - the changed or added files, as the gap to the previous path id, the language and the
+ *   zigzag encoded difference of each counter;
+ * - the ids of the files that disappeared.
+ *
+ * Every HISTORY_KEYFRAME_INTERVAL snapshots a keyframe stores every file against zero instead,
+ * so a snapshot is rebuilt from the closest keyframe before it, not from the first snapshot.
+ *
+ * File layout: the "SLOCHIST" magic and a version varint, then one record per snapshot:
+ * a 'K' (keyframe) or 'D' (delta) byte, the payload size as a varint, and the payload
+ * (time, base directory, new paths, changed files, removed files).
+ */
+#include <cstdint>
+#include <ctime>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "file_info.h"
+#include "table_report.h"
+#include "varint.h"
+
+constexpr char HISTORY_MAGIC[] = "SLOCHIST";
+constexpr std::uint64_t HISTORY_VERSION = 1;
+/// # of snapshots between two keyframes.
+constexpr std::size_t HISTORY_KEYFRAME_INTERVAL = 64;
+
+/// Counters of one file in one snapshot.
+struct HistoryCounts {
+  bool present = false;  //!< The file exists in the snapshot.
+  std::uint8_t type = UNDEF;
+  count_t n_blank = 0;
+  count_t n_comments = 0;
+  count_t n_doc = 0;
+  count_t n_loc = 0;
+  count_t n_lines = 0;
+
+  bool operator==(const HistoryCounts& o) const {
+    return present == o.present and type == o.type and n_blank == o.n_blank
+           and n_comments == o.n_comments and n_doc == o.n_doc and n_loc == o.n_loc
+           and n_lines == o.n_lines;
+  }
+  bool operator!=(const HistoryCounts& o) const { return !(*this == o); }
+};
+
+/// A whole snapshot, indexed by path id.
+using HistoryState = std::vector<HistoryCounts>;
+
+/// Reads an archive; snapshots are rebuilt on demand from the closest keyframe.
+class HistoryReader {
+public:
+  /**
+   * @brief Reads an archive and indexes its records.
+   *
+   * @param filename: The archive.
+   * @param error: Receives a description of the problem, if any.
+   * @return true if the archive is valid.
+   */
+  bool open(const std::string& filename, std::string& error) {
+    std::ifstream in(filename, std::ios::binary);
+    if (!in.is_open()) {
+      error = "could not open " + filename;
+      return false;
+    }
+    std::stringstream ss;
+    ss << in.rdbuf();
+    m_data = ss.str();
+    m_records.clear();
+    m_paths.clear();
+    m_ids.clear();
+
+    const char* p = m_data.data();
+    const char* end = p + m_data.size();
+    std::uint64_t version = 0;
+    constexpr std::size_t magic_len = sizeof(HISTORY_MAGIC) - 1;
+    if (m_data.compare(0, magic_len, HISTORY_MAGIC) != 0
+        or !get_varint(p += magic_len, end, version) or version != HISTORY_VERSION) {
+      error = filename + " is not a history archive";
+      return false;
+    }
+    while (p != end) {
+      Record r;
+      r.keyframe = *p == 'K';
+      std::uint64_t size = 0;
+      if ((*p != 'K' and *p != 'D') or !get_varint(++p, end, size)
+          or size > static_cast<std::uint64_t>(end - p) or (m_records.empty() and !r.keyframe)) {
+        error = filename + " is corrupt";
+        return false;
+      }
+      const char* q = p;
+      p += size;
+      // Only the header and the new paths are read now; the files are decoded on demand.
+      std::uint64_t time = 0, len = 0, n_paths = 0;
+      bool ok = get_varint(q, p, time) and get_varint(q, p, len) and len <= std::uint64_t(p - q);
+      if (ok) {
+        r.time = static_cast<std::int64_t>(time);
+        r.base_dir.assign(q, len);
+        q += len;
+        ok = get_varint(q, p, n_paths);
+      }
+      for (std::uint64_t i = 0; ok and i < n_paths; ++i) {
+        ok = get_varint(q, p, len) and len <= std::uint64_t(p - q);
+        if (ok) {
+          m_ids.emplace(std::string{ q, len }, m_paths.size());
+          m_paths.emplace_back(q, len);
+          q += len;
+        }
+      }
+      if (!ok) {
+        error = filename + " is corrupt";
+        return false;
+      }
+      r.files = q;
+      r.end = p;
+      r.n_paths = m_paths.size();
+      m_records.push_back(r);
+    }
+    return true;
+  }
+
+  /// # of snapshots.
+  std::size_t size() const { return m_records.size(); }
+  std::int64_t time(std::size_t i) const { return m_records[i].time; }
+  const std::string& base_dir(std::size_t i) const { return m_records[i].base_dir; }
+  /// Paths of every id, in order of first appearance.
+  const std::vector<std::string>& paths() const { return m_paths; }
+
+  /// Id of `path`, or paths().size() if it never appears in the archive.
+  std::size_t find(const std::string& path) const {
+    auto it = m_ids.find(path);
+    return it == m_ids.end() ? m_paths.size() : it->second;
+  }
+
+  /**
+   * @brief Rebuilds snapshot `i`.
+   *
+   * @param state: Receives the snapshot, one entry per path id.
+   * @return false if the archive is corrupt.
+   */
+  bool snapshot(std::size_t i, HistoryState& state) const {
+    std::size_t k = i;
+    while (!m_records[k].keyframe) {
+      --k;
+    }
+    for (; k <= i; ++k) {
+      if (!apply(k, state))
+        return false;
+    }
+    return true;
+  }
+
+  /**
+   * @brief Counters of one path in every snapshot.
+   *
+   * @param id: The path id, see find().
+   * @param series: Receives one entry per snapshot.
+   * @return false if the archive is corrupt.
+   */
+  bool series(std::size_t id, std::vector<HistoryCounts>& series) const {
+    HistoryState state;
+    series.clear();
+    for (std::size_t i = 0; i < size(); ++i) {
+      if (!apply(i, state))
+        return false;
+      series.push_back(id < state.size() ? state[id] : HistoryCounts{});
+    }
+    return true;
+  }
+
+  /// Applies record `i` on top of the snapshot before it (anything, for a keyframe).
+  bool apply(std::size_t i, HistoryState& state) const {
+    const Record& r = m_records[i];
+    if (r.keyframe)
+      state.assign(r.n_paths, HistoryCounts{});
+    state.resize(r.n_paths);
+
+    const char* p = r.files;
+    std::uint64_t n = 0, id = 0, gap = 0;
+    if (!get_varint(p, r.end, n))
+      return false;
+    for (std::uint64_t e = 0; e < n; ++e) {
+      std::uint64_t type = 0, d[5];
+      if (!get_varint(p, r.end, gap) or (id += gap) >= state.size()
+          or !get_varint(p, r.end, type))
+        return false;
+      for (auto& v : d) {
+        if (!get_varint(p, r.end, v))
+          return false;
+      }
+      HistoryCounts& c = state[id];
+      c.present = true;
+      c.type = static_cast<std::uint8_t>(type);
+      c.n_blank += static_cast<count_t>(unzigzag(d[0]));
+      c.n_comments += static_cast<count_t>(unzigzag(d[1]));
+      c.n_doc += static_cast<count_t>(unzigzag(d[2]));
+      c.n_loc += static_cast<count_t>(unzigzag(d[3]));
+      c.n_lines += static_cast<count_t>(unzigzag(d[4]));
+      ++id;
+    }
+    if (!get_varint(p, r.end, n))
+      return false;
+    id = 0;
+    for (std::uint64_t e = 0; e < n; ++e) {
+      if (!get_varint(p, r.end, gap) or (id += gap) >= state.size())
+        return false;
+      state[id++] = HistoryCounts{};
+    }
+    return p == r.end;
+  }
+
+private:
+  struct Record {
+    bool keyframe = false;
+    std::int64_t time = 0;
+    std::string base_dir;
+    const char* files = nullptr;  //!< Start of the changed files in m_data.
+    const char* end = nullptr;    //!< End of the record.
+    std::size_t n_paths = 0;      //!< Size of the path dictionary after this record.
+  };
+
+  std::string m_data;
+  std::vector<Record> m_records;
+  std::vector<std::string> m_paths;
+  std::unordered_map<std::string, std::size_t> m_ids;
+};
+
+/**
+ * @brief Appends the results of this run to a history archive, creating it if needed.
+ *
+ * @param filename: The archive.
+ * @param files: The files counted in this run.
+ * @param base_dir: Paths are stored relative to this directory.
+ * @param error: Receives a description of the failure, if any.
+ * @return true on success.
+ */
+inline bool append_history(const std::string& filename,
+                           const FileList& files,
+                           const std::string& base_dir,
+                           std::string& error) {
+  HistoryReader reader;
+  HistoryState previous;
+  std::ifstream probe(filename, std::ios::binary | std::ios::ate);
+  bool exists = probe.is_open() and probe.tellg() > 0;
+  probe.close();
+  if (exists) {
+    if (!reader.open(filename, error))
+      return false;
+    if (reader.size() > 0 and !reader.snapshot(reader.size() - 1, previous)) {
+      error = filename + " is corrupt";
+      return false;
+    }
+  }
+
+  // Current snapshot, growing the dictionary with the paths seen for the first time.
+  std::unordered_map<std::string, std::size_t> new_ids;
+  std::vector<std::string> new_paths;
+  std::size_t n_known = reader.paths().size();
+  HistoryState current(n_known);
+  for (const auto& f : files) {
+    std::string path = relative_basename(f.filename, base_dir);
+    std::size_t id = reader.find(path);
+    if (id == n_known) {
+      auto [it, added] = new_ids.emplace(path, n_known + new_paths.size());
+      if (added) {
+        new_paths.push_back(path);
+        current.emplace_back();
+      }
+      id = it->second;
+    }
+    current[id] = HistoryCounts{ true,
+                                 static_cast<std::uint8_t>(f.type),
+                                 f.n_blank,
+                                 all_comment_lines(f),
+                                 all_doc_lines(f),
+                                 f.n_loc,
+                                 f.n_lines };
+  }
+
+  bool keyframe = reader.size() % HISTORY_KEYFRAME_INTERVAL == 0;
+  if (keyframe)
+    previous.clear();
+  previous.resize(current.size());
+
+  std::string payload;
+  put_varint(payload, static_cast<std::uint64_t>(std::time(nullptr)));
+  put_varint(payload, base_dir.size());
+  payload += base_dir;
+  put_varint(payload, new_paths.size());
+  for (const auto& path : new_paths) {
+    put_varint(payload, path.size());
+    payload += path;
+  }
+
+  std::string changed, removed;
+  std::size_t n_changed = 0, n_removed = 0, last_changed = 0, last_removed = 0;
+  for (std::size_t id = 0; id < current.size(); ++id) {
+    const HistoryCounts& now = current[id];
+    const HistoryCounts& before = previous[id];
+    if (now == before)
+      continue;
+    if (!now.present) {
+      put_varint(removed, id - last_removed);
+      last_removed = id + 1;
+      ++n_removed;
+      continue;
+    }
+    auto diff = [](count_t a, count_t b) {
+      return zigzag(static_cast<std::int64_t>(a) - static_cast<std::int64_t>(b));
+    };
+    put_varint(changed, id - last_changed);
+    put_varint(changed, now.type);
+    put_varint(changed, diff(now.n_blank, before.n_blank));
+    put_varint(changed, diff(now.n_comments, before.n_comments));
+    put_varint(changed, diff(now.n_doc, before.n_doc));
+    put_varint(changed, diff(now.n_loc, before.n_loc));
+    put_varint(changed, diff(now.n_lines, before.n_lines));
+    last_changed = id + 1;
+    ++n_changed;
+  }
+  put_varint(payload, n_changed);
+  payload += changed;
+  put_varint(payload, n_removed);
+  payload += removed;
+
+  std::string record;
+  if (!exists) {
+    record = HISTORY_MAGIC;
+    put_varint(record, HISTORY_VERSION);
+  }
+  record += keyframe ? 'K' : 'D';
+  put_varint(record, payload.size());
+  record += payload;
+
+  std::ofstream out(filename, std::ios::binary | std::ios::app);
+  if (!out.write(record.data(), static_cast<std::streamsize>(record.size())) or !out.flush()) {
+    error = "could not write " + filename;
+    return false;
+  }
+  return true;
+}
+
+#endif
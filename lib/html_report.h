@@ -0,0 +1,197 @@
+#ifndef HTML_REPORT_H
+#define HTML_REPORT_H
+
+/*!
+ * @file html_report.h
+ * @description
+ * Self-contained HTML report (`--format html`): a treemap of lines of code by directory and
+ * language, drawn in the browser from a compact JSON roll-up embedded in the page.
+ *
+ * Files are rolled up by directory while they are counted, so the report never holds one row
+ * per file. The page then streams one JSON array per directory:
+ *   [name, parent index, # of files, [code lines per language]]
+ * Parents come before their children, and the counts are those of the files directly in the
+ * directory; the page adds up the subtrees itself.
+ */
+#include <array>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "file_info.h"
+#include "table_report.h"
+
+/// Directories and per-language code lines of a run, built one batch of files at a time.
+class HtmlReport {
+public:
+  /// @param base_dir: Directories are shown relative to this directory.
+  explicit HtmlReport(std::string base_dir) : m_base_dir{ std::move(base_dir) } {
+    m_nodes.push_back(Node{ ".", 0, 0, {}, {} });
+    m_prefix = m_base_dir;
+    if (m_prefix.empty() or m_prefix.back() != '/')
+      m_prefix += '/';
+  }
+
+  /// Adds files to the roll-up of their directories.
+  void add(const FileInfo* begin, const FileInfo* end) {
+    for (const FileInfo* f = begin; f != end; ++f) {
+      Node& dir = m_nodes[directory_of(relative_path(f->filename))];
+      dir.n_files++;
+      dir.sloc[f->type] += f->n_loc;
+    }
+  }
+
+  /**
+   * @brief Writes the whole page.
+   *
+   * @param warning: If not empty, shown in a banner above the treemap (e.g. partial results).
+   */
+  void write(std::ostream& out, const std::string& warning = {}) const {
+    out << "<!DOCTYPE html>\n<html><head><meta charset=\"utf-8\">\n<title>sloc: ";
+    write_escaped(out, m_base_dir, false);
+    out << "</title>\n<style>" << STYLE << "</style>\n</head><body>\n"
+        << "<header><h1>Lines of code in <span id=\"path\"></span></h1>";
+    if (!warning.empty()) {
+      out << "<p class=\"warning\">";
+      write_escaped(out, warning, false);
+      out << "</p>";
+    }
+    out << "<div id=\"legend\"></div></header>\n<div id=\"map\"></div>\n"
+        << "<script type=\"application/json\" id=\"data\">{\"base\":";
+    write_escaped(out, m_base_dir, true);
+    out << ",\"langs\":[";
+    for (int t = 0; t <= UNDEF; ++t) {
+      out << (t == 0 ? "" : ",");
+      write_escaped(out, lang_type_to_string(static_cast<lang_type_e>(t)), true);
+    }
+    out << "],\"dirs\":[";
+    for (std::size_t i = 0; i < m_nodes.size(); ++i) {
+      const Node& n = m_nodes[i];
+      out << (i == 0 ? "\n[" : ",\n[");
+      write_escaped(out, n.name, true);
+      out << ',' << n.parent << ',' << n.n_files << ",[";
+      for (int t = 0; t <= UNDEF; ++t) {
+        out << (t == 0 ? "" : ",") << n.sloc[t];
+      }
+      out << "]]";
+    }
+    out << "]}</script>\n<script>" << SCRIPT << "</script>\n</body></html>\n";
+  }
+
+private:
+  struct Node {
+    std::string name;
+    std::size_t parent;
+    count_t n_files;
+    std::array<count_t, UNDEF + 1> sloc;  //!< Code lines of the files directly in it.
+    std::unordered_map<std::string, std::size_t> children;
+  };
+
+  /// Path of a file relative to the base directory. Paths found under the base directory are
+  /// cut lexically, which avoids resolving every path on disk.
+  std::string relative_path(const std::string& filename) const {
+    if (filename.compare(0, m_prefix.size(), m_prefix) == 0
+        and filename.find("/.", m_prefix.size() - 1) == std::string::npos)
+      return filename.substr(m_prefix.size());
+    return relative_basename(filename, m_base_dir);
+  }
+
+  /// Node of the directory of `path`, created along with its parents if needed.
+  std::size_t directory_of(std::string_view path) {
+    std::size_t node = 0;
+    for (std::size_t slash; (slash = path.find('/')) != std::string_view::npos;
+         path.remove_prefix(slash + 1)) {
+      if (slash == 0)
+        continue;
+      std::string name{ path.substr(0, slash) };
+      auto it = m_nodes[node].children.find(name);
+      if (it == m_nodes[node].children.end()) {
+        it = m_nodes[node].children.emplace(name, m_nodes.size()).first;
+        m_nodes.push_back(Node{ std::move(name), node, 0, {}, {} });
+      }
+      node = it->second;
+    }
+    return node;
+  }
+
+  /// Writes `s` as a JSON string (quoted) or as HTML text. Either way '<' is escaped, so the
+  /// data cannot close the script element it is embedded in.
+  static void write_escaped(std::ostream& out, std::string_view s, bool json) {
+    if (json)
+      out << '"';
+    for (char c : s) {
+      auto u = static_cast<unsigned char>(c);
+      if (json and (c == '"' or c == '\\')) {
+        out << '\\' << c;
+      } else if (json and (u < 0x20 or c == '<' or c == '>' or c == '&')) {
+        const char* hex = "0123456789abcdef";
+        out << "\\u00" << hex[u >> 4] << hex[u & 0xf];
+      } else if (!json and (c == '<' or c == '>' or c == '&')) {
+        out << (c == '<' ? "&lt;" : c == '>' ? "&gt;" : "&amp;");
+      } else {
+        out << c;
+      }
+    }
+    if (json)
+      out << '"';
+  }
+
+  static constexpr const char* STYLE =
+    "body{margin:0;font:13px sans-serif;display:flex;flex-direction:column;height:100vh}"
+    "header{padding:6px 10px}h1{font-size:16px;margin:0 0 4px}"
+    ".warning{margin:0 0 4px;padding:4px 8px;background:#fde8c8;border:1px solid #e0a040}"
+    "#path a{cursor:pointer;color:#06c}#legend span{margin-right:12px}"
+    "#legend i{display:inline-block;width:10px;height:10px;margin-right:4px}"
+    "#map{position:relative;flex:1;margin:0 10px 10px}"
+    ".t{position:absolute;box-sizing:border-box;border:1px solid #fff;overflow:hidden;"
+    "white-space:nowrap;font-size:11px;padding:1px 3px;cursor:default}"
+    ".d{cursor:pointer;background:#eee;border-color:#999}";
+
+  /// Squarified treemap of the selected directory: its subdirectories, which can be clicked to
+  /// zoom in, and one tile per language for the files directly in it. Items are sorted by
+  /// decreasing size, so the first item of a row is its largest and the next one its smallest.
+  static constexpr const char* SCRIPT =
+    "const D=JSON.parse(document.getElementById('data').textContent);"
+    "const C=['#4e79a7','#f28e2b','#76b7b2','#e15759','#bab0ac'];"
+    "const N=D.dirs.map(d=>({name:d[0],parent:d[1],files:d[2],own:d[3],kids:[],"
+    "total:d[3].reduce((a,b)=>a+b,0)}));"
+    "for(let i=N.length-1;i>0;--i){const p=N[N[i].parent];p.kids.push(i);p.total+=N[i].total;}"
+    "document.getElementById('legend').innerHTML=D.langs.map((l,i)=>"
+    "`<span><i style=\"background:${C[i]}\"></i>${l}</span>`).join('');"
+    "function esc(s){return s.replace(/[&<>\"]/g,c=>'&#'+c.charCodeAt(0)+';');}"
+    "function layout(items,x,y,w,h,out){"
+    "let i=0,sum=items.reduce((a,b)=>a+b.v,0);"
+    "while(i<items.length){const horiz=w>=h,side=horiz?h:w;let row=[],rs=0,worst=Infinity;"
+    "while(i<items.length){const v=items[i].v,s=rs+v,len=s/sum*(horiz?w:h),"
+    "mx=row.length?row[0].v:v,q=Math.max(side*mx/s/len,len/(side*v/s));"
+    "if(q>worst&&row.length)break;worst=q;row.push(items[i++]);rs=s;}"
+    "const len=rs/sum*(horiz?w:h);let o=0;"
+    "for(const r of row){const k=r.v/rs*side;"
+    "out.push(horiz?[r,x,y+o,len,k]:[r,x+o,y,k,len]);o+=k;}"
+    "if(horiz){x+=len;w-=len;}else{y+=len;h-=len;}sum-=rs;}}"
+    "let cur=0;function show(id){cur=id;const n=N[id],map=document.getElementById('map');"
+    "let crumbs=[],p=id;while(true){crumbs.unshift(p);if(p===0)break;p=N[p].parent;}"
+    "document.getElementById('path').innerHTML=crumbs.map(c=>"
+    "`<a onclick=\"show(${c})\">${esc(c===0?D.base:N[c].name)}</a>`).join(' / ');"
+    "const items=n.kids.map(k=>({v:N[k].total,dir:k}))"
+    ".concat(n.own.map((v,l)=>({v:v,lang:l}))).filter(i=>i.v>0).sort((a,b)=>b.v-a.v);"
+    "const tiles=[];layout(items,0,0,map.clientWidth,map.clientHeight,tiles);"
+    "map.innerHTML=tiles.filter(t=>t[3]>=2&&t[4]>=2).map(([it,x,y,w,h])=>{"
+    "const st=`left:${x}px;top:${y}px;width:${w}px;height:${h}px`;"
+    "if(it.dir!==undefined){const d=N[it.dir];"
+    "return `<div class=\"t d\" style=\"${st}\" onclick=\"show(${it.dir})\" "
+    "title=\"${esc(d.name)}: ${d.total} lines of code\">${esc(d.name)}</div>`;}"
+    "return `<div class=\"t\" style=\"${st};background:${C[it.lang]}\" "
+    "title=\"${esc(D.langs[it.lang])} files in ${esc(n.name)}: ${it.v} lines of code\"></div>`;"
+    "}).join('');}"
+    "show(0);window.onresize=()=>show(cur);";
+
+  std::string m_base_dir;
+  std::string m_prefix;  //!< m_base_dir ending with '/'.
+  std::vector<Node> m_nodes;  //!< m_nodes[0] is the base directory.
+};
+
+#endif
@@ -0,0 +1,280 @@
+#ifndef JSON_SAX_H
+#define JSON_SAX_H
+
+/*!
+ * @file json_sax.h
+ * @description
+ * Streaming (SAX-style) JSON parser, for inputs too large to hold in memory, such as the
+ * compilation databases read by `--compdb`.
+ *
+ * The input is read in fixed-size chunks and handed to a handler as events; nothing is kept but
+ * the current chunk, the stack of open containers and the string being decoded. Strings the
+ * handler does not want (see Handler::key()) are skipped without being copied, so memory does
+ * not depend on the size of the input, nor on its longest unwanted string.
+ *
+ * A handler provides:
+ * - void object_begin(), object_end(), array_begin(), array_end();
+ * - bool key(std::string_view k): whether the strings in the value of `k` are wanted;
+ * - void string(std::string_view s): a wanted string value;
+ * - void scalar(std::string_view s): a number, true, false or null, as written.
+ */
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/// Parses one JSON document from a stream.
+class JsonSaxParser {
+public:
+  /// Size of the chunks the input is read in.
+  static constexpr std::size_t CHUNK_SIZE = 64 * 1024;
+
+  explicit JsonSaxParser(std::istream& in) : m_in{ in }, m_chunk(CHUNK_SIZE) {}
+
+  /**
+   * @brief Parses the whole document, feeding `handler`.
+   *
+   * @param handler: Receives the events, see the file description.
+   * @param error: Receives a description of the problem, if any.
+   * @return true if the input is well-formed JSON.
+   */
+  template <typename Handler>
+  bool parse(Handler& handler, std::string& error) {
+    // One entry per open container: '{' or '[', and whether its strings are wanted.
+    std::vector<std::pair<char, bool>> stack;
+    bool want = true;
+    for (;;) {
+      // A value.
+      int c = skip_blanks();
+      if (c == '{' or c == '[') {
+        stack.emplace_back(static_cast<char>(c), want);
+        if (c == '{')
+          handler.object_begin();
+        else
+          handler.array_begin();
+        int d = skip_blanks();
+        if (d < 0) {
+          return fail(error, "unexpected end of input");
+        } else if (d == (c == '{' ? '}' : ']')) {
+          close(handler, stack);
+        } else {
+          m_pos--;
+          if (c == '{' and !read_key(handler, want, error))
+            return false;
+          continue;
+        }
+      } else if (c == '"') {
+        if (!read_string(want ? &m_string : nullptr)) {
+          return fail(error, "unterminated string");
+        }
+        if (want)
+          handler.string(m_string);
+      } else if (c == '-' or (c >= '0' and c <= '9') or (c >= 'a' and c <= 'z')) {
+        m_string.assign(1, static_cast<char>(c));
+        for (int d = peek(); d == '-' or d == '+' or d == '.' or (d >= '0' and d <= '9')
+                             or (d >= 'a' and d <= 'z') or (d >= 'A' and d <= 'Z');
+             d = peek()) {
+          m_string += static_cast<char>(d);
+          m_pos++;
+        }
+        handler.scalar(m_string);
+      } else {
+        return fail(error, c < 0 ? "unexpected end of input" : "unexpected character");
+      }
+
+      // What follows a value: a ',', the end of its container, or the end of the input.
+      for (;;) {
+        if (stack.empty()) {
+          if (skip_blanks() >= 0)
+            return fail(error, "trailing characters after the document");
+          return true;
+        }
+        int d = skip_blanks();
+        if (d == ',') {
+          want = stack.back().second;
+          if (stack.back().first == '{' and !read_key(handler, want, error))
+            return false;
+          break;
+        }
+        if (d != (stack.back().first == '{' ? '}' : ']'))
+          return fail(error, "expected ',' or the end of a container");
+        close(handler, stack);
+      }
+    }
+  }
+
+private:
+  bool fill() {
+    if (m_eof)
+      return false;
+    m_in.read(m_chunk.data(), static_cast<std::streamsize>(m_chunk.size()));
+    m_offset += m_end;
+    m_end = static_cast<std::size_t>(m_in.gcount());
+    m_pos = 0;
+    m_eof = m_end == 0;
+    return !m_eof;
+  }
+
+  int get() {
+    if (m_pos == m_end and !fill())
+      return -1;
+    return static_cast<unsigned char>(m_chunk[m_pos++]);
+  }
+
+  int peek() {
+    if (m_pos == m_end and !fill())
+      return -1;
+    return static_cast<unsigned char>(m_chunk[m_pos]);
+  }
+
+  int skip_blanks() {
+    int c = get();
+    while (c == ' ' or c == '\t' or c == '\n' or c == '\r') {
+      c = get();
+    }
+    return c;
+  }
+
+  bool fail(std::string& error, const char* what) const {
+    error = std::string{ what } + " at byte " + std::to_string(m_offset + m_pos);
+    return false;
+  }
+
+  template <typename Handler>
+  void close(Handler& handler, std::vector<std::pair<char, bool>>& stack) {
+    if (stack.back().first == '{')
+      handler.object_end();
+    else
+      handler.array_end();
+    stack.pop_back();
+  }
+
+  /// Reads `"key":`, telling the handler; `want` receives its answer.
+  template <typename Handler>
+  bool read_key(Handler& handler, bool& want, std::string& error) {
+    if (skip_blanks() != '"')
+      return fail(error, "expected a key");
+    if (!read_string(&m_key))
+      return fail(error, "unterminated string");
+    if (skip_blanks() != ':')
+      return fail(error, "expected ':'");
+    want = handler.key(m_key);
+    return true;
+  }
+
+  /// Reads 4 hex digits of a \u escape.
+  bool read_hex(std::uint32_t& v) {
+    v = 0;
+    for (int i = 0; i < 4; ++i) {
+      int c = get();
+      int digit = c >= '0' and c <= '9'   ? c - '0'
+                  : c >= 'a' and c <= 'f' ? c - 'a' + 10
+                  : c >= 'A' and c <= 'F' ? c - 'A' + 10
+                                          : -1;
+      if (digit < 0)
+        return false;
+      v = v << 4 | static_cast<std::uint32_t>(digit);
+    }
+    return true;
+  }
+
+  static void put_utf8(std::string& out, std::uint32_t cp) {
+    if (cp < 0x80) {
+      out += static_cast<char>(cp);
+    } else if (cp < 0x800) {
+      out += static_cast<char>(0xc0 | cp >> 6);
+      out += static_cast<char>(0x80 | (cp & 0x3f));
+    } else if (cp < 0x10000) {
+      out += static_cast<char>(0xe0 | cp >> 12);
+      out += static_cast<char>(0x80 | (cp >> 6 & 0x3f));
+      out += static_cast<char>(0x80 | (cp & 0x3f));
+    } else {
+      out += static_cast<char>(0xf0 | cp >> 18);
+      out += static_cast<char>(0x80 | (cp >> 12 & 0x3f));
+      out += static_cast<char>(0x80 | (cp >> 6 & 0x3f));
+      out += static_cast<char>(0x80 | (cp & 0x3f));
+    }
+  }
+
+  /**
+   * @brief Reads a string whose opening quote was consumed, decoding it into `out`, or just
+   * skipping it if `out` is null.
+   */
+  bool read_string(std::string* out) {
+    if (out != nullptr)
+      out->clear();
+    for (;;) {
+      if (m_pos == m_end and !fill())
+        return false;
+      // Runs without quotes or escapes are copied (or skipped) whole.
+      const char* begin = m_chunk.data() + m_pos;
+      const char* end = m_chunk.data() + m_end;
+      const char* p = begin;
+      while (p != end and *p != '"' and *p != '\\') {
+        ++p;
+      }
+      if (out != nullptr)
+        out->append(begin, p);
+      m_pos += static_cast<std::size_t>(p - begin);
+      if (p == end)
+        continue;
+      m_pos++;
+      if (*p == '"')
+        return true;
+      int e = get();
+      char decoded;
+      switch (e) {
+      case 'b':
+        decoded = '\b';
+        break;
+      case 'f':
+        decoded = '\f';
+        break;
+      case 'n':
+        decoded = '\n';
+        break;
+      case 'r':
+        decoded = '\r';
+        break;
+      case 't':
+        decoded = '\t';
+        break;
+      case 'u': {
+        std::uint32_t cp;
+        if (!read_hex(cp))
+          return false;
+        // A high surrogate takes the low one that follows.
+        if (cp >= 0xd800 and cp < 0xdc00 and peek() == '\\') {
+          m_pos++;
+          std::uint32_t low;
+          if (get() != 'u' or !read_hex(low))
+            return false;
+          cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+        }
+        if (out != nullptr)
+          put_utf8(*out, cp);
+        continue;
+      }
+      case -1:
+        return false;
+      default:  // '"', '\\', '/'
+        decoded = static_cast<char>(e);
+      }
+      if (out != nullptr)
+        *out += decoded;
+    }
+  }
+
+  std::istream& m_in;
+  std::vector<char> m_chunk;
+  std::size_t m_pos = 0;      //!< Next byte in m_chunk.
+  std::size_t m_end = 0;      //!< # of valid bytes in m_chunk.
+  std::uint64_t m_offset = 0;  //!< Offset in the input of m_chunk[0].
+  bool m_eof = false;
+  std::string m_key;
+  std::string m_string;
+};
+
+#endif
@@ -0,0 +1,130 @@
+#ifndef LICENSE_HEADERS_H
+#define LICENSE_HEADERS_H
+
+/*!
+ * @file license_headers.h
+ * @description
+ * License header detection (`--licenses`).
+ *
+ * While a file is parsed, its leading comment block (the comment and doc lines before the first
+ * line of code, or the first blank line outside a comment) is hashed once. Digits are folded
+ * before hashing so headers that only differ by their years still match. After the run, the
+ * blocks shared by at least LICENSE_MIN_FILES files are taken as license headers, and their
+ * lines are moved from the comment and doc counters to a separate license counter.
+ */
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "code_parser.h"
+#include "file_info.h"
+
+/// # of files that must share a leading comment block for it to be a license header.
+constexpr std::size_t LICENSE_MIN_FILES = 3;
+/// Shorter blocks (e.g. a lone "// -*- C++ -*-") are never license headers.
+constexpr count_t LICENSE_MIN_LINES = 3;
+
+/// The leading comment block of a file.
+struct HeaderFingerprint {
+  std::uint64_t hash = 0;  //!< 0 if the file does not start with a comment.
+  count_t n_comments = 0;  //!< # of comment lines in the block.
+  count_t n_doc = 0;       //!< # of doc lines in the block.
+};
+
+/// Builds the fingerprint of a file from its lines, in order, as they are parsed.
+class HeaderScanner {
+public:
+  /**
+   * @brief Feeds the next line of the file.
+   *
+   * @param line: The line.
+   * @param category: What the parser counted it as.
+   * @param in_comment: Whether the parser is inside a block comment after the line.
+   * @return false once the block is over; later lines need not be fed.
+   */
+  bool add(std::string_view line, line_category_e category, bool in_comment) {
+    if (category == LINE_BLANK)
+      return !m_started or in_comment;
+    if (category == LINE_CODE)
+      return false;
+    m_started = true;
+    (category == LINE_DOC ? m_fingerprint.n_doc : m_fingerprint.n_comments)++;
+
+    // FNV-1a over the trimmed line, with every run of digits folded into one '0'.
+    std::size_t first = line.find_first_not_of(" \t\r\f\v");
+    std::size_t last = line.find_last_not_of(" \t\r\f\v");
+    bool in_number = false;
+    for (std::size_t i = first; i <= last; ++i) {
+      bool digit = line[i] >= '0' and line[i] <= '9';
+      if (!(digit and in_number))
+        mix(digit ? '0' : line[i]);
+      in_number = digit;
+    }
+    mix('\n');
+    return true;
+  }
+
+  /// The fingerprint of the lines fed so far.
+  HeaderFingerprint fingerprint() const {
+    HeaderFingerprint f = m_fingerprint;
+    f.hash = m_started ? m_hash : 0;
+    return f;
+  }
+
+private:
+  void mix(char c) {
+    m_hash ^= static_cast<unsigned char>(c);
+    m_hash *= 0x100000001b3ull;
+  }
+
+  bool m_started = false;
+  std::uint64_t m_hash = 0xcbf29ce484222325ull;
+  HeaderFingerprint m_fingerprint;
+};
+
+/**
+ * @brief Learns the license headers of the run.
+ *
+ * @param headers: The fingerprint of each file of the run.
+ * @return the hashes of the blocks taken as license headers.
+ */
+inline std::unordered_set<std::uint64_t> learn_license_headers(
+  const std::vector<HeaderFingerprint>& headers) {
+  std::unordered_map<std::uint64_t, std::size_t> frequency;
+  for (const auto& h : headers) {
+    if (h.hash != 0 and h.n_comments + h.n_doc >= LICENSE_MIN_LINES)
+      frequency[h.hash]++;
+  }
+  std::unordered_set<std::uint64_t> licenses;
+  for (const auto& [hash, n] : frequency) {
+    if (n >= LICENSE_MIN_FILES)
+      licenses.insert(hash);
+  }
+  return licenses;
+}
+
+/**
+ * @brief Moves the lines of the license headers to FileInfo::n_license.
+ *
+ * @param files: The files of the run.
+ * @param headers: The fingerprint of each file, in the same order.
+ * @param licenses: The license headers, see learn_license_headers().
+ */
+inline void classify_license_headers(FileList& files,
+                                     const std::vector<HeaderFingerprint>& headers,
+                                     const std::unordered_set<std::uint64_t>& licenses) {
+  for (std::size_t i = 0; i < files.size() and i < headers.size(); ++i) {
+    const HeaderFingerprint& h = headers[i];
+    if (h.hash == 0 or licenses.count(h.hash) == 0)
+      continue;
+    FileInfo& f = files[i];
+    f.n_comments -= h.n_comments;
+    f.n_doc -= h.n_doc;
+    f.n_license = h.n_comments + h.n_doc;
+    f.n_license_doc = h.n_doc;
+  }
+}
+
+#endif
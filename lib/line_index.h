@@ -0,0 +1,132 @@
+#ifndef LINE_INDEX_H
+#define LINE_INDEX_H
+
+/*!
+ * @file line_index.h
+ * @description
+ * Parser-state checkpoints (`--line-index K`), for classifying any line of a file without
+ * parsing it from the top.
+ *
+ * Whether a line is a comment depends on every line before it, but only through the 2-bit
+ * CodeParser::state(). Every K lines the byte offset of the next line and the state the parser
+ * is in there are recorded, as one varint each: (offset delta << 2) | state. Classifying lines
+ * [first, last) then means decoding up to the checkpoint before `first` and parsing from it,
+ * at most K - 1 lines more than the range itself.
+ *
+ * The index is built during the normal parse and stored per file in the slocbin output, with
+ * the size and content_hash() of the file it describes; `sloc query --lines` reads it back, and
+ * only trusts it for a file that still has that size and hash.
+ */
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#include "code_parser.h"
+#include "varint.h"
+
+/// FNV-1a hash of the contents of a file, stored with its index to detect later edits.
+inline std::uint64_t content_hash(std::string_view text) {
+  std::uint64_t h = 14695981039346656037ull;
+  for (unsigned char c : text) {
+    h ^= c;
+    h *= 1099511628211ull;
+  }
+  return h;
+}
+
+/// Records the checkpoints of one file while it is parsed.
+class LineIndexBuilder {
+public:
+  /// @param stride: # of lines between two checkpoints (K).
+  explicit LineIndexBuilder(std::uint32_t stride) : m_stride{ stride } {}
+
+  /**
+   * @brief Called after each line is parsed.
+   *
+   * @param next_offset: Offset in the file of the line after it.
+   * @param state: The parser state after it, see CodeParser::state().
+   */
+  void add(std::uint64_t next_offset, std::uint8_t state) {
+    if (++m_line % m_stride != 0)
+      return;
+    put_varint(m_index, (next_offset - m_offset) << 2 | state);
+    m_offset = next_offset;
+  }
+
+  /// The encoded checkpoints; checkpoint 0 (offset 0, no comment) is implied.
+  std::string& index() { return m_index; }
+
+private:
+  std::uint32_t m_stride;
+  std::uint64_t m_line = 0;
+  std::uint64_t m_offset = 0;
+  std::string m_index;
+};
+
+/// Where the parser stands at a checkpoint.
+struct LineCheckpoint {
+  std::uint64_t line = 0;  //!< 0-based line number.
+  std::uint64_t offset = 0;
+  std::uint8_t state = 0;
+};
+
+/**
+ * @brief Finds the last checkpoint at or before a line.
+ *
+ * @param index: The encoded checkpoints of the file.
+ * @param stride: The K they were recorded with.
+ * @param line: 0-based line number.
+ */
+inline LineCheckpoint find_checkpoint(std::string_view index, std::uint32_t stride,
+                                      std::uint64_t line) {
+  LineCheckpoint c;
+  const char* p = index.data();
+  const char* end = p + index.size();
+  std::uint64_t v;
+  while (c.line + stride <= line and get_varint(p, end, v)) {
+    c.line += stride;
+    c.offset += v >> 2;
+    c.state = static_cast<std::uint8_t>(v & 3);
+  }
+  return c;
+}
+
+/**
+ * @brief Classifies lines [first, last) of a file from its checkpoints.
+ *
+ * @param text: The contents of the file, as indexed.
+ * @param index, stride: Its checkpoints, see LineIndexBuilder.
+ * @param first, last: 0-based line range; `last` may go past the end of the file.
+ * @param fn: Called with the line number and category of each line in the range, in order.
+ */
+template <typename Fn>
+void classify_lines(std::string_view text,
+                    std::string_view index,
+                    std::uint32_t stride,
+                    std::uint64_t first,
+                    std::uint64_t last,
+                    Fn&& fn) {
+  LineCheckpoint c = find_checkpoint(index, stride, first);
+  if (c.offset > text.size())
+    return;
+  CodeParser parser;
+  parser.set_state(c.state);
+  std::uint64_t line_no = c.line;
+  std::string line;
+  // Lines are split here so the loop can stop at `last`; the rest of the file is not looked at.
+  const char* p = text.data() + c.offset;
+  const char* end = text.data() + text.size();
+  while (p < end and line_no < last) {
+    auto nl = static_cast<const char*>(std::memchr(p, '\n', static_cast<std::size_t>(end - p)));
+    const char* line_end = nl == nullptr ? end : nl;
+    line.assign(p, line_end);
+    line_category_e category = parser.parse_line(line);
+    if (line_no >= first)
+      fn(line_no, category);
+    ++line_no;
+    p = nl == nullptr ? end : nl + 1;
+  }
+}
+
+#endif
@@ -0,0 +1,273 @@
+#ifndef LINE_MAP_H
+#define LINE_MAP_H
+
+/*!
+ * @file line_map.h
+ * @description
+ * Per-line classification sidecar (`--emit-line-map`), for tools that need to know which lines
+ * of a file are code (e.g. to leave comments out of coverage denominators).
+ *
+ * Each line takes 2 bits, its line_category_e (0 blank, 1 code, 2 comment, 3 doc), four lines
+ * per byte starting from the low bits. The maps are filled during the normal parse, in the
+ * same pass that counts the lines.
+ *
+ * Layout (little endian, every section 8-byte aligned), meant to be mapped as is:
+ * - LineMapHeader
+ * - n_files LineMapEntry records, sorted by path, for binary search
+ * - string heap: the relative paths and the base directory
+ * - the bitmaps, each starting on an 8-byte boundary
+ *
+ * A run stopped early (see cancellation.h) still writes its maps, with LINE_MAP_FLAG_PARTIAL
+ * set: files it did not count are missing from the file, not known to have no code.
+ */
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <numeric>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include "code_parser.h"
+#include "file_info.h"
+#include "table_report.h"
+
+constexpr std::uint32_t LINE_MAP_VERSION = 2;
+/// Header flag: the run was stopped early; the maps are of the files it counted out of
+/// LineMapHeader::files_found.
+constexpr std::uint32_t LINE_MAP_FLAG_PARTIAL = 1;
+
+struct LineMapHeader {
+  char magic[8];  //!< "SLOCLMAP"
+  std::uint32_t version;
+  std::uint32_t base_dir_len;
+  std::uint64_t n_files;
+  std::uint64_t entries_offset;
+  std::uint64_t heap_offset;
+  std::uint64_t heap_size;
+  std::uint64_t bits_offset;
+  std::uint64_t base_dir_offset;  //!< Offset of the base directory in the string heap.
+  std::uint32_t flags;
+  std::uint32_t reserved;
+  std::uint64_t files_found;  //!< With LINE_MAP_FLAG_PARTIAL, # of files found; 0 otherwise.
+};
+
+struct LineMapEntry {
+  std::uint64_t path_offset;  //!< Offset of the path in the string heap.
+  std::uint32_t path_len;
+  std::uint32_t reserved;
+  std::uint64_t n_lines;
+  std::uint64_t bits_offset;  //!< Offset of the bitmap from LineMapHeader::bits_offset.
+};
+
+static_assert(sizeof(LineMapHeader) == 80, "unexpected padding in LineMapHeader");
+static_assert(sizeof(LineMapEntry) == 32, "unexpected padding in LineMapEntry");
+
+/**
+ * @brief Appends the category of the next line to a bitmap.
+ *
+ * @param map: The bitmap of the file so far.
+ * @param line_no: 0-based number of the line, i.e. # of lines already in `map`.
+ * @param category: What the parser counted the line as.
+ */
+inline void append_line_category(std::string& map, count_t line_no, line_category_e category) {
+  if (line_no % 4 == 0)
+    map += '\0';
+  map.back() = static_cast<char>(map.back() | category << (2 * (line_no % 4)));
+}
+
+/**
+ * @brief Writes the line maps of the files (FileInfo::line_map).
+ *
+ * @param filename: The file to write.
+ * @param files: The files of the run.
+ * @param base_dir: Paths are stored relative to this directory.
+ * @param error: Receives a description of the problem, if any.
+ * @param flags: Stored as is in the header.
+ * @param files_found: With LINE_MAP_FLAG_PARTIAL, # of files the run found.
+ * @return true if the file was written.
+ */
+inline bool write_line_map(const std::string& filename,
+                           const FileList& files,
+                           const std::string& base_dir,
+                           std::string& error,
+                           std::uint32_t flags = 0,
+                           std::uint64_t files_found = 0) {
+  auto pad8 = [](std::string& s) { s.resize((s.size() + 7) / 8 * 8, '\0'); };
+
+  std::vector<std::string> paths;
+  paths.reserve(files.size());
+  for (const auto& f : files) {
+    paths.push_back(relative_basename(f.filename, base_dir));
+  }
+  std::vector<std::size_t> order(files.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(),
+                   [&](std::size_t a, std::size_t b) { return paths[a] < paths[b]; });
+
+  std::vector<LineMapEntry> entries;
+  entries.reserve(files.size());
+  std::string heap;
+  std::uint64_t bits_size = 0;
+  for (std::size_t i : order) {
+    entries.push_back(LineMapEntry{ heap.size(), static_cast<std::uint32_t>(paths[i].size()), 0,
+                                    files[i].n_lines, bits_size });
+    heap += paths[i];
+    bits_size += (files[i].line_map.size() + 7) / 8 * 8;
+  }
+  if ((flags & LINE_MAP_FLAG_PARTIAL) == 0)
+    files_found = 0;
+  LineMapHeader header{ {}, LINE_MAP_VERSION, static_cast<std::uint32_t>(base_dir.size()),
+                        entries.size(), sizeof(LineMapHeader), 0, 0, 0, heap.size(), flags, 0,
+                        files_found };
+  std::memcpy(header.magic, "SLOCLMAP", 8);
+  heap += base_dir;
+  header.heap_offset = header.entries_offset + entries.size() * sizeof(LineMapEntry);
+  header.heap_size = heap.size();
+  pad8(heap);
+  header.bits_offset = header.heap_offset + heap.size();
+
+  std::ofstream out{ filename, std::ios::binary };
+  if (!out.is_open()) {
+    error = "could not open " + filename;
+    return false;
+  }
+  out.write(reinterpret_cast<const char*>(&header), sizeof header);
+  out.write(reinterpret_cast<const char*>(entries.data()),
+            static_cast<std::streamsize>(entries.size() * sizeof(LineMapEntry)));
+  out.write(heap.data(), static_cast<std::streamsize>(heap.size()));
+  static const char zeros[8] = {};
+  for (std::size_t i : order) {
+    const std::string& map = files[i].line_map;
+    out.write(map.data(), static_cast<std::streamsize>(map.size()));
+    out.write(zeros, static_cast<std::streamsize>((8 - map.size() % 8) % 8));
+  }
+  if (!out.flush()) {
+    error = "could not write " + filename;
+    return false;
+  }
+  return true;
+}
+
+/// Read-only view of a line map file, mapped in memory.
+class LineMapReader {
+public:
+  LineMapReader() = default;
+  LineMapReader(const LineMapReader&) = delete;
+  LineMapReader& operator=(const LineMapReader&) = delete;
+  ~LineMapReader() {
+    if (m_data != nullptr)
+      ::munmap(const_cast<char*>(m_data), m_size);
+  }
+
+  /**
+   * @brief Maps a file and checks its structure.
+   *
+   * @param filename: The line map file.
+   * @param error: Receives a description of the problem, if any.
+   * @return true if the file is a valid line map.
+   */
+  bool open(const std::string& filename, std::string& error) {
+    int fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      error = "could not open " + filename;
+      return false;
+    }
+    struct stat st {};
+    if (::fstat(fd, &st) != 0 or static_cast<std::size_t>(st.st_size) < sizeof(LineMapHeader)) {
+      ::close(fd);
+      error = filename + " is not a line map";
+      return false;
+    }
+    m_size = static_cast<std::size_t>(st.st_size);
+    void* p = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) {
+      error = "could not map " + filename;
+      return false;
+    }
+    m_data = static_cast<const char*>(p);
+    std::memcpy(&m_header, m_data, sizeof m_header);
+
+    // Written as subtractions: the sums of offsets and lengths read from the file can wrap.
+    auto within = [](std::uint64_t offset, std::uint64_t len, std::uint64_t size) {
+      return offset <= size and len <= size - offset;
+    };
+    auto fits = [&](std::uint64_t offset, std::uint64_t len) {
+      return within(offset, len, m_size) and offset % 8 == 0;
+    };
+    bool ok = std::memcmp(m_header.magic, "SLOCLMAP", 8) == 0
+              and m_header.version == LINE_MAP_VERSION
+              and m_header.n_files <= m_size / sizeof(LineMapEntry)
+              and fits(m_header.entries_offset, m_header.n_files * sizeof(LineMapEntry))
+              and fits(m_header.heap_offset, m_header.heap_size)
+              and within(m_header.base_dir_offset, m_header.base_dir_len, m_header.heap_size)
+              and fits(m_header.bits_offset, 0);
+    for (std::uint64_t i = 0; ok and i < m_header.n_files; ++i) {
+      const LineMapEntry& e = entry(i);
+      ok = within(e.path_offset, e.path_len, m_header.heap_size)
+           and e.bits_offset <= m_size - m_header.bits_offset
+           and e.n_lines <= 4 * (m_size - m_header.bits_offset - e.bits_offset);
+    }
+    if (!ok)
+      error = filename + " is not a valid line map";
+    return ok;
+  }
+
+  std::uint64_t size() const { return m_header.n_files; }
+
+  std::uint32_t flags() const { return m_header.flags; }
+
+  /// Whether the run was stopped before counting every file: files missing from the map may
+  /// exist.
+  bool partial() const { return (m_header.flags & LINE_MAP_FLAG_PARTIAL) != 0; }
+
+  /// # of files the run found, of which size() were counted; 0 unless partial().
+  std::uint64_t files_found() const { return m_header.files_found; }
+
+  const LineMapEntry& entry(std::uint64_t i) const {
+    return reinterpret_cast<const LineMapEntry*>(m_data + m_header.entries_offset)[i];
+  }
+
+  std::string_view path(std::uint64_t i) const {
+    return { m_data + m_header.heap_offset + entry(i).path_offset, entry(i).path_len };
+  }
+
+  std::string_view base_dir() const {
+    return { m_data + m_header.heap_offset + m_header.base_dir_offset, m_header.base_dir_len };
+  }
+
+  /// Index of the file with path `p`, or size() if there is none.
+  std::uint64_t find(std::string_view p) const {
+    std::uint64_t first = 0, count = size();
+    while (count > 0) {
+      std::uint64_t half = count / 2;
+      if (path(first + half) < p) {
+        first += half + 1;
+        count -= half + 1;
+      } else {
+        count = half;
+      }
+    }
+    return first < size() and path(first) == p ? first : size();
+  }
+
+  /// Category of 0-based line `line` of file `i`; the line must be below entry(i).n_lines.
+  line_category_e category(std::uint64_t i, std::uint64_t line) const {
+    auto byte = static_cast<unsigned char>(
+      m_data[m_header.bits_offset + entry(i).bits_offset + line / 4]);
+    return static_cast<line_category_e>((byte >> (2 * (line % 4))) & 3);
+  }
+
+private:
+  const char* m_data = nullptr;
+  std::size_t m_size = 0;
+  LineMapHeader m_header{};
+};
+
+#endif
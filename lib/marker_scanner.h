@@ -0,0 +1,179 @@
+#ifndef MARKER_SCANNER_H
+#define MARKER_SCANNER_H
+
+/*!
+ * @file marker_scanner.h
+ * @description
+ * Counts tech-debt markers (TODO, FIXME, ...) in comments (`--markers`): comment and doc
+ * lines, and the comments of code lines, such as `int x;  // TODO: check x`.
+ *
+ * All markers are looked for in a single pass. With SSE2, 16 positions are tested at once
+ * against the first and second bytes of every marker; only the positions matching both are
+ * compared with the markers in full. Without SSE2, or when there are too many distinct leading
+ * bytes for the vector filter to pay off, positions are filtered through a table of first bytes.
+ *
+ * A marker only counts as a whole word: "TODO:" and "TODO(bob)" match TODO, "TODOS" does not.
+ */
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
+
+#include "file_info.h"
+
+/// Counts the occurrences of a fixed set of markers in text.
+class MarkerScanner {
+public:
+  MarkerScanner() = default;
+
+  /// @param markers: The markers to count; empty ones are ignored.
+  explicit MarkerScanner(const std::vector<std::string>& markers) {
+    for (const auto& m : markers) {
+      if (!m.empty())
+        m_markers.push_back(m);
+    }
+    m_bucket.fill(0);
+    for (std::size_t k = 0; k < m_markers.size(); ++k) {
+      auto first = static_cast<unsigned char>(m_markers[k][0]);
+      if (m_bucket[first] == 0) {
+        m_buckets.emplace_back();
+        m_bucket[first] = static_cast<std::uint16_t>(m_buckets.size());
+      }
+      m_buckets[m_bucket[first] - 1].push_back(k);
+    }
+#ifdef __SSE2__
+    m_simd = !m_markers.empty();
+    for (const auto& m : m_markers) {
+      m_simd = m_simd and m.size() >= 2;
+    }
+    for (std::size_t byte = 0; m_simd and byte < 2; ++byte) {
+      std::string distinct;
+      for (const auto& m : m_markers) {
+        if (distinct.find(m[byte]) == std::string::npos)
+          distinct += m[byte];
+      }
+      m_simd = distinct.size() <= MAX_SIMD_BYTES;
+      for (std::size_t j = 0; m_simd and j < distinct.size(); ++j) {
+        (byte == 0 ? m_first : m_second)[j] = _mm_set1_epi8(distinct[j]);
+      }
+      (byte == 0 ? m_n_first : m_n_second) = distinct.size();
+    }
+#endif
+  }
+
+  const std::vector<std::string>& markers() const { return m_markers; }
+  bool empty() const { return m_markers.empty(); }
+
+  /**
+   * @brief Counts the markers found in `text`.
+   *
+   * @param text: A line (or any text) to scan.
+   * @param counts: Incremented once per occurrence; one entry per marker, in order.
+   */
+  void scan(std::string_view text, count_t* counts) const {
+    const char* p = text.data();
+    const std::size_t n = text.size();
+    std::size_t i = 0;
+#ifdef __SSE2__
+    if (m_simd) {
+      // Loads p[i + 1 .. i + 16] too, hence the extra byte.
+      for (; i + 17 <= n; i += 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i + 1));
+        __m128i first = _mm_setzero_si128();
+        __m128i second = _mm_setzero_si128();
+        for (std::size_t j = 0; j < m_n_first; ++j) {
+          first = _mm_or_si128(first, _mm_cmpeq_epi8(a, m_first[j]));
+        }
+        for (std::size_t j = 0; j < m_n_second; ++j) {
+          second = _mm_or_si128(second, _mm_cmpeq_epi8(b, m_second[j]));
+        }
+        auto mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_and_si128(first, second)));
+        while (mask != 0) {
+          verify(text, i + static_cast<std::size_t>(__builtin_ctz(mask)), counts);
+          mask &= mask - 1;
+        }
+      }
+    }
+#endif
+    for (; i < n; ++i) {
+      if (m_bucket[static_cast<unsigned char>(p[i])] != 0)
+        verify(text, i, counts);
+    }
+  }
+
+  /**
+   * @brief Counts the markers found in the comments of a code line, skipping the code and its
+   * string and character literals. A block comment left open runs to the end of the line (the
+   * parser counts the lines after it as code).
+   *
+   * @param line: A line the parser counted as code.
+   * @param counts: Incremented once per occurrence; one entry per marker, in order.
+   */
+  void scan_code(std::string_view line, count_t* counts) const {
+    char quote = 0;
+    for (std::size_t i = 0; i < line.size(); ++i) {
+      char c = line[i];
+      if (quote != 0) {
+        if (c == '\\')
+          ++i;
+        else if (c == quote)
+          quote = 0;
+      } else if (c == '"' or c == '\'') {
+        quote = c;
+      } else if (c == '/' and line.substr(i, 2) == "//") {
+        scan(line.substr(i + 2), counts);
+        return;
+      } else if (c == '/' and line.substr(i, 2) == "/*") {
+        std::size_t end = line.find("*/", i + 2);
+        scan(line.substr(i + 2, end == std::string_view::npos ? end : end - i - 2), counts);
+        if (end == std::string_view::npos)
+          return;
+        i = end + 1;
+      }
+    }
+  }
+
+private:
+  static bool is_word(char c) {
+    return (c >= 'a' and c <= 'z') or (c >= 'A' and c <= 'Z') or (c >= '0' and c <= '9')
+           or c == '_';
+  }
+
+  /// Counts the markers that occur at `pos` as whole words.
+  void verify(std::string_view text, std::size_t pos, count_t* counts) const {
+    std::uint16_t b = m_bucket[static_cast<unsigned char>(text[pos])];
+    if (b == 0)
+      return;
+    for (std::size_t k : m_buckets[b - 1]) {
+      const std::string& m = m_markers[k];
+      if (text.compare(pos, m.size(), m) != 0)
+        continue;
+      bool starts_word = pos == 0 or !is_word(m.front()) or !is_word(text[pos - 1]);
+      std::size_t end = pos + m.size();
+      bool ends_word = end == text.size() or !is_word(m.back()) or !is_word(text[end]);
+      if (starts_word and ends_word)
+        counts[k]++;
+    }
+  }
+
+  std::vector<std::string> m_markers;
+  std::array<std::uint16_t, 256> m_bucket{};        //!< First byte -> 1 + index in m_buckets.
+  std::vector<std::vector<std::size_t>> m_buckets;  //!< Markers sharing a first byte.
+#ifdef __SSE2__
+  /// Above this many distinct first (or second) bytes the scalar filter is used.
+  static constexpr std::size_t MAX_SIMD_BYTES = 8;
+  bool m_simd = false;
+  __m128i m_first[MAX_SIMD_BYTES];   //!< Distinct first bytes of the markers, broadcast.
+  __m128i m_second[MAX_SIMD_BYTES];  //!< Distinct second bytes of the markers, broadcast.
+  std::size_t m_n_first = 0;
+  std::size_t m_n_second = 0;
+#endif
+};
+
+#endif
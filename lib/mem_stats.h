@@ -0,0 +1,140 @@
+#ifndef MEM_STATS_H
+#define MEM_STATS_H
+
+/*!
+ * @file mem_stats.h
+ * @description
+ * Lightweight memory accounting by subsystem, reported with `--stats`.
+ *
+ * Every allocation is charged to the subsystem tag of the calling thread, set with a MemScope.
+ * Containers that should always be charged to the same subsystem, whatever the caller, use a
+ * TaggedAllocator. The sloc executable replaces the global operator new/delete so the counters
+ * see every allocation (see main.cpp); memory that does not come from operator new, like mapped
+ * files, is charged with mem_charge()/mem_release().
+ */
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+/// The subsystems memory is charged to.
+enum class mem_tag_e : std::uint8_t {
+  OTHER = 0,  //!< Anything outside a MemScope.
+  TRAVERSAL,  //!< Directory walk temporaries.
+  FILE_LIST,  //!< Storage of the FileList vector.
+  PATHS,      //!< Filenames kept in FileInfo.
+  PARSE,      //!< Read buffers, mapped files and parser temporaries.
+  OUTPUT,     //!< Table formatting and output streams.
+  INTERN,     //!< Identifiers interned for --halstead.
+  N_TAGS,
+};
+
+/// Name of a subsystem, as printed by --stats.
+inline const char* mem_tag_to_string(mem_tag_e tag) {
+  switch (tag) {
+  case mem_tag_e::OTHER:
+    return "other";
+  case mem_tag_e::TRAVERSAL:
+    return "traversal";
+  case mem_tag_e::FILE_LIST:
+    return "file list";
+  case mem_tag_e::PATHS:
+    return "path strings";
+  case mem_tag_e::PARSE:
+    return "parse buffers";
+  case mem_tag_e::OUTPUT:
+    return "output";
+  case mem_tag_e::INTERN:
+    return "identifiers";
+  default:
+    return "invalid";
+  }
+}
+
+/// Counters of one subsystem. Aligned to a cache line so threads charging different
+/// subsystems do not share one.
+struct alignas(64) MemCounters {
+  std::atomic<std::size_t> current{ 0 };      //!< Bytes currently allocated.
+  std::atomic<std::size_t> peak{ 0 };         //!< Highest value of `current`.
+  std::atomic<std::size_t> total{ 0 };        //!< Bytes allocated over the whole run.
+  std::atomic<std::size_t> allocations{ 0 };  //!< # of allocations over the whole run.
+};
+
+/// Counters of every subsystem.
+inline std::array<MemCounters, static_cast<std::size_t>(mem_tag_e::N_TAGS)>& mem_counters() {
+  static std::array<MemCounters, static_cast<std::size_t>(mem_tag_e::N_TAGS)> counters;
+  return counters;
+}
+
+/// Accounting is off until --stats turns it on, so normal runs only pay for a flag check.
+inline std::atomic<bool>& mem_stats_enabled() {
+  static std::atomic<bool> enabled{ false };
+  return enabled;
+}
+
+/// Subsystem the calling thread is currently working for.
+inline mem_tag_e& current_mem_tag() {
+  thread_local mem_tag_e tag = mem_tag_e::OTHER;
+  return tag;
+}
+
+/// Charges `bytes` to `tag`.
+inline void mem_charge(mem_tag_e tag, std::size_t bytes) {
+  auto& c = mem_counters()[static_cast<std::size_t>(tag)];
+  std::size_t now = c.current.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+  c.total.fetch_add(bytes, std::memory_order_relaxed);
+  c.allocations.fetch_add(1, std::memory_order_relaxed);
+  std::size_t peak = c.peak.load(std::memory_order_relaxed);
+  while (now > peak and !c.peak.compare_exchange_weak(peak, now, std::memory_order_relaxed)) {
+  }
+}
+
+/// Gives back `bytes` previously charged to `tag`.
+inline void mem_release(mem_tag_e tag, std::size_t bytes) {
+  mem_counters()[static_cast<std::size_t>(tag)].current.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+/// Sets the subsystem of the calling thread for the lifetime of the object.
+class MemScope {
+public:
+  explicit MemScope(mem_tag_e tag) : m_saved{ current_mem_tag() } { current_mem_tag() = tag; }
+  MemScope(const MemScope&) = delete;
+  MemScope& operator=(const MemScope&) = delete;
+  ~MemScope() { current_mem_tag() = m_saved; }
+
+private:
+  mem_tag_e m_saved;
+};
+
+/// Allocator charging a container's storage to `Tag`, whichever scope it grows in.
+template <typename T, mem_tag_e Tag>
+struct TaggedAllocator {
+  using value_type = T;
+
+  template <typename U>
+  struct rebind {
+    using other = TaggedAllocator<U, Tag>;
+  };
+
+  TaggedAllocator() = default;
+  template <typename U>
+  TaggedAllocator(const TaggedAllocator<U, Tag>&) {}
+
+  T* allocate(std::size_t n) {
+    MemScope scope{ Tag };
+    return static_cast<T*>(::operator new(n * sizeof(T)));
+  }
+  void deallocate(T* p, std::size_t) { ::operator delete(p); }
+
+  template <typename U>
+  bool operator==(const TaggedAllocator<U, Tag>&) const {
+    return true;
+  }
+  template <typename U>
+  bool operator!=(const TaggedAllocator<U, Tag>&) const {
+    return false;
+  }
+};
+
+#endif
@@ -0,0 +1,256 @@
+#ifndef PATCH_COUNTER_H
+#define PATCH_COUNTER_H
+
+/*!
+ * @file patch_counter.h
+ * @description
+ * Classifies the added and removed lines of a unified diff (`sloc --patch`).
+ *
+ * Whether a line is a comment depends on the lines before it, so each hunk has to be parsed
+ * starting from the parser state at its first line, in the old file for '-' lines and in the new
+ * one for '+' lines. The new file is read from the working tree. Its unchanged lines are the same
+ * in both versions, so one walk over it gives both states: the lines between hunks go to the old
+ * and the new parser alike, context lines too, and '-'/'+' lines only to their side.
+ *
+ * The parser state only changes on lines holding a '/', so between hunks only those lines are
+ * parsed; the others are skipped with a memchr. Only the +/- lines are classified and counted.
+ *
+ * If the new file cannot be read, or its lines do not match the context of the diff (the patch
+ * is not applied), the hunks are parsed from the state the previous hunk left, and the file is
+ * flagged as approximate. Added and deleted files are always exact: the diff holds all of them.
+ */
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "code_parser.h"
+#include "file_buffer.h"
+#include "file_info.h"
+
+/// Lines added and removed in one file by a patch.
+struct PatchFile {
+  std::string filename;  //!< The new path (the old one for a deleted file), stripped.
+  lang_type_e type = UNDEF;
+  ProfileCounts added;
+  ProfileCounts removed;
+  bool exact = true;  //!< false if the parser state at the hunks had to be guessed.
+};
+
+/// Reads a unified diff, line by line, and counts the lines it adds and removes.
+class PatchCounter {
+public:
+  /// Gives the language of a path, or nothing if it is not counted.
+  using LangFn = std::function<std::optional<lang_type_e>(const std::string&)>;
+
+  /**
+   * @brief Ctro.
+   *
+   * @param root: The directory the paths of the diff are relative to.
+   * @param strip: # of leading path components to drop from them, as in `patch -p`.
+   * @param lang: Gives the language of a file; files without one are skipped.
+   */
+  PatchCounter(std::string root, unsigned strip, LangFn lang)
+      : m_root{ std::move(root) }, m_strip{ strip }, m_lang{ std::move(lang) } {}
+
+  /**
+   * @brief Feeds the next line of the diff, without its newline.
+   *
+   * @param line: The line.
+   * @return false if a hunk header is malformed.
+   */
+  bool add(std::string_view line) {
+    if (m_old_left > 0 or m_new_left > 0) {
+      hunk_line(line);
+      return true;
+    }
+    if (starts_with(line, "diff ")) {
+      end_file();
+    } else if (starts_with(line, "--- ")) {
+      end_file();
+      m_old_path = path_of(line.substr(4));
+    } else if (starts_with(line, "+++ ")) {
+      begin_file(path_of(line.substr(4)));
+    } else if (starts_with(line, "@@ ")) {
+      return begin_hunk(line);
+    }
+    return true;
+  }
+
+  /// Ends the last file; call once the diff is over.
+  void finish() { end_file(); }
+
+  /// The files the diff touches, in order, skipping those of unknown languages.
+  const std::vector<PatchFile>& files() const { return m_files; }
+
+private:
+  static bool starts_with(std::string_view s, std::string_view prefix) {
+    return s.substr(0, prefix.size()) == prefix;
+  }
+
+  /// The path of a ---/+++ line, without its timestamp and leading components; empty for
+  /// /dev/null.
+  std::string path_of(std::string_view s) const {
+    s = s.substr(0, s.find('\t'));
+    if (s == "/dev/null")
+      return {};
+    for (unsigned i = 0; i < m_strip; ++i) {
+      std::size_t slash = s.find('/');
+      if (slash == std::string_view::npos)
+        break;
+      s.remove_prefix(slash + 1);
+    }
+    return std::string{ s };
+  }
+
+  void begin_file(std::string new_path) {
+    const std::string& path = new_path.empty() ? m_old_path : new_path;
+    auto type = path.empty() ? std::nullopt : m_lang(path);
+    m_active = type.has_value();
+    if (!m_active)
+      return;
+    PatchFile file;
+    file.filename = path;
+    file.type = type.value();
+    m_files.push_back(file);
+    m_old = CodeParser{};
+    m_new = CodeParser{};
+    m_line = 1;
+    m_pos = 0;
+    // An added file is all in the diff; otherwise the new file comes from the working tree.
+    m_have_buffer = !new_path.empty() and !m_old_path.empty()
+                    and m_buffer.load(m_root + '/' + new_path);
+    if (!new_path.empty() and !m_old_path.empty() and !m_have_buffer)
+      m_files.back().exact = false;
+  }
+
+  void end_file() {
+    m_active = false;
+    m_have_buffer = false;
+    m_old_path.clear();
+  }
+
+  /// Parses "@@ -a[,b] +c[,d] @@" and brings the parsers to the first line of the hunk.
+  bool begin_hunk(std::string_view line) {
+    std::string header{ line };
+    char* p = &header[3];
+    if (*p++ != '-')
+      return false;
+    std::strtoul(p, &p, 10);
+    m_old_left = *p == ',' ? std::strtoul(p + 1, &p, 10) : 1;
+    if (*p++ != ' ' or *p++ != '+')
+      return false;
+    count_t new_start = std::strtoul(p, &p, 10);
+    m_new_left = *p == ',' ? std::strtoul(p + 1, &p, 10) : 1;
+    if (*p != ' ')
+      return false;
+    // "+c,0" (nothing added) points at the line before the hunk.
+    if (m_active and m_have_buffer)
+      skip_to(m_new_left == 0 ? new_start + 1 : new_start);
+    return true;
+  }
+
+  /// Walks the new file up to line `target`, feeding the lines that can change the state.
+  void skip_to(count_t target) {
+    const char* data = m_buffer.view().data();
+    const std::size_t size = m_buffer.view().size();
+    while (m_line < target and m_pos < size) {
+      std::string_view l = next_line(data, size);
+      if (std::memchr(l.data(), '/', l.size()) != nullptr) {
+        m_scratch.assign(l);
+        m_old.parse_line(m_scratch);
+        m_new.parse_line(m_scratch);
+      }
+    }
+  }
+
+  /// The line of the new file at m_pos, moving past it.
+  std::string_view next_line(const char* data, std::size_t size) {
+    auto nl = static_cast<const char*>(std::memchr(data + m_pos, '\n', size - m_pos));
+    std::size_t end = nl == nullptr ? size : static_cast<std::size_t>(nl - data);
+    std::string_view l{ data + m_pos, end - m_pos };
+    m_pos = nl == nullptr ? size : end + 1;
+    m_line++;
+    return l;
+  }
+
+  /// Checks that the working tree has `text` as the next line of the new file.
+  void match_new_line(std::string_view text) {
+    if (!m_have_buffer)
+      return;
+    std::string_view view = m_buffer.view();
+    if (m_pos >= view.size() or next_line(view.data(), view.size()) != text) {
+      // The tree does not hold this version: go on from the state of the previous hunk.
+      m_have_buffer = false;
+      m_files.back().exact = false;
+    }
+  }
+
+  static void count(ProfileCounts& counts, line_category_e category) {
+    switch (category) {
+    case LINE_BLANK:
+      counts.n_blank++;
+      break;
+    case LINE_CODE:
+      counts.n_loc++;
+      break;
+    case LINE_COMMENT:
+      counts.n_comments++;
+      break;
+    case LINE_DOC:
+      counts.n_doc++;
+      break;
+    }
+  }
+
+  void hunk_line(std::string_view line) {
+    // Some tools strip the space of empty context lines.
+    char tag = line.empty() ? ' ' : line[0];
+    std::string_view text = line.empty() ? line : line.substr(1);
+    if (tag == '\\')  // "\ No newline at end of file"
+      return;
+    if (tag == '-') {
+      m_old_left -= m_old_left > 0 ? 1 : 0;
+    } else if (tag == '+') {
+      m_new_left -= m_new_left > 0 ? 1 : 0;
+    } else {
+      m_old_left -= m_old_left > 0 ? 1 : 0;
+      m_new_left -= m_new_left > 0 ? 1 : 0;
+    }
+    if (!m_active)
+      return;
+    m_scratch.assign(text);
+    if (tag == '-') {
+      count(m_files.back().removed, m_old.parse_line(m_scratch));
+    } else if (tag == '+') {
+      count(m_files.back().added, m_new.parse_line(m_scratch));
+      match_new_line(text);
+    } else {
+      m_old.parse_line(m_scratch);
+      m_new.parse_line(m_scratch);
+      match_new_line(text);
+    }
+  }
+
+  std::string m_root;
+  unsigned m_strip;
+  LangFn m_lang;
+  std::vector<PatchFile> m_files;
+
+  std::string m_old_path;     //!< Stripped old path of the file being read; empty for /dev/null.
+  bool m_active = false;      //!< The current file is counted.
+  count_t m_old_left = 0;     //!< Old lines left in the current hunk.
+  count_t m_new_left = 0;     //!< New lines left in the current hunk.
+  CodeParser m_old;           //!< Parser state in the old file.
+  CodeParser m_new;           //!< Parser state in the new file.
+  FileBuffer m_buffer;        //!< The new file, from the working tree.
+  bool m_have_buffer = false;
+  count_t m_line = 1;         //!< Line of the new file at m_pos.
+  std::size_t m_pos = 0;      //!< Offset in m_buffer of the next line of the new file.
+  std::string m_scratch;
+};
+
+#endif
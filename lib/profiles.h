@@ -0,0 +1,176 @@
+#ifndef PROFILES_H
+#define PROFILES_H
+
+/*!
+ * @file profiles.h
+ * @description
+ * Classification profiles (`--profile a,b,c`): several definitions of what counts as code,
+ * comment or documentation, all evaluated in the same read of each file.
+ *
+ * The parser classifies each line once; every profile then maps that classification through its
+ * own rules, so adding profiles costs a few comparisons per line, not another read or parse.
+ *
+ * A profile is a '+'-separated list of rules:
+ * - default         the classification of the main table;
+ * - no-braces       lines made only of braces, parentheses, ';' and ',' are blank, not code;
+ * - doc-as-comment  documentation lines are counted as comments;
+ * - no-license      license header lines (see license_headers.h) are not counted at all.
+ */
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+#include "code_parser.h"
+#include "file_info.h"
+#include "license_headers.h"
+
+/// Rules of one profile.
+struct ProfileRules {
+  std::string name;
+  bool braces_are_code = true;   //!< Brace-only lines count as code.
+  bool doc_is_comment = false;   //!< Doc lines count as comments.
+  bool count_license = true;     //!< License header lines are counted.
+};
+
+/**
+ * @brief Parses the argument of --profile.
+ *
+ * @param list: Comma-separated profiles, each a '+'-separated list of rules.
+ * @param profiles: Receives the profiles, in order.
+ * @return false if a rule is unknown.
+ */
+inline bool parse_profiles(const std::string& list, std::vector<ProfileRules>& profiles) {
+  std::istringstream in{ list };
+  for (std::string name; std::getline(in, name, ',');) {
+    if (name.empty())
+      continue;
+    ProfileRules rules;
+    rules.name = name;
+    std::istringstream parts{ name };
+    for (std::string rule; std::getline(parts, rule, '+');) {
+      if (rule == "no-braces") {
+        rules.braces_are_code = false;
+      } else if (rule == "doc-as-comment") {
+        rules.doc_is_comment = true;
+      } else if (rule == "no-license") {
+        rules.count_license = false;
+      } else if (rule != "default") {
+        return false;
+      }
+    }
+    profiles.push_back(rules);
+  }
+  return !profiles.empty();
+}
+
+/// Whether `line` holds nothing but braces, parentheses, ';' and ',' (e.g. "}", "});").
+inline bool is_brace_only(std::string_view line) {
+  bool any = false;
+  for (char c : line) {
+    switch (c) {
+    case '{':
+    case '}':
+    case '(':
+    case ')':
+    case ';':
+    case ',':
+      any = true;
+      break;
+    case ' ':
+    case '\t':
+    case '\r':
+    case '\f':
+    case '\v':
+      break;
+    default:
+      return false;
+    }
+  }
+  return any;
+}
+
+/// Counts lines under every profile, from the category the parser gave them.
+class ProfileCounter {
+public:
+  explicit ProfileCounter(const std::vector<ProfileRules>& profiles) : m_profiles{ profiles } {
+    for (const auto& p : m_profiles) {
+      m_check_braces = m_check_braces or !p.braces_are_code;
+    }
+  }
+
+  bool empty() const { return m_profiles.empty(); }
+
+  /**
+   * @brief Counts one line.
+   *
+   * @param counts: The counters of the file, one per profile.
+   * @param line: The line.
+   * @param category: What the parser counted it as.
+   */
+  void add(ProfileCounts* counts, std::string_view line, line_category_e category) const {
+    bool brace_only = category == LINE_CODE and m_check_braces and is_brace_only(line);
+    for (std::size_t k = 0; k < m_profiles.size(); ++k) {
+      const ProfileRules& p = m_profiles[k];
+      ProfileCounts& c = counts[k];
+      switch (category) {
+      case LINE_BLANK:
+        c.n_blank++;
+        break;
+      case LINE_CODE:
+        (brace_only and !p.braces_are_code ? c.n_blank : c.n_loc)++;
+        break;
+      case LINE_COMMENT:
+        c.n_comments++;
+        break;
+      case LINE_DOC:
+        (p.doc_is_comment ? c.n_comments : c.n_doc)++;
+        break;
+      }
+    }
+  }
+
+  /**
+   * @brief Takes the license header lines out of the profiles that do not count them.
+   *
+   * @param files: The files of the run, counted with these profiles.
+   * @param headers: The fingerprint of each file, in the same order.
+   * @param licenses: The license headers, see learn_license_headers().
+   */
+  void drop_licenses(FileList& files,
+                     const std::vector<HeaderFingerprint>& headers,
+                     const std::unordered_set<std::uint64_t>& licenses) const {
+    for (std::size_t i = 0; i < files.size() and i < headers.size(); ++i) {
+      const HeaderFingerprint& h = headers[i];
+      if (h.hash == 0 or licenses.count(h.hash) == 0)
+        continue;
+      for (std::size_t k = 0; k < m_profiles.size() and k < files[i].profiles.size(); ++k) {
+        ProfileCounts& c = files[i].profiles[k];
+        if (m_profiles[k].count_license)
+          continue;
+        if (m_profiles[k].doc_is_comment) {
+          c.n_comments -= h.n_comments + h.n_doc;
+        } else {
+          c.n_comments -= h.n_comments;
+          c.n_doc -= h.n_doc;
+        }
+      }
+    }
+  }
+
+  /// Whether a profile needs the license headers of the run.
+  bool needs_licenses() const {
+    for (const auto& p : m_profiles) {
+      if (!p.count_license)
+        return true;
+    }
+    return false;
+  }
+
+private:
+  std::vector<ProfileRules> m_profiles;
+  bool m_check_braces = false;  //!< Some profile does not count brace-only lines as code.
+};
+
+#endif
@@ -0,0 +1,137 @@
+#ifndef PROGRESS_H
+#define PROGRESS_H
+
+/*!
+ * @file progress.h
+ * @description
+ * Live progress line on stderr (`--progress`): files found by the walk, files counted, read
+ * throughput and an estimate of the time left.
+ *
+ * The walk and the workers only bump relaxed atomic counters, once per file; a timer thread
+ * samples them and does all the formatting and writing. Nobody takes a lock or does I/O on
+ * behalf of the progress line. The counters live in their own cache lines, so the workers do
+ * not fight over the line the walk writes to.
+ *
+ * On a terminal the line is redrawn in place a few times per second; otherwise (a CI log) a
+ * full line is written every LOG_PERIOD.
+ */
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <unistd.h>
+
+/// Counters fed by the walk and the workers.
+struct ProgressCounters {
+  alignas(64) std::atomic<std::uint64_t> discovered{ 0 };  //!< Files found so far.
+  alignas(64) std::atomic<std::uint64_t> counted{ 0 };     //!< Files counted.
+  std::atomic<std::uint64_t> bytes{ 0 };                   //!< Bytes of the files counted.
+  /// When the walk ended and the counting began, in steady_clock ns; 0 while walking.
+  std::atomic<std::int64_t> counting_since{ 0 };
+};
+
+/// Counters of the run; bumping them is cheap enough to do unconditionally.
+inline ProgressCounters& progress_counters() {
+  static ProgressCounters counters;
+  return counters;
+}
+
+/// Marks the end of the walk: from now on, the files are being counted.
+inline void progress_begin_counting() {
+  progress_counters().counting_since.store(
+    std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch())
+      .count(),
+    std::memory_order_relaxed);
+}
+
+/// Timer thread that draws the progress line, from start() until stop().
+class ProgressReporter {
+public:
+  /// Time between two redraws on a terminal.
+  static constexpr std::chrono::milliseconds TTY_PERIOD{ 250 };
+  /// Time between two lines when stderr is not a terminal.
+  static constexpr std::chrono::seconds LOG_PERIOD{ 10 };
+
+  ProgressReporter() = default;
+  ProgressReporter(const ProgressReporter&) = delete;
+  ProgressReporter& operator=(const ProgressReporter&) = delete;
+  ~ProgressReporter() { stop(); }
+
+  void start() {
+    m_tty = ::isatty(STDERR_FILENO) != 0;
+    m_start = Clock::now();
+    m_thread = std::thread{ [this] { run(); } };
+  }
+
+  /// Draws the last state and ends the line.
+  void stop() {
+    if (!m_thread.joinable())
+      return;
+    {
+      std::lock_guard<std::mutex> lock{ m_mutex };
+      m_stop = true;
+    }
+    m_wake.notify_one();
+    m_thread.join();
+    draw();
+    std::fputc('\n', stderr);
+    std::fflush(stderr);
+  }
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  void run() {
+    std::unique_lock<std::mutex> lock{ m_mutex };
+    while (!m_wake.wait_for(lock, m_tty ? std::chrono::milliseconds{ TTY_PERIOD } : LOG_PERIOD,
+                            [this] { return m_stop; })) {
+      draw();
+      if (!m_tty)
+        std::fputc('\n', stderr);
+      std::fflush(stderr);
+    }
+  }
+
+  void draw() {
+    const ProgressCounters& c = progress_counters();
+    const std::uint64_t discovered = c.discovered.load(std::memory_order_relaxed);
+    const auto now = Clock::now();
+    const double elapsed = std::chrono::duration<double>(now - m_start).count();
+    if (m_tty)
+      std::fputs("\r\033[K", stderr);
+    const std::int64_t since = c.counting_since.load(std::memory_order_relaxed);
+    if (since == 0) {
+      std::fprintf(stderr, "[sloc] %.0fs walking: %llu files found", elapsed,
+                   static_cast<unsigned long long>(discovered));
+      return;
+    }
+    const std::uint64_t counted = c.counted.load(std::memory_order_relaxed);
+    const std::uint64_t bytes = c.bytes.load(std::memory_order_relaxed);
+    const double counting =
+      std::chrono::duration<double>(now - Clock::time_point{ std::chrono::nanoseconds{ since } })
+        .count();
+    std::fprintf(stderr, "[sloc] %.0fs %llu/%llu files (%.1f%%)", elapsed,
+                 static_cast<unsigned long long>(counted),
+                 static_cast<unsigned long long>(discovered),
+                 discovered == 0 ? 100.0 : 100.0 * counted / discovered);
+    if (counting > 0 and counted > 0) {
+      const double files_per_s = counted / counting;
+      const double eta = (discovered - counted) / files_per_s;
+      std::fprintf(stderr, ", %.1f MiB/s, ETA %u:%02u", bytes / counting / (1 << 20),
+                   static_cast<unsigned>(eta) / 60, static_cast<unsigned>(eta) % 60);
+    }
+  }
+
+  bool m_tty = false;
+  Clock::time_point m_start;
+  std::thread m_thread;
+  std::mutex m_mutex;
+  std::condition_variable m_wake;
+  bool m_stop = false;
+};
+
+#endif
@@ -0,0 +1,391 @@
+#ifndef SLOCBIN_H
+#define SLOCBIN_H
+
+/*!
+ * @file slocbin.h
+ * @description
+ * Indexed binary result file (`--format slocbin`), answered offline by `sloc query`.
+ *
+ * Layout (little endian, every section 8-byte aligned):
+ * - SlocbinHeader
+ * - n_rows SlocbinRow records, in output order
+ * - string heap: the relative paths and the base directory
+ * - one uint32 permutation of the rows per sort criterion (f, t, c, d, b, s, a), ascending
+ * - with SLOCBIN_FLAG_LINE_INDEX only: the parser checkpoints of each file (see line_index.h),
+ *   as one {offset, size, file size, file content_hash()} uint64 entry per row into a blob,
+ *   then the blob, then a SlocbinLineIndexTrailer right before the footer (readers that ignore
+ *   the flag never look at this section)
+ * - SlocbinFooter, at the very end of the file
+ *
+ * The permutation by filename doubles as the path -> row lookup: paths are found, and path
+ * prefixes turned into a contiguous range of rows, by binary search over it.
+ */
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <numeric>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include "file_info.h"
+#include "line_index.h"
+#include "table_report.h"
+
+/// Sort criteria with a stored permutation, in the order they appear in the footer.
+constexpr char SLOCBIN_CRITERIA[] = "ftcdbsa";
+constexpr std::size_t SLOCBIN_N_CRITERIA = sizeof(SLOCBIN_CRITERIA) - 1;
+constexpr std::uint32_t SLOCBIN_VERSION = 2;
+/// Header flag: the file has a line index section.
+constexpr std::uint32_t SLOCBIN_FLAG_LINE_INDEX = 1;
+/// Header flag: the run was stopped early (see cancellation.h); the rows are the files it
+/// counted out of SlocbinHeader::files_found.
+constexpr std::uint32_t SLOCBIN_FLAG_PARTIAL = 2;
+
+struct SlocbinHeader {
+  char magic[8];  //!< "SLOCBIN\0"
+  std::uint32_t version;
+  std::uint32_t flags;
+  std::uint64_t n_rows;
+  std::uint64_t base_dir_offset;  //!< Offset of the base directory in the string heap.
+  std::uint32_t base_dir_len;
+  std::uint32_t files_found;  //!< With SLOCBIN_FLAG_PARTIAL, # of files found; 0 otherwise.
+};
+
+struct SlocbinRow {
+  std::uint64_t path_offset;  //!< Offset of the path in the string heap.
+  std::uint32_t path_len;
+  std::uint8_t type;  //!< lang_type_e
+  std::uint8_t pad[3];
+  std::uint64_t n_blank;
+  std::uint64_t n_comments;
+  std::uint64_t n_doc;
+  std::uint64_t n_loc;
+  std::uint64_t n_lines;
+};
+
+struct SlocbinFooter {
+  std::uint64_t rows_offset;
+  std::uint64_t heap_offset;
+  std::uint64_t heap_size;
+  std::uint64_t index_offset[SLOCBIN_N_CRITERIA];  //!< One permutation per criterion.
+  char magic[8];                                   //!< "SLOCIDX\0"
+};
+
+/// Locates the line index section; written right before the footer.
+struct SlocbinLineIndexTrailer {
+  std::uint64_t table_offset;  //!< n_rows {offset, size, file size, file hash} entries.
+  std::uint64_t blob_offset;
+  std::uint64_t blob_size;
+  std::uint32_t stride;  //!< # of lines between two checkpoints.
+  std::uint32_t reserved;
+  char magic[8];  //!< "SLOCLIX\0"
+};
+
+static_assert(sizeof(SlocbinHeader) == 40, "unexpected padding in SlocbinHeader");
+static_assert(sizeof(SlocbinRow) == 56, "unexpected padding in SlocbinRow");
+static_assert(sizeof(SlocbinFooter) == 24 + 8 * SLOCBIN_N_CRITERIA + 8,
+              "unexpected padding in SlocbinFooter");
+static_assert(sizeof(SlocbinLineIndexTrailer) == 40,
+              "unexpected padding in SlocbinLineIndexTrailer");
+
+/**
+ * @brief Value of a row for a sort criterion other than 'f'.
+ *
+ * @param row: The row.
+ * @param criterion: One of t, c, d, b, s, a.
+ */
+inline std::uint64_t slocbin_key(const SlocbinRow& row, char criterion) {
+  switch (criterion) {
+  case 't':
+    return row.type;
+  case 'c':
+    return row.n_comments;
+  case 'd':
+    return row.n_doc;
+  case 'b':
+    return row.n_blank;
+  case 's':
+    return row.n_loc;
+  case 'a':
+    return row.n_lines;
+  default:
+    return 0;
+  }
+}
+
+/**
+ * @brief Writes the files, with their sort indexes, in the slocbin format.
+ *
+ * @param out: The (binary) stream to write to.
+ * @param files: The files, in output order.
+ * @param base_dir: Paths are stored relative to this directory.
+ * @param flags: Stored as is in the header.
+ * @param line_index_stride: If not 0, FileInfo::line_index of each file is stored too, and
+ * SLOCBIN_FLAG_LINE_INDEX set.
+ * @param files_found: With SLOCBIN_FLAG_PARTIAL, # of files the run found.
+ */
+inline void write_slocbin(std::ostream& out,
+                          const FileList& files,
+                          const std::string& base_dir,
+                          std::uint32_t flags = 0,
+                          std::uint32_t line_index_stride = 0,
+                          std::size_t files_found = 0) {
+  if (line_index_stride != 0)
+    flags |= SLOCBIN_FLAG_LINE_INDEX;
+  auto pad8 = [](std::string& s) { s.resize((s.size() + 7) / 8 * 8, '\0'); };
+
+  std::vector<SlocbinRow> rows(files.size());
+  std::string heap;
+  for (std::size_t i = 0; i < files.size(); ++i) {
+    const FileInfo& f = files[i];
+    std::string path = relative_basename(f.filename, base_dir);
+    rows[i] = SlocbinRow{ heap.size(), static_cast<std::uint32_t>(path.size()),
+                          static_cast<std::uint8_t>(f.type), {},
+                          f.n_blank, all_comment_lines(f), all_doc_lines(f), f.n_loc,
+                          f.n_lines };
+    heap += path;
+  }
+  if ((flags & SLOCBIN_FLAG_PARTIAL) == 0)
+    files_found = 0;
+  SlocbinHeader header{ "SLOCBIN", SLOCBIN_VERSION, flags, rows.size(), heap.size(),
+                        static_cast<std::uint32_t>(base_dir.size()),
+                        static_cast<std::uint32_t>(
+                          std::min<std::size_t>(files_found, UINT32_MAX)) };
+  heap += base_dir;
+  std::size_t heap_size = heap.size();
+  pad8(heap);
+
+  SlocbinFooter footer{};
+  footer.rows_offset = sizeof(SlocbinHeader);
+  footer.heap_offset = footer.rows_offset + rows.size() * sizeof(SlocbinRow);
+  footer.heap_size = heap_size;
+  std::memcpy(footer.magic, "SLOCIDX", 8);
+
+  out.write(reinterpret_cast<const char*>(&header), sizeof header);
+  out.write(reinterpret_cast<const char*>(rows.data()),
+            static_cast<std::streamsize>(rows.size() * sizeof(SlocbinRow)));
+  out.write(heap.data(), static_cast<std::streamsize>(heap.size()));
+
+  std::uint64_t offset = footer.heap_offset + heap.size();
+  std::vector<std::uint32_t> perm(rows.size());
+  for (std::size_t c = 0; c < SLOCBIN_N_CRITERIA; ++c) {
+    char criterion = SLOCBIN_CRITERIA[c];
+    std::iota(perm.begin(), perm.end(), 0);
+    if (criterion == 'f') {
+      auto path = [&](std::uint32_t r) {
+        return std::string_view{ heap.data() + rows[r].path_offset, rows[r].path_len };
+      };
+      std::stable_sort(perm.begin(), perm.end(), [&](std::uint32_t a, std::uint32_t b) {
+        return path(a) < path(b);
+      });
+    } else {
+      std::stable_sort(perm.begin(), perm.end(), [&](std::uint32_t a, std::uint32_t b) {
+        return slocbin_key(rows[a], criterion) < slocbin_key(rows[b], criterion);
+      });
+    }
+    footer.index_offset[c] = offset;
+    std::size_t bytes = perm.size() * sizeof(std::uint32_t);
+    out.write(reinterpret_cast<const char*>(perm.data()), static_cast<std::streamsize>(bytes));
+    if (bytes % 8 != 0) {
+      out.write("\0\0\0\0", 4);
+      bytes += 4;
+    }
+    offset += bytes;
+  }
+  if (line_index_stride != 0) {
+    std::vector<std::uint64_t> table;
+    std::string blob;
+    for (const auto& f : files) {
+      table.push_back(blob.size());
+      table.push_back(f.line_index.size());
+      table.push_back(f.indexed_size);
+      table.push_back(f.indexed_hash);
+      blob += f.line_index;
+    }
+    SlocbinLineIndexTrailer trailer{ offset, offset + table.size() * sizeof(std::uint64_t),
+                                     blob.size(), line_index_stride, 0, "SLOCLIX" };
+    pad8(blob);
+    out.write(reinterpret_cast<const char*>(table.data()),
+              static_cast<std::streamsize>(table.size() * sizeof(std::uint64_t)));
+    out.write(blob.data(), static_cast<std::streamsize>(blob.size()));
+    out.write(reinterpret_cast<const char*>(&trailer), sizeof trailer);
+  }
+  out.write(reinterpret_cast<const char*>(&footer), sizeof footer);
+}
+
+/// Read-only view of a slocbin file, mapped in memory.
+class SlocbinReader {
+public:
+  SlocbinReader() = default;
+  SlocbinReader(const SlocbinReader&) = delete;
+  SlocbinReader& operator=(const SlocbinReader&) = delete;
+  ~SlocbinReader() {
+    if (m_data != nullptr)
+      ::munmap(const_cast<char*>(m_data), m_size);
+  }
+
+  /**
+   * @brief Maps a file and checks its structure.
+   *
+   * @param filename: The slocbin file.
+   * @param error: Receives a description of the problem, if any.
+   * @return true if the file is a valid slocbin file.
+   */
+  bool open(const std::string& filename, std::string& error) {
+    int fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      error = "could not open " + filename;
+      return false;
+    }
+    struct stat st {};
+    constexpr std::size_t min_size = sizeof(SlocbinHeader) + sizeof(SlocbinFooter);
+    if (::fstat(fd, &st) != 0 or static_cast<std::size_t>(st.st_size) < min_size) {
+      ::close(fd);
+      error = filename + " is not a slocbin file";
+      return false;
+    }
+    m_size = static_cast<std::size_t>(st.st_size);
+    void* p = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) {
+      error = "could not map " + filename;
+      return false;
+    }
+    m_data = static_cast<const char*>(p);
+    std::memcpy(&m_header, m_data, sizeof m_header);
+    std::memcpy(&m_footer, m_data + m_size - sizeof m_footer, sizeof m_footer);
+
+    auto fits = [&](std::uint64_t offset, std::uint64_t len) {
+      return offset <= m_size and len <= m_size - offset and offset % 8 == 0;
+    };
+    bool ok = std::memcmp(m_header.magic, "SLOCBIN", 8) == 0
+              and std::memcmp(m_footer.magic, "SLOCIDX", 8) == 0
+              and m_header.version == SLOCBIN_VERSION
+              and m_header.n_rows <= m_size / sizeof(SlocbinRow)
+              and fits(m_footer.rows_offset, m_header.n_rows * sizeof(SlocbinRow))
+              and fits(m_footer.heap_offset, m_footer.heap_size)
+              and m_header.base_dir_offset <= m_footer.heap_size
+              and m_header.base_dir_len <= m_footer.heap_size - m_header.base_dir_offset;
+    for (std::size_t c = 0; ok and c < SLOCBIN_N_CRITERIA; ++c) {
+      ok = fits(m_footer.index_offset[c], m_header.n_rows * sizeof(std::uint32_t));
+    }
+    if (ok and (m_header.flags & SLOCBIN_FLAG_LINE_INDEX) != 0) {
+      ok = m_size >= min_size + sizeof m_trailer;
+      if (ok)
+        std::memcpy(&m_trailer, m_data + m_size - sizeof m_footer - sizeof m_trailer,
+                    sizeof m_trailer);
+      ok = ok and std::memcmp(m_trailer.magic, "SLOCLIX", 8) == 0 and m_trailer.stride != 0
+           and fits(m_trailer.table_offset, m_header.n_rows * 4 * sizeof(std::uint64_t))
+           and fits(m_trailer.blob_offset, m_trailer.blob_size);
+    }
+    if (!ok) {
+      error = filename + " is not a valid slocbin file";
+      return false;
+    }
+    // Permutation entries are used as row numbers without further checks.
+    for (std::size_t c = 0; c < SLOCBIN_N_CRITERIA; ++c) {
+      const std::uint32_t* perm = permutation(SLOCBIN_CRITERIA[c]);
+      for (std::uint64_t i = 0; i < m_header.n_rows; ++i) {
+        if (perm[i] >= m_header.n_rows) {
+          error = filename + " is corrupt";
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
+  std::uint64_t size() const { return m_header.n_rows; }
+  std::uint32_t flags() const { return m_header.flags; }
+
+  /// # of files the run found, of which size() were counted; 0 unless SLOCBIN_FLAG_PARTIAL.
+  std::uint32_t files_found() const { return m_header.files_found; }
+
+  /// # of lines between the checkpoints of line_index(); 0 if the file has no line index.
+  std::uint32_t line_index_stride() const {
+    return (m_header.flags & SLOCBIN_FLAG_LINE_INDEX) != 0 ? m_trailer.stride : 0;
+  }
+
+  /// The parser checkpoints of row `r` (see line_index.h); empty if there are none.
+  std::string_view line_index(std::uint64_t r) const {
+    if (line_index_stride() == 0)
+      return {};
+    const auto* table = reinterpret_cast<const std::uint64_t*>(m_data + m_trailer.table_offset);
+    std::uint64_t offset = table[4 * r], size = table[4 * r + 1];
+    if (offset > m_trailer.blob_size or size > m_trailer.blob_size - offset)
+      return {};
+    return { m_data + m_trailer.blob_offset + offset, size };
+  }
+
+  /// Whether `text` is still the file row `r` was indexed from: same size and content_hash().
+  bool line_index_matches(std::uint64_t r, std::string_view text) const {
+    if (line_index_stride() == 0)
+      return false;
+    const auto* table = reinterpret_cast<const std::uint64_t*>(m_data + m_trailer.table_offset);
+    return table[4 * r + 2] == text.size() and table[4 * r + 3] == content_hash(text);
+  }
+
+  const SlocbinRow& row(std::uint64_t r) const {
+    return reinterpret_cast<const SlocbinRow*>(m_data + m_footer.rows_offset)[r];
+  }
+
+  /// Path of row `r`; rows are not validated up front, so a corrupt entry reads as empty.
+  std::string_view path(std::uint64_t r) const {
+    const SlocbinRow& x = row(r);
+    if (x.path_offset > m_footer.heap_size or x.path_len > m_footer.heap_size - x.path_offset)
+      return {};
+    return { m_data + m_footer.heap_offset + x.path_offset, x.path_len };
+  }
+
+  std::string_view base_dir() const {
+    return { m_data + m_footer.heap_offset + m_header.base_dir_offset, m_header.base_dir_len };
+  }
+
+  /// Rows in ascending order of `criterion` (one of SLOCBIN_CRITERIA).
+  const std::uint32_t* permutation(char criterion) const {
+    auto c = static_cast<std::size_t>(std::strchr(SLOCBIN_CRITERIA, criterion) - SLOCBIN_CRITERIA);
+    return reinterpret_cast<const std::uint32_t*>(m_data + m_footer.index_offset[c]);
+  }
+
+  /**
+   * @brief Range [first, last) of positions in the filename permutation whose path starts with
+   * `prefix`. An empty prefix selects every row.
+   */
+  std::pair<std::uint64_t, std::uint64_t> prefix_range(std::string_view prefix) const {
+    const std::uint32_t* by_name = permutation('f');
+    const std::uint32_t* end = by_name + size();
+    auto first = std::lower_bound(by_name, end, prefix, [&](std::uint32_t r, std::string_view p) {
+      return path(r) < p;
+    });
+    // Paths sharing the prefix sort right after it, so they form a contiguous run.
+    auto last = std::partition_point(first, end, [&](std::uint32_t r) {
+      return path(r).substr(0, prefix.size()) == prefix;
+    });
+    return { static_cast<std::uint64_t>(first - by_name),
+             static_cast<std::uint64_t>(last - by_name) };
+  }
+
+  /// Row of `p`, or size() if it is not in the file.
+  std::uint64_t find(std::string_view p) const {
+    auto [first, last] = prefix_range(p);
+    // `p` itself sorts first among the paths it prefixes.
+    if (first < last and path(permutation('f')[first]) == p)
+      return permutation('f')[first];
+    return size();
+  }
+
+private:
+  const char* m_data = nullptr;
+  std::size_t m_size = 0;
+  SlocbinHeader m_header{};
+  SlocbinFooter m_footer{};
+  SlocbinLineIndexTrailer m_trailer{};
+};
+
+#endif
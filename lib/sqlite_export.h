@@ -0,0 +1,281 @@
+#ifndef SQLITE_EXPORT_H
+#define SQLITE_EXPORT_H
+
+/*!
+ * @file sqlite_export.h
+ * @description
+ * Writes the results of a run into a SQLite database (`--sqlite out.db`).
+ *
+ * Schema (every run is appended as a new snapshot):
+ * - runs(id, started_at, base_dir, n_files)
+ * - languages(id, name)
+ * - paths(id, path)                 paths relative to the run's base directory
+ * - files(run_id, path_id, language_id, blank, comments, doc, code, lines)
+ * - language_totals(run_id, language_id, n_files, blank, comments, doc, code, lines)
+ * - run_coverage(run_id, files_found, files_counted, stopped_by)
+ *   stopped_by is NULL, or why a run stopped before counting every file it found
+ *
+ * A run is written in a single transaction, with the database in WAL mode: if anything
+ * fails, none of its rows are left behind. Rows go through prepared statements, and secondary
+ * indexes are only created after the rows are in, so the first import does not maintain them
+ * row by row.
+ */
+#include <array>
+#include <cstdint>
+#include <ctime>
+#include <string>
+
+#include "cancellation.h"
+#include "file_info.h"
+#include "table_report.h"
+
+#ifdef SLOC_HAVE_SQLITE
+# include <sqlite3.h>
+
+/// Owns a prepared statement and finalizes it when going out of scope.
+class SqliteStatement {
+public:
+  SqliteStatement(sqlite3* db, const char* sql) {
+    if (sqlite3_prepare_v2(db, sql, -1, &m_stmt, nullptr) != SQLITE_OK) {
+      m_stmt = nullptr;
+    }
+  }
+  SqliteStatement(const SqliteStatement&) = delete;
+  SqliteStatement& operator=(const SqliteStatement&) = delete;
+  ~SqliteStatement() { sqlite3_finalize(m_stmt); }
+
+  bool ok() const { return m_stmt != nullptr; }
+  sqlite3_stmt* get() const { return m_stmt; }
+
+  /// Binds 64-bit integers to the first parameters, in order.
+  template <typename... Ts>
+  void bind(Ts... values) {
+    int index = 1;
+    (sqlite3_bind_int64(m_stmt, index++, static_cast<sqlite3_int64>(values)), ...);
+  }
+
+  /// Runs the statement and resets it for the next use.
+  /// @return the result of sqlite3_step().
+  int run() {
+    int rc = sqlite3_step(m_stmt);
+    sqlite3_reset(m_stmt);
+    return rc;
+  }
+
+private:
+  sqlite3_stmt* m_stmt = nullptr;
+};
+
+/// Current time as an ISO 8601 UTC timestamp.
+inline std::string utc_timestamp() {
+  std::time_t now = std::time(nullptr);
+  std::tm tm {};
+  gmtime_r(&now, &tm);
+  char buf[32];
+  std::strftime(buf, sizeof buf, "%Y-%m-%dT%H:%M:%SZ", &tm);
+  return buf;
+}
+
+/**
+ * @brief Appends the results of this run to a SQLite database, creating it if needed.
+ *
+ * @param db_path: The database file.
+ * @param files: The files counted in this run.
+ * @param base_dir: Paths are stored relative to this directory.
+ * @param error: Receives a description of the failure, if any.
+ * @param coverage: The share of the tree the run counted, if it was stopped early.
+ * @return true on success.
+ */
+inline bool export_sqlite(const std::string& db_path,
+                          const FileList& files,
+                          const std::string& base_dir,
+                          std::string& error,
+                          const RunCoverage& coverage = {}) {
+  sqlite3* db = nullptr;
+  if (sqlite3_open_v2(db_path.c_str(), &db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, nullptr)
+      != SQLITE_OK) {
+    error = db == nullptr ? "out of memory" : sqlite3_errmsg(db);
+    sqlite3_close(db);
+    return false;
+  }
+
+  auto exec = [&](const char* sql) {
+    char* msg = nullptr;
+    if (sqlite3_exec(db, sql, nullptr, nullptr, &msg) != SQLITE_OK) {
+      error = msg == nullptr ? sqlite3_errmsg(db) : msg;
+      sqlite3_free(msg);
+      return false;
+    }
+    return true;
+  };
+
+  bool ok = exec("PRAGMA journal_mode=WAL;"
+                 "PRAGMA synchronous=NORMAL;"
+                 "PRAGMA temp_store=MEMORY;"
+                 "PRAGMA cache_size=-65536;")
+            and exec("CREATE TABLE IF NOT EXISTS runs("
+                     "  id INTEGER PRIMARY KEY, started_at TEXT NOT NULL,"
+                     "  base_dir TEXT NOT NULL, n_files INTEGER NOT NULL);"
+                     "CREATE TABLE IF NOT EXISTS languages("
+                     "  id INTEGER PRIMARY KEY, name TEXT NOT NULL UNIQUE);"
+                     "CREATE TABLE IF NOT EXISTS paths("
+                     "  id INTEGER PRIMARY KEY, path TEXT NOT NULL UNIQUE);"
+                     "CREATE TABLE IF NOT EXISTS files("
+                     "  run_id INTEGER NOT NULL REFERENCES runs(id),"
+                     "  path_id INTEGER NOT NULL REFERENCES paths(id),"
+                     "  language_id INTEGER NOT NULL REFERENCES languages(id),"
+                     "  blank INTEGER NOT NULL, comments INTEGER NOT NULL, doc INTEGER NOT NULL,"
+                     "  code INTEGER NOT NULL, lines INTEGER NOT NULL);"
+                     "CREATE TABLE IF NOT EXISTS language_totals("
+                     "  run_id INTEGER NOT NULL REFERENCES runs(id),"
+                     "  language_id INTEGER NOT NULL REFERENCES languages(id),"
+                     "  n_files INTEGER NOT NULL, blank INTEGER NOT NULL,"
+                     "  comments INTEGER NOT NULL, doc INTEGER NOT NULL,"
+                     "  code INTEGER NOT NULL, lines INTEGER NOT NULL,"
+                     "  PRIMARY KEY (run_id, language_id));"
+                     "CREATE TABLE IF NOT EXISTS run_coverage("
+                     "  run_id INTEGER PRIMARY KEY REFERENCES runs(id),"
+                     "  files_found INTEGER NOT NULL, files_counted INTEGER NOT NULL,"
+                     "  stopped_by TEXT);")
+            and exec("BEGIN;");
+
+  sqlite3_int64 run_id = 0;
+  std::array<sqlite3_int64, UNDEF + 1> language_ids{};
+  if (ok) {
+    SqliteStatement insert_run{
+      db, "INSERT INTO runs(started_at, base_dir, n_files) VALUES(?, ?, ?);"
+    };
+    SqliteStatement insert_language{ db, "INSERT OR IGNORE INTO languages(name) VALUES(?);" };
+    SqliteStatement select_language{ db, "SELECT id FROM languages WHERE name = ?;" };
+    ok = insert_run.ok() and insert_language.ok() and select_language.ok();
+    if (ok) {
+      std::string started_at = utc_timestamp();
+      sqlite3_bind_text(insert_run.get(), 1, started_at.c_str(), -1, SQLITE_TRANSIENT);
+      sqlite3_bind_text(insert_run.get(), 2, base_dir.c_str(), -1, SQLITE_TRANSIENT);
+      sqlite3_bind_int64(insert_run.get(), 3, static_cast<sqlite3_int64>(files.size()));
+      ok = insert_run.run() == SQLITE_DONE;
+      run_id = sqlite3_last_insert_rowid(db);
+    }
+    if (ok) {
+      SqliteStatement insert_coverage{ db,
+                                       "INSERT INTO run_coverage(run_id, files_found,"
+                                       " files_counted, stopped_by) VALUES(?, ?, ?, ?);" };
+      ok = insert_coverage.ok();
+      if (ok) {
+        const bool partial = coverage.partial();
+        insert_coverage.bind(run_id,
+                             partial ? coverage.n_found : files.size(),
+                             partial ? coverage.n_counted : files.size());
+        if (partial)
+          sqlite3_bind_text(insert_coverage.get(), 4, coverage.reason_name(), -1, SQLITE_STATIC);
+        ok = insert_coverage.run() == SQLITE_DONE;
+      }
+    }
+    for (int t = 0; ok and t <= UNDEF; ++t) {
+      std::string name = lang_type_to_string(static_cast<lang_type_e>(t));
+      sqlite3_bind_text(insert_language.get(), 1, name.c_str(), -1, SQLITE_TRANSIENT);
+      ok = insert_language.run() == SQLITE_DONE;
+      sqlite3_bind_text(select_language.get(), 1, name.c_str(), -1, SQLITE_TRANSIENT);
+      ok = ok and sqlite3_step(select_language.get()) == SQLITE_ROW;
+      language_ids[t] = sqlite3_column_int64(select_language.get(), 0);
+      sqlite3_reset(select_language.get());
+    }
+  }
+
+  // Per-language totals are accumulated while the file rows are written.
+  struct Totals {
+    count_t n_files = 0, blank = 0, comments = 0, doc = 0, code = 0, lines = 0;
+  };
+  std::array<Totals, UNDEF + 1> totals{};
+
+  if (ok) {
+    SqliteStatement insert_path{ db, "INSERT OR IGNORE INTO paths(path) VALUES(?);" };
+    SqliteStatement select_path{ db, "SELECT id FROM paths WHERE path = ?;" };
+    SqliteStatement insert_file{ db,
+                                 "INSERT INTO files(run_id, path_id, language_id, blank, comments,"
+                                 " doc, code, lines) VALUES(?, ?, ?, ?, ?, ?, ?, ?);" };
+    ok = insert_path.ok() and select_path.ok() and insert_file.ok();
+
+    for (const auto& f : files) {
+      if (!ok)
+        break;
+      std::string path = relative_basename(f.filename, base_dir);
+      sqlite3_bind_text(insert_path.get(), 1, path.c_str(), -1, SQLITE_TRANSIENT);
+      ok = insert_path.run() == SQLITE_DONE;
+      sqlite3_int64 path_id = 0;
+      if (sqlite3_changes(db) == 1) {
+        path_id = sqlite3_last_insert_rowid(db);
+      } else {
+        sqlite3_bind_text(select_path.get(), 1, path.c_str(), -1, SQLITE_TRANSIENT);
+        ok = ok and sqlite3_step(select_path.get()) == SQLITE_ROW;
+        path_id = sqlite3_column_int64(select_path.get(), 0);
+        sqlite3_reset(select_path.get());
+      }
+
+      insert_file.bind(run_id,
+                       path_id,
+                       language_ids[f.type],
+                       f.n_blank,
+                       all_comment_lines(f),
+                       all_doc_lines(f),
+                       f.n_loc,
+                       f.n_lines);
+      ok = ok and insert_file.run() == SQLITE_DONE;
+
+      Totals& t = totals[f.type];
+      t.n_files++;
+      t.blank += f.n_blank;
+      t.comments += all_comment_lines(f);
+      t.doc += all_doc_lines(f);
+      t.code += f.n_loc;
+      t.lines += f.n_lines;
+    }
+    if (!ok and error.empty()) {
+      error = sqlite3_errmsg(db);
+    }
+  }
+
+  if (ok) {
+    SqliteStatement insert_total{ db,
+                                  "INSERT INTO language_totals(run_id, language_id, n_files,"
+                                  " blank, comments, doc, code, lines)"
+                                  " VALUES(?, ?, ?, ?, ?, ?, ?, ?);" };
+    ok = insert_total.ok();
+    for (int t = 0; ok and t <= UNDEF; ++t) {
+      const Totals& s = totals[t];
+      if (s.n_files == 0)
+        continue;
+      insert_total.bind(
+        run_id, language_ids[t], s.n_files, s.blank, s.comments, s.doc, s.code, s.lines);
+      ok = insert_total.run() == SQLITE_DONE;
+    }
+  }
+
+  ok = ok
+       and exec("COMMIT;"
+                "CREATE INDEX IF NOT EXISTS files_run ON files(run_id);"
+                "CREATE INDEX IF NOT EXISTS files_path ON files(path_id, run_id);");
+  if (!ok and error.empty()) {
+    error = sqlite3_errmsg(db);
+  }
+  if (!ok) {
+    sqlite3_exec(db, "ROLLBACK;", nullptr, nullptr, nullptr);
+  }
+  sqlite3_close(db);
+  return ok;
+}
+
+#else
+
+inline bool export_sqlite(const std::string&,
+                          const FileList&,
+                          const std::string&,
+                          std::string& error,
+                          const RunCoverage& = {}) {
+  error = "sloc was built without SQLite support";
+  return false;
+}
+
+#endif
+
+#endif
@@ -0,0 +1,422 @@
+#ifndef SUBTREE_CACHE_H
+#define SUBTREE_CACHE_H
+
+/*!
+ * @file subtree_cache.h
+ * @description
+ * Result cache for incremental runs (`--cache`), kept as a tree mirroring the directories.
+ *
+ * Each directory node stores its mtime and its children: the counts of its source files, with
+ * their mtime and size, and its subdirectories. A directory whose mtime did not change since the
+ * last run had no entry added, removed or renamed, so its listing is taken from the cache
+ * without reading the directory. Its files still get one stat each, and are reused when their
+ * mtime and size match: editing a file in place does not change the mtime of its directory.
+ * A directory that changed is read again, with its files reused the same way.
+ *
+ * With `--cache-trust-dirs`, the files of an unchanged directory are reused without a stat, so
+ * an unchanged directory costs one stat in all. Files edited in place then go unnoticed until
+ * something else changes in their directory.
+ *
+ * Entries modified in the same second the previous run started are never trusted, since a later
+ * change could keep the same mtime. When nothing had to be read again, the cache file is left as
+ * it is.
+ *
+ * File layout (varints, see varint.h): "SLOCTREE", version, start time of the run that wrote
+ * it, # of roots, then each root node in preorder. A node is its name, a kind (0 file, 1
+ * directory), its mtime, then for a file its language, size and counts, and for a directory its
+ * children.
+ */
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <optional>
+#include <string>
+#include <sys/stat.h>
+#include <unordered_map>
+#include <vector>
+
+#include "cancellation.h"
+#include "file_info.h"
+#include "mem_stats.h"
+#include "progress.h"
+#include "varint.h"
+
+constexpr std::uint32_t SUBTREE_CACHE_VERSION = 2;
+
+/// A file or directory of the cache.
+struct CacheNode {
+  std::string name;       //!< Name in its parent; the path as given for a root.
+  bool is_dir = false;
+  std::int64_t mtime = 0;  //!< ns since the epoch.
+  // Files.
+  std::uint64_t size = 0;
+  lang_type_e type = UNDEF;
+  count_t n_blank = 0;
+  count_t n_comments = 0;
+  count_t n_doc = 0;
+  count_t n_loc = 0;
+  std::int64_t file_index = -1;  //!< Index in the FileList of a file counted in this run.
+  // Directories.
+  std::vector<CacheNode> children;
+};
+
+/// Walks directories, reusing the counts the cache confirms, see the file description.
+class SubtreeCache {
+public:
+  /// Gives the language of a path, or nothing if it is not counted.
+  using LangFn = std::function<std::optional<lang_type_e>(const std::string&)>;
+
+  /// What the walks reused.
+  struct Stats {
+    std::size_t n_dirs_reused = 0;   //!< Directories not read, their listing was cached.
+    std::size_t n_dirs_scanned = 0;  //!< Directories read.
+    std::size_t n_files_reused = 0;
+    std::size_t n_files_counted = 0;
+  };
+
+  /**
+   * @brief Ctro.
+   *
+   * @param lang: Gives the language of a file; files without one are skipped.
+   * @param trust_dirs: Reuse the files of an unchanged directory without a stat each.
+   */
+  explicit SubtreeCache(LangFn lang, bool trust_dirs = false)
+      : m_lang{ std::move(lang) }, m_trust_dirs{ trust_dirs } {
+    m_start = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::system_clock::now().time_since_epoch())
+                .count();
+  }
+
+  /**
+   * @brief Reads the cache of a previous run.
+   *
+   * @param filename: The cache file; if it does not exist, the cache starts empty.
+   * @param error: Receives a description of the problem, if any.
+   * @return false if the file exists but is not a valid cache.
+   */
+  bool load(const std::string& filename, std::string& error) {
+    std::ifstream in{ filename, std::ios::binary };
+    if (!in.is_open())
+      return true;
+    std::string data{ std::istreambuf_iterator<char>{ in }, std::istreambuf_iterator<char>{} };
+    const char* p = data.data();
+    const char* end = p + data.size();
+    std::uint64_t version = 0, start = 0, n_roots = 0;
+    bool ok = data.compare(0, 8, "SLOCTREE") == 0;
+    p += ok ? 8 : 0;
+    ok = ok and get_varint(p, end, version) and version == SUBTREE_CACHE_VERSION
+         and get_varint(p, end, start) and get_varint(p, end, n_roots);
+    if (ok)
+      m_prev_start = static_cast<std::int64_t>(start);
+    for (std::uint64_t i = 0; ok and i < n_roots; ++i) {
+      CacheNode root;
+      ok = read_node(p, end, root);
+      m_old_roots.emplace(root.name, std::move(root));
+    }
+    if (!ok) {
+      m_old_roots.clear();
+      error = filename + " is not a valid cache file";
+    }
+    return ok;
+  }
+
+  /**
+   * @brief Lists the source files of a directory, appending them to `files`.
+   *
+   * Files whose counts come from the cache are flagged FileInfo::cached; the others have to be
+   * counted, and are picked up by save().
+   *
+   * The walk ends early once stop_requested(); the tree is then incomplete and must not be
+   * saved.
+   *
+   * @param root: The directory, as given on the command line.
+   * @param recursive: Also walk its subdirectories.
+   * @param files: The list to append to.
+   */
+  void walk(const std::string& root, bool recursive, FileList& files) {
+    auto old = m_old_roots.find(root);
+    CacheNode node;
+    node.name = root;
+    node.is_dir = true;
+    walk_dir(root, old == m_old_roots.end() ? nullptr : &old->second, recursive, node, files);
+    m_new_roots.push_back(std::move(node));
+  }
+
+  /**
+   * @brief Takes the counts of the files counted in this run and writes the cache, unless
+   * nothing changed.
+   *
+   * @param filename: The cache file.
+   * @param files: The list the walks appended to, counted, in the same order.
+   * @param error: Receives a description of the problem, if any.
+   * @return true if the cache was written or was up to date.
+   */
+  bool save(const std::string& filename, const FileList& files, std::string& error) {
+    // Anything read again is written back, so the next run can trust it.
+    bool changed = m_changed or m_new_roots.size() != m_old_roots.size()
+                   or m_stats.n_dirs_scanned > 0 or m_stats.n_files_counted > 0;
+    for (auto& root : m_new_roots) {
+      finish(root, files);
+      changed = changed or m_old_roots.count(root.name) == 0;
+    }
+    if (!changed)
+      return true;
+
+    std::string data = "SLOCTREE";
+    put_varint(data, SUBTREE_CACHE_VERSION);
+    put_varint(data, static_cast<std::uint64_t>(m_start));
+    put_varint(data, m_new_roots.size());
+    for (const auto& root : m_new_roots) {
+      write_node(data, root);
+    }
+    // Written aside and renamed, so an interrupted run leaves the previous cache.
+    std::string tmp = filename + ".tmp";
+    std::ofstream out{ tmp, std::ios::binary };
+    out.write(data.data(), static_cast<std::streamsize>(data.size()));
+    out.close();
+    if (!out or std::rename(tmp.c_str(), filename.c_str()) != 0) {
+      std::remove(tmp.c_str());
+      error = "could not write " + filename;
+      return false;
+    }
+    return true;
+  }
+
+  const Stats& stats() const { return m_stats; }
+
+private:
+  static std::int64_t mtime_of(const struct stat& st) {
+    return static_cast<std::int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+  }
+
+  /// Whether an mtime seen by the previous run can be trusted, see the file description.
+  bool trusted(std::int64_t mtime) const {
+    return mtime / 1000000000 < m_prev_start / 1000000000;
+  }
+
+  /// Whether the cached counts of `prev` still hold for a file of language `type` with status
+  /// `st`.
+  bool reusable(const CacheNode* prev, lang_type_e type, const struct stat& st) const {
+    return prev != nullptr and !prev->is_dir and prev->type == type
+           and prev->mtime == mtime_of(st) and prev->size == static_cast<std::uint64_t>(st.st_size)
+           and trusted(prev->mtime);
+  }
+
+  /// A subdirectory a non-recursive walk listed but did not enter. The listing of its parent
+  /// must still name it, or a recursive walk reusing that listing would skip it; with no
+  /// mtime, it is read again by the first walk that enters it.
+  static CacheNode unvisited_dir(std::string name) {
+    CacheNode sub;
+    sub.name = std::move(name);
+    sub.is_dir = true;
+    return sub;
+  }
+
+  void add_file(const std::string& path, CacheNode& node, bool reused, FileList& files) {
+    MemScope paths{ mem_tag_e::PATHS };
+    progress_counters().discovered.fetch_add(1, std::memory_order_relaxed);
+    if (reused) {
+      files.emplace_back(path, node.type, node.n_blank, node.n_comments, node.n_loc, node.n_doc,
+                         node.n_blank + node.n_comments + node.n_doc + node.n_loc);
+      files.back().cached = true;
+      m_stats.n_files_reused++;
+    } else {
+      node.file_index = static_cast<std::int64_t>(files.size());
+      files.emplace_back(path, node.type);
+      m_stats.n_files_counted++;
+    }
+  }
+
+  void walk_dir(const std::string& path,
+                const CacheNode* old,
+                bool recursive,
+                CacheNode& node,
+                FileList& files) {
+    struct stat st {};
+    if (stop_requested() or ::stat(path.c_str(), &st) != 0)
+      return;
+    node.mtime = mtime_of(st);
+    if (old != nullptr and old->is_dir and old->mtime == node.mtime and trusted(node.mtime)) {
+      // Same listing as last time: its files are checked, its subdirectories walked.
+      m_stats.n_dirs_reused++;
+      for (const auto& child : old->children) {
+        std::string child_path = (std::filesystem::path{ path } / child.name).string();
+        if (!child.is_dir and m_trust_dirs) {
+          node.children.push_back(child);
+          add_file(child_path, node.children.back(), true, files);
+        } else if (!child.is_dir) {
+          struct stat file_st {};
+          if (::stat(child_path.c_str(), &file_st) != 0) {
+            m_changed = true;  // gone, though the directory kept its mtime
+            continue;
+          }
+          add_listed_file(child_path, &child, child.type, file_st, node, files);
+        } else if (recursive) {
+          CacheNode sub;
+          sub.name = child.name;
+          sub.is_dir = true;
+          walk_dir(child_path, &child, recursive, sub, files);
+          node.children.push_back(std::move(sub));
+        } else {
+          node.children.push_back(unvisited_dir(child.name));
+        }
+      }
+      return;
+    }
+
+    m_stats.n_dirs_scanned++;
+    std::unordered_map<std::string, const CacheNode*> old_children;
+    if (old != nullptr and old->is_dir) {
+      for (const auto& child : old->children) {
+        old_children.emplace(child.name, &child);
+      }
+    }
+    DIR* dir = ::opendir(path.c_str());
+    if (dir == nullptr)
+      return;
+    // Entries are visited in directory order, descending into subdirectories as they come, as
+    // std::filesystem::recursive_directory_iterator does.
+    while (const struct dirent* entry = ::readdir(dir)) {
+      if (stop_requested())
+        break;
+      if (std::strcmp(entry->d_name, ".") == 0 or std::strcmp(entry->d_name, "..") == 0)
+        continue;
+      std::string child_path = (std::filesystem::path{ path } / entry->d_name).string();
+      bool is_dir = entry->d_type == DT_DIR;
+      if (entry->d_type == DT_UNKNOWN) {
+        struct stat child_st {};
+        is_dir = ::lstat(child_path.c_str(), &child_st) == 0 and S_ISDIR(child_st.st_mode);
+      }
+      auto old_child = old_children.find(entry->d_name);
+      const CacheNode* prev = old_child == old_children.end() ? nullptr : old_child->second;
+      if (is_dir) {
+        if (!recursive) {
+          node.children.push_back(unvisited_dir(entry->d_name));
+          continue;
+        }
+        CacheNode sub;
+        sub.name = entry->d_name;
+        sub.is_dir = true;
+        walk_dir(child_path, prev, recursive, sub, files);
+        node.children.push_back(std::move(sub));
+        continue;
+      }
+      auto type = m_lang(child_path);
+      struct stat file_st {};
+      if (!type.has_value() or ::stat(child_path.c_str(), &file_st) != 0)
+        continue;
+      add_listed_file(child_path, prev, type.value(), file_st, node, files);
+    }
+    ::closedir(dir);
+  }
+
+  /// Adds a file of a directory listing to `node`, reusing the counts of `prev` if they hold.
+  void add_listed_file(const std::string& path,
+                       const CacheNode* prev,
+                       lang_type_e type,
+                       const struct stat& st,
+                       CacheNode& node,
+                       FileList& files) {
+    const bool reused = reusable(prev, type, st);
+    node.children.push_back(reused ? *prev : CacheNode{});
+    CacheNode& file = node.children.back();
+    file.name = std::filesystem::path{ path }.filename().string();
+    file.type = type;
+    file.mtime = mtime_of(st);
+    file.size = static_cast<std::uint64_t>(st.st_size);
+    add_file(path, file, reused, files);
+  }
+
+  /// Fills the counts of the files counted in this run.
+  void finish(CacheNode& node, const FileList& files) {
+    for (auto& child : node.children) {
+      if (child.is_dir) {
+        finish(child, files);
+        continue;
+      }
+      if (child.file_index >= 0) {
+        const FileInfo& f = files[static_cast<std::size_t>(child.file_index)];
+        child.n_blank = f.n_blank;
+        child.n_comments = f.n_comments;
+        child.n_doc = f.n_doc;
+        child.n_loc = f.n_loc;
+        child.file_index = -1;
+      }
+    }
+  }
+
+  static void write_node(std::string& out, const CacheNode& node) {
+    put_varint(out, node.name.size());
+    out += node.name;
+    put_varint(out, node.is_dir ? 1 : 0);
+    put_varint(out, zigzag(node.mtime));
+    if (!node.is_dir) {
+      for (std::uint64_t v : { std::uint64_t{ node.type }, node.size, std::uint64_t{ node.n_blank },
+                               std::uint64_t{ node.n_comments }, std::uint64_t{ node.n_doc },
+                               std::uint64_t{ node.n_loc } }) {
+        put_varint(out, v);
+      }
+      return;
+    }
+    put_varint(out, node.children.size());
+    for (const auto& child : node.children) {
+      write_node(out, child);
+    }
+  }
+
+  static bool read_node(const char*& p, const char* end, CacheNode& node) {
+    std::uint64_t len, kind, mtime;
+    if (!get_varint(p, end, len) or len > static_cast<std::uint64_t>(end - p))
+      return false;
+    node.name.assign(p, len);
+    p += len;
+    if (!get_varint(p, end, kind) or !get_varint(p, end, mtime) or kind > 1)
+      return false;
+    node.is_dir = kind == 1;
+    node.mtime = unzigzag(mtime);
+    if (!node.is_dir) {
+      std::uint64_t v[6];
+      for (auto& x : v) {
+        if (!get_varint(p, end, x))
+          return false;
+      }
+      if (v[0] >= UNDEF)
+        return false;
+      node.type = static_cast<lang_type_e>(v[0]);
+      node.size = v[1];
+      node.n_blank = static_cast<count_t>(v[2]);
+      node.n_comments = static_cast<count_t>(v[3]);
+      node.n_doc = static_cast<count_t>(v[4]);
+      node.n_loc = static_cast<count_t>(v[5]);
+      return true;
+    }
+    std::uint64_t n_children;
+    if (!get_varint(p, end, n_children)
+        or n_children > static_cast<std::uint64_t>(end - p))
+      return false;
+    node.children.resize(n_children);
+    for (auto& child : node.children) {
+      if (!read_node(p, end, child))
+        return false;
+    }
+    return true;
+  }
+
+  LangFn m_lang;
+  bool m_trust_dirs = false;      //!< Reuse the files of unchanged directories without a stat.
+  bool m_changed = false;         //!< A reused listing lost a file; the cache must be rewritten.
+  std::int64_t m_start = 0;       //!< When this run started, ns since the epoch.
+  std::int64_t m_prev_start = 0;  //!< When the run that wrote the cache started.
+  std::unordered_map<std::string, CacheNode> m_old_roots;
+  std::vector<CacheNode> m_new_roots;
+  Stats m_stats;
+};
+
+#endif
@@ -0,0 +1,552 @@
+#ifndef TABLE_REPORT_H
+#define TABLE_REPORT_H
+
+/*!
+ * @file table_report.h
+ * @description
+ * The formatted table sloc prints once counting is done.
+ */
+#include <algorithm>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "build_deps.h"
+#include "file_info.h"
+#include "halstead.h"
+#include "patch_counter.h"
+
+/**
+ * @brief Extracts the relative basename from a full file path.
+ *
+ * This is important for the formatting of the output table to be presented.
+ *
+ * @param full_path: The full path to the file.
+ * @param base_dir: The base directory.
+ * @return the new path.
+ */
+
+inline std::string relative_basename(const std::string &full_path, const std::string &base_dir) {
+    std::filesystem::path full(full_path);
+    std::filesystem::path base(base_dir);
+    std::error_code ec;
+    std::filesystem::path rel = std::filesystem::relative(full, base, ec);
+    if (!ec) {
+        return rel.string();
+    } else {
+        return full.string();
+    }
+}
+
+/**
+ * @brief Prints a formatted table with information about each file.
+ *
+ * Displays the following columns for each file:
+ * - Filename
+ * - Language
+ * - Number of comments (and percentage)
+ * - Number of documentation comments (and percentage)
+ * - Number of blank lines (and percentage)
+ * - Number of lines of code (and percentage)
+ * - Total number of lines
+ *
+ * @param files: The list of files to display.
+ * @param base_dir: Filenames are shown relative to this directory.
+ * @param out: The stream the table is written to.
+ * @param license_column: Adds a column with the license header lines of each file.
+ */
+inline void print_table(const FileList& files,
+                        const std::string& base_dir,
+                        std::ostream& out = std::cout,
+                        bool license_column = false) {
+  if (files.empty()) {
+    out << "No files processed.\n";
+    return;
+  }
+
+  // Calculate maximum filename width using the relative path
+  size_t max_filename_width = 0;
+  for (const auto& f : files) {
+    std::string relName = relative_basename(f.filename, base_dir);
+    max_filename_width = std::max(max_filename_width, relName.size());
+  }
+  max_filename_width = std::max(max_filename_width, static_cast<size_t>(8)); // "Filename" header
+
+  const size_t sum_fixed_widths = 12 + 15 + 17 + 12 + 12 + 12 + (license_column ? 15 : 0);
+  const size_t total_separator_width = max_filename_width + sum_fixed_widths;
+  
+  out << "Files processed: " << files.size() << '\n';
+  out << std::string(total_separator_width, '-') << '\n';
+  
+  // Print table header
+  out << std::left
+            << std::setw(max_filename_width) << "Filename"
+            << std::setw(12) << "Language"
+            << std::setw(15) << "Comments"
+            << std::setw(17) << "Doc Comments";
+  if (license_column)
+    out << std::setw(15) << "License";
+  out << std::setw(12) << "Blank"
+            << std::setw(12) << "Code"
+            << std::setw(12) << "# of lines"
+            << '\n';
+
+  out << std::string(total_separator_width, '-') << '\n';
+
+  // Print each file's data using the relative path
+  for (const auto& f : files) {
+    count_t total = f.n_blank + f.n_comments + f.n_doc + f.n_loc + f.n_license;
+    auto percent = [&](count_t count) -> std::string {
+      if (total == 0)
+        return "0.0%";
+      std::ostringstream oss;
+      oss << std::fixed << std::setprecision(1) << (100.0 * count / total) << '%';
+      return oss.str();
+    };
+
+    std::ostringstream comments, doc, license, blank, code;
+    comments << f.n_comments << " (" << percent(f.n_comments) << ")";
+    doc << f.n_doc << " (" << percent(f.n_doc) << ")";
+    license << f.n_license << " (" << percent(f.n_license) << ")";
+    blank << f.n_blank << " (" << percent(f.n_blank) << ")";
+    code << f.n_loc << " (" << percent(f.n_loc) << ")";
+
+    out << std::left
+              << std::setw(max_filename_width) << relative_basename(f.filename, base_dir)
+              << "  "
+              << std::setw(12) << lang_type_to_string(f.type)
+              << std::setw(15) << comments.str()
+              << std::setw(17) << doc.str();
+    if (license_column)
+      out << std::setw(15) << license.str();
+    out << std::setw(12) << blank.str()
+              << std::setw(12) << code.str()
+              << std::setw(12) << total
+              << '\n';
+
+    out << '\n';
+  }
+  
+  out << std::string(total_separator_width, '-') << '\n';
+
+  // Print the SUM row when processing more than one file
+  if (files.size() > 1) {
+    count_t sum_comments = 0, sum_doc = 0, sum_license = 0, sum_blank = 0, sum_loc = 0;
+    count_t sum_lines = 0;
+    for (const auto& f : files) {
+      sum_comments += f.n_comments;
+      sum_license += f.n_license;
+      sum_doc += f.n_doc;
+      sum_blank += f.n_blank;
+      sum_loc += f.n_loc;
+      sum_lines += f.n_lines;
+    }
+
+    out << std::left 
+              << std::setw(max_filename_width) << "SUM"
+              << std::setw(12) << ""
+              << std::setw(15) << sum_comments
+              << std::setw(17) << sum_doc;
+    if (license_column)
+      out << std::setw(15) << sum_license;
+    out << std::setw(12) << sum_blank
+              << std::setw(12) << sum_loc
+              << std::setw(12) << sum_lines
+              << '\n';
+
+    out << std::string(total_separator_width, '-') << '\n';
+  }
+}
+
+/**
+ * @brief Prints how many times each marker was found, for every file with at least one.
+ *
+ * @param files: The files, counted with markers.
+ * @param markers: The marker names, in the order of FileInfo::n_markers.
+ * @param base_dir: Filenames are shown relative to this directory.
+ * @param out: The stream the table is written to.
+ */
+inline void print_markers(const FileList& files,
+                          const std::vector<std::string>& markers,
+                          const std::string& base_dir,
+                          std::ostream& out = std::cout) {
+  std::vector<count_t> totals(markers.size(), 0);
+  std::vector<const FileInfo*> marked;
+  size_t max_filename_width = 8;
+  for (const auto& f : files) {
+    count_t n = 0;
+    for (std::size_t k = 0; k < f.n_markers.size() and k < markers.size(); ++k) {
+      totals[k] += f.n_markers[k];
+      n += f.n_markers[k];
+    }
+    if (n > 0) {
+      marked.push_back(&f);
+      max_filename_width =
+        std::max(max_filename_width, relative_basename(f.filename, base_dir).size());
+    }
+  }
+  max_filename_width += 2;
+  std::vector<size_t> widths;
+  size_t total_separator_width = max_filename_width;
+  for (const auto& m : markers) {
+    widths.push_back(std::max<size_t>(m.size() + 2, 10));
+    total_separator_width += widths.back();
+  }
+
+  out << "\nMarkers found in comments:";
+  for (std::size_t k = 0; k < markers.size(); ++k) {
+    out << (k == 0 ? " " : ", ") << markers[k] << ' ' << totals[k];
+  }
+  out << '\n';
+  if (marked.empty())
+    return;
+
+  out << std::string(total_separator_width, '-') << '\n';
+  out << std::left << std::setw(max_filename_width) << "Filename";
+  for (std::size_t k = 0; k < markers.size(); ++k) {
+    out << std::setw(widths[k]) << markers[k];
+  }
+  out << '\n' << std::string(total_separator_width, '-') << '\n';
+  for (const FileInfo* f : marked) {
+    out << std::setw(max_filename_width) << relative_basename(f->filename, base_dir);
+    for (std::size_t k = 0; k < markers.size(); ++k) {
+      out << std::setw(widths[k]) << (k < f->n_markers.size() ? f->n_markers[k] : 0);
+    }
+    out << '\n';
+  }
+  out << std::string(total_separator_width, '-') << '\n';
+}
+
+/**
+ * @brief Prints the counters of every file under each classification profile.
+ *
+ * @param files: The files, counted with profiles.
+ * @param profiles: The profile names, in the order of FileInfo::profiles.
+ * @param base_dir: Filenames are shown relative to this directory.
+ * @param out: The stream the table is written to.
+ */
+inline void print_profiles(const FileList& files,
+                           const std::vector<std::string>& profiles,
+                           const std::string& base_dir,
+                           std::ostream& out = std::cout) {
+  size_t max_filename_width = 8;
+  for (const auto& f : files) {
+    max_filename_width =
+      std::max(max_filename_width, relative_basename(f.filename, base_dir).size());
+  }
+  max_filename_width += 2;
+  std::vector<size_t> widths;
+  size_t total_separator_width = max_filename_width;
+  for (const auto& p : profiles) {
+    widths.push_back(std::max<size_t>(p.size() + 2, 4 * 10));
+    total_separator_width += widths.back();
+  }
+  auto print_counts = [&](const ProfileCounts& c, size_t width) {
+    std::ostringstream group;
+    group << std::left << std::setw(10) << c.n_loc << std::setw(10) << c.n_comments
+          << std::setw(10) << c.n_doc << c.n_blank;
+    out << std::setw(width) << group.str();
+  };
+
+  out << "\nClassification profiles:\n" << std::string(total_separator_width, '-') << '\n';
+  out << std::left << std::setw(max_filename_width) << "";
+  for (std::size_t k = 0; k < profiles.size(); ++k) {
+    out << std::setw(widths[k]) << profiles[k];
+  }
+  out << '\n' << std::setw(max_filename_width) << "Filename";
+  for (std::size_t k = 0; k < profiles.size(); ++k) {
+    out << std::setw(widths[k]) << "Code      Comments  Doc       Blank";
+  }
+  out << '\n' << std::string(total_separator_width, '-') << '\n';
+
+  std::vector<ProfileCounts> totals(profiles.size());
+  for (const auto& f : files) {
+    out << std::setw(max_filename_width) << relative_basename(f.filename, base_dir);
+    for (std::size_t k = 0; k < profiles.size(); ++k) {
+      ProfileCounts c = k < f.profiles.size() ? f.profiles[k] : ProfileCounts{};
+      print_counts(c, widths[k]);
+      totals[k].n_loc += c.n_loc;
+      totals[k].n_comments += c.n_comments;
+      totals[k].n_doc += c.n_doc;
+      totals[k].n_blank += c.n_blank;
+    }
+    out << '\n';
+  }
+  out << std::string(total_separator_width, '-') << '\n';
+  if (files.size() > 1) {
+    out << std::setw(max_filename_width) << "SUM";
+    for (std::size_t k = 0; k < profiles.size(); ++k) {
+      print_counts(totals[k], widths[k]);
+    }
+    out << '\n' << std::string(total_separator_width, '-') << '\n';
+  }
+}
+
+/**
+ * @brief Prints the documentation coverage of every header with top-level declarations.
+ *
+ * @param files: The files, counted with --doc-coverage.
+ * @param base_dir: Filenames are shown relative to this directory.
+ * @param out: The stream the table is written to.
+ */
+inline void print_doc_coverage(const FileList& files,
+                               const std::string& base_dir,
+                               std::ostream& out = std::cout) {
+  std::vector<const FileInfo*> headers;
+  size_t max_filename_width = 8;
+  count_t documented = 0, undocumented = 0;
+  for (const auto& f : files) {
+    if (f.n_documented + f.n_undocumented == 0)
+      continue;
+    headers.push_back(&f);
+    documented += f.n_documented;
+    undocumented += f.n_undocumented;
+    max_filename_width =
+      std::max(max_filename_width, relative_basename(f.filename, base_dir).size());
+  }
+  max_filename_width += 2;
+  auto coverage = [](count_t doc, count_t undoc) {
+    std::ostringstream oss;
+    oss << std::fixed << std::setprecision(1) << (100.0 * doc / (doc + undoc)) << '%';
+    return oss.str();
+  };
+
+  out << "\nDocumentation coverage of top-level declarations in headers:";
+  if (headers.empty()) {
+    out << " no declarations found.\n";
+    return;
+  }
+  const size_t total_separator_width = max_filename_width + 14 + 16 + 10;
+  out << '\n' << std::string(total_separator_width, '-') << '\n';
+  out << std::left << std::setw(max_filename_width) << "Filename" << std::setw(14)
+      << "Documented" << std::setw(16) << "Undocumented" << "Coverage" << '\n';
+  out << std::string(total_separator_width, '-') << '\n';
+  for (const FileInfo* f : headers) {
+    out << std::setw(max_filename_width) << relative_basename(f->filename, base_dir)
+        << std::setw(14) << f->n_documented << std::setw(16) << f->n_undocumented
+        << coverage(f->n_documented, f->n_undocumented) << '\n';
+  }
+  out << std::string(total_separator_width, '-') << '\n';
+  out << std::setw(max_filename_width) << "SUM" << std::setw(14) << documented << std::setw(16)
+      << undocumented << coverage(documented, undocumented) << '\n';
+  out << std::string(total_separator_width, '-') << '\n';
+}
+
+/**
+ * @brief Prints the Halstead counts and measures of each file, then of each module.
+ *
+ * @param files: The files of the run, counted with --halstead.
+ * @param modules: The counts of each module (directory), see HalsteadModules.
+ * @param n_operands: # of distinct operands in the whole run.
+ * @param base_dir: The base directory, for relative names.
+ * @param out: Where the tables are written.
+ */
+inline void print_halstead(const FileList& files,
+                           const std::map<std::string, HalsteadCounts>& modules,
+                           std::size_t n_operands,
+                           const std::string& base_dir,
+                           std::ostream& out = std::cout) {
+  auto print = [&out](const std::string& title, const std::string& column,
+                      const std::vector<std::pair<std::string, HalsteadCounts>>& rows) {
+    size_t max_name_width = column.size();
+    for (const auto& [name, c] : rows) {
+      max_name_width = std::max(max_name_width, name.size());
+    }
+    max_name_width += 2;
+    const size_t total_separator_width = max_name_width + 4 * 10 + 2 * 12 + 2 * 14;
+    out << '\n' << title << '\n' << std::string(total_separator_width, '-') << '\n';
+    out << std::left << std::setw(max_name_width) << column << std::setw(10) << "n1"
+        << std::setw(10) << "n2" << std::setw(10) << "N1" << std::setw(10) << "N2"
+        << std::setw(12) << "Vocabulary" << std::setw(12) << "Length" << std::setw(14)
+        << "Volume" << "Difficulty" << '\n';
+    out << std::string(total_separator_width, '-') << '\n';
+    for (const auto& [name, c] : rows) {
+      HalsteadMeasures m = halstead_measures(c);
+      out << std::setw(max_name_width) << name << std::setw(10) << c.n_operators
+          << std::setw(10) << c.n_operands << std::setw(10) << c.total_operators
+          << std::setw(10) << c.total_operands << std::setw(12) << m.vocabulary
+          << std::setw(12) << m.length << std::fixed << std::setprecision(1) << std::setw(14)
+          << m.volume << m.difficulty << '\n';
+    }
+    out << std::string(total_separator_width, '-') << '\n';
+  };
+
+  std::vector<std::pair<std::string, HalsteadCounts>> rows;
+  for (const auto& f : files) {
+    rows.emplace_back(relative_basename(f.filename, base_dir), f.halstead);
+  }
+  print("Halstead metrics:", "Filename", rows);
+  rows.clear();
+  for (const auto& [module, c] : modules) {
+    std::string name = relative_basename(module.empty() ? "." : module, base_dir);
+    rows.emplace_back(name.empty() ? "." : name, c);
+  }
+  print("Halstead metrics by module:", "Module", rows);
+  out << "Distinct operands (identifiers, numbers and literals): " << n_operands << '\n';
+}
+
+/**
+ * @brief Prints the complexity of each file, then of each function, most complex first.
+ *
+ * @param files: The files of the run, counted with --complexity.
+ * @param base_dir: The base directory, for relative names.
+ * @param out: Where the tables are written.
+ */
+inline void print_complexity(const FileList& files,
+                             const std::string& base_dir,
+                             std::ostream& out = std::cout) {
+  size_t max_filename_width = 8;
+  ComplexityCounts sum;
+  std::vector<std::pair<std::string, const FunctionComplexity*>> functions;
+  for (const auto& f : files) {
+    std::string name = relative_basename(f.filename, base_dir);
+    max_filename_width = std::max(max_filename_width, name.size());
+    sum.n_functions += f.complexity.n_functions;
+    sum.complexity += f.complexity.complexity;
+    sum.max_complexity = std::max(sum.max_complexity, f.complexity.max_complexity);
+    sum.max_nesting = std::max(sum.max_nesting, f.complexity.max_nesting);
+    for (const auto& fn : f.functions) {
+      functions.emplace_back(name + ':' + std::to_string(fn.line), &fn);
+    }
+  }
+  max_filename_width += 2;
+
+  size_t total_separator_width = max_filename_width + 12 + 13 + 17 + 11;
+  out << "\nCyclomatic complexity:\n" << std::string(total_separator_width, '-') << '\n';
+  out << std::left << std::setw(max_filename_width) << "Filename" << std::setw(12) << "Functions"
+      << std::setw(13) << "Complexity" << std::setw(17) << "Max (function)" << "Max nesting"
+      << '\n';
+  out << std::string(total_separator_width, '-') << '\n';
+  auto row = [&](const std::string& name, const ComplexityCounts& c) {
+    out << std::setw(max_filename_width) << name << std::setw(12) << c.n_functions
+        << std::setw(13) << c.complexity << std::setw(17) << c.max_complexity << c.max_nesting
+        << '\n';
+  };
+  for (const auto& f : files) {
+    row(relative_basename(f.filename, base_dir), f.complexity);
+  }
+  out << std::string(total_separator_width, '-') << '\n';
+  row("SUM", sum);
+  out << std::string(total_separator_width, '-') << '\n';
+
+  if (functions.empty())
+    return;
+  std::stable_sort(functions.begin(), functions.end(), [](const auto& a, const auto& b) {
+    return a.second->complexity > b.second->complexity;
+  });
+  size_t max_location_width = 8, max_function_width = 8;
+  for (const auto& [location, fn] : functions) {
+    max_location_width = std::max(max_location_width, location.size());
+    max_function_width = std::max(max_function_width, fn->name.size());
+  }
+  max_location_width += 2;
+  max_function_width += 2;
+  total_separator_width = max_location_width + max_function_width + 13 + 7;
+  out << "\nFunctions by complexity:\n" << std::string(total_separator_width, '-') << '\n';
+  out << std::setw(max_location_width) << "Location" << std::setw(max_function_width)
+      << "Function" << std::setw(13) << "Complexity" << "Nesting" << '\n';
+  out << std::string(total_separator_width, '-') << '\n';
+  for (const auto& [location, fn] : functions) {
+    out << std::setw(max_location_width) << location << std::setw(max_function_width) << fn->name
+        << std::setw(13) << fn->complexity << fn->max_nesting << '\n';
+  }
+  out << std::string(total_separator_width, '-') << '\n';
+}
+
+/**
+ * @brief Prints the code each translation unit puts through the compiler (`--deps`).
+ *
+ * A unit counts its source and every header it reads, so headers shared by many units count in
+ * each of them; the totals also give the code of the distinct files, each counted once.
+ *
+ * @param units: The units, see unit_counts().
+ * @param n_files: # of distinct files read by the units.
+ * @param unique_loc: Lines of code of those files.
+ * @param base_dir: Sources are shown relative to this directory.
+ * @param out: Where the table is written.
+ */
+inline void print_units(const std::vector<UnitCounts>& units,
+                        std::size_t n_files,
+                        count_t unique_loc,
+                        const std::string& base_dir,
+                        std::ostream& out = std::cout) {
+  size_t max_filename_width = 18;  // "Translation unit"
+  for (const auto& u : units) {
+    max_filename_width = std::max(max_filename_width, relative_basename(u.source, base_dir).size());
+  }
+  max_filename_width += 2;
+  const size_t total_separator_width = max_filename_width + 8 + 21;
+  out << "\nTranslation units: " << units.size() << '\n';
+  out << std::string(total_separator_width, '-') << '\n';
+  out << std::left << std::setw(max_filename_width) << "Translation unit" << std::setw(8)
+      << "Files" << "Code (with #includes)" << '\n';
+  out << std::string(total_separator_width, '-') << '\n';
+  count_t effective_loc = 0;
+  for (const auto& u : units) {
+    out << std::setw(max_filename_width) << relative_basename(u.source, base_dir) << std::setw(8)
+        << u.n_files << u.n_loc << '\n';
+    effective_loc += u.n_loc;
+  }
+  out << std::string(total_separator_width, '-') << '\n';
+  out << std::setw(max_filename_width) << "SUM" << std::setw(8) << "" << effective_loc << '\n';
+  out << std::setw(max_filename_width) << "Distinct files" << std::setw(8) << n_files
+      << unique_loc << '\n';
+  out << std::string(total_separator_width, '-') << '\n';
+}
+
+/**
+ * @brief Prints the lines a patch adds and removes in each file, by category.
+ *
+ * @param files: The files of the patch, see PatchCounter.
+ * @param out: Where the table is written.
+ */
+inline void print_patch(const std::vector<PatchFile>& files, std::ostream& out = std::cout) {
+  size_t max_filename_width = 8;
+  for (const auto& f : files) {
+    max_filename_width = std::max(max_filename_width, f.filename.size() + (f.exact ? 0 : 1));
+  }
+  max_filename_width += 2;
+  auto cell = [](count_t added, count_t removed) {
+    return '+' + std::to_string(added) + " -" + std::to_string(removed);
+  };
+  const size_t total_separator_width = max_filename_width + 12 + 4 * 16;
+  out << "Files touched: " << files.size() << '\n';
+  out << std::string(total_separator_width, '-') << '\n';
+  out << std::left << std::setw(max_filename_width) << "Filename" << std::setw(12) << "Language"
+      << std::setw(16) << "Code" << std::setw(16) << "Comments" << std::setw(16) << "Doc Comments"
+      << "Blank" << '\n';
+  out << std::string(total_separator_width, '-') << '\n';
+  PatchFile sum;
+  bool exact = true;
+  for (const auto& f : files) {
+    out << std::setw(max_filename_width) << (f.exact ? f.filename : f.filename + '*')
+        << std::setw(12) << lang_type_to_string(f.type) << std::setw(16)
+        << cell(f.added.n_loc, f.removed.n_loc) << std::setw(16)
+        << cell(f.added.n_comments, f.removed.n_comments) << std::setw(16)
+        << cell(f.added.n_doc, f.removed.n_doc) << cell(f.added.n_blank, f.removed.n_blank)
+        << '\n';
+    for (auto [total, part] : { std::pair{ &sum.added, &f.added }, { &sum.removed, &f.removed } }) {
+      total->n_loc += part->n_loc;
+      total->n_comments += part->n_comments;
+      total->n_doc += part->n_doc;
+      total->n_blank += part->n_blank;
+    }
+    exact = exact and f.exact;
+  }
+  out << std::string(total_separator_width, '-') << '\n';
+  out << std::setw(max_filename_width + 12) << "SUM" << std::setw(16)
+      << cell(sum.added.n_loc, sum.removed.n_loc) << std::setw(16)
+      << cell(sum.added.n_comments, sum.removed.n_comments) << std::setw(16)
+      << cell(sum.added.n_doc, sum.removed.n_doc) << cell(sum.added.n_blank, sum.removed.n_blank)
+      << '\n';
+  out << std::string(total_separator_width, '-') << '\n';
+  if (!exact) {
+    out << "* The new file was missing or did not match the diff: comment state guessed.\n";
+  }
+}
+
+#endif
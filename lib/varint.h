@@ -0,0 +1,43 @@
+#ifndef VARINT_H
+#define VARINT_H
+
+/*!
+ * @file varint.h
+ * @description
+ * LEB128 varints and zigzag encoding, shared by the compact binary formats.
+ */
+#include <cstdint>
+#include <string>
+
+/// Appends `v` as a LEB128 varint.
+inline void put_varint(std::string& out, std::uint64_t v) {
+  while (v >= 0x80) {
+    out += static_cast<char>((v & 0x7f) | 0x80);
+    v >>= 7;
+  }
+  out += static_cast<char>(v);
+}
+
+/// Reads a varint at `p`, advancing it.
+/// @return false if the input ends before the varint does.
+inline bool get_varint(const char*& p, const char* end, std::uint64_t& v) {
+  v = 0;
+  for (unsigned shift = 0; p != end and shift < 64; shift += 7) {
+    auto byte = static_cast<unsigned char>(*p++);
+    v |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0)
+      return true;
+  }
+  return false;
+}
+
+/// Maps signed differences to small unsigned values: 0, -1, 1, -2, 2... -> 0, 1, 2, 3, 4...
+inline std::uint64_t zigzag(std::int64_t v) {
+  return (static_cast<std::uint64_t>(v) << 1) ^ static_cast<std::uint64_t>(v >> 63);
+}
+
+inline std::int64_t unzigzag(std::uint64_t v) {
+  return static_cast<std::int64_t>(v >> 1) ^ -static_cast<std::int64_t>(v & 1);
+}
+
+#endif
@@ -6,189 +6,159 @@
  * @date	May, 12th 2025.
  */
 #include <algorithm>
+#include <atomic>
 #include <cctype>
 #include <cerrno>
+#include <climits>
+#include <condition_variable>
 #include <cstdint>
+#include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <ctime>
 #include <dirent.h>
 #include <filesystem>
 #include <fstream>
+#include <functional>
 #include <getopt.h>
 #include <iomanip>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <new>
 #include <optional>
+#include <sstream>
 #include <string>
+#include <sys/resource.h>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
-//== Enumerations
-
-/// This enumeration lists all the supported languages.
-enum lang_type_e : std::uint8_t {
-  C = 0,  //!< C language
-  CPP,    //!< C++ language
-  H,      //!< C/C++ header
-  HPP,    //!< C++ header
-  UNDEF,  //!< Undefined type.
-};
+#include "adaptive_pipeline.h"
+#include "arrow_writer.h"
+#include "build_deps.h"
+#include "cancellation.h"
+#include "code_parser.h"
+#include "compdb.h"
+#include "complexity.h"
+#include "doc_coverage.h"
+#include "file_buffer.h"
+#include "file_info.h"
+#include "halstead.h"
+#include "history_archive.h"
+#include "html_report.h"
+#include "license_headers.h"
+#include "line_index.h"
+#include "line_map.h"
+#include "marker_scanner.h"
+#include "profiles.h"
+#include "progress.h"
+#include "mem_stats.h"
+#include "patch_counter.h"
+#include "slocbin.h"
+#include "sqlite_export.h"
+#include "subtree_cache.h"
+#include "table_report.h"
 
-//== Class/Struct declaration
+//== Memory accounting
 
-/// Integer type for counting lines.
-using count_t = unsigned long;
-
-/// Stores the file information we are collecting.
-class FileInfo {
-public:
-  std::string filename;  //!< the filename.
-  lang_type_e type;      //!< the language type.
-  count_t n_blank;       //!< # of blank lines in the file.
-  count_t n_comments;    //!< # of comment lines.
-  count_t n_doc;         //!< # of documentation lines
-  count_t n_loc;         //!< # lines of code.
-  count_t n_lines;       //!< # of lines.
-
-  /// Ctro.
-  FileInfo(std::string fn = "",
-           lang_type_e t = UNDEF,
-           count_t nb = 0,
-           count_t nc = 0,
-           count_t nl = 0,
-           count_t nd = 0,
-           count_t ni = 0)
-      : filename{ std::move(fn) }, type{ t }, n_blank{ nb }, n_comments{ nc }, n_loc{ nl },
-        n_doc{ nd }, n_lines{ ni } {}
+/// Prefix of every block handed out by operator new. Its size keeps the block aligned for any
+/// fundamental type.
+struct alignas(alignof(std::max_align_t)) AllocHeader {
+  std::size_t size;  //!< Bytes charged for this block, 0 if it was allocated with stats off.
+  mem_tag_e tag;     //!< Subsystem the block was charged to.
 };
 
-using FileList = std::vector<FileInfo>;
-
-/// The running options provided via CLI.
-struct RunningOpt {
-  std::vector<std::string> input_list;  //!< This might be a list of filenames or a directories.
-  bool recursive{ false };
-  bool should_order{ false };
-  std::pair<bool, char> ordering_method;  // first = true if -s, false if -S;
-};
-
-/// Those are auxiliar functions, but we need to implement here because we need those available in
-/// the next class scope
-/**
- * @brief Trims whitespace to the left of a string.
- *
- * @param s: The string to trim.
- * @param t: A C-string containing characters to trim (whitespace characters).
- * @return a new string, left-trimmed.
- */
-inline std::string ltrim(const std::string& s, const char* t = " \t\n\r\f\v") {
-  std::string clone{ s };
-  clone.erase(0, clone.find_first_not_of(t));
-  return clone;
+/// Allocates `size` bytes and charges them to the calling thread's subsystem.
+static void* counted_malloc(std::size_t size) noexcept {
+  auto* h = static_cast<AllocHeader*>(std::malloc(sizeof(AllocHeader) + size));
+  if (h == nullptr)
+    return nullptr;
+  h->size = 0;
+  h->tag = mem_tag_e::OTHER;
+  if (mem_stats_enabled().load(std::memory_order_relaxed) and size > 0) {
+    h->size = size;
+    h->tag = current_mem_tag();
+    mem_charge(h->tag, size);
+  }
+  return h + 1;
 }
 
-/**
- * @brief Trims whitespace to the right of a string.
- *
- * @param s: The string to trim.
- * @param t: A C-string containing characters to trim (whitespace characters).
- * @return a new string, right-trimmed.
- */
-inline std::string rtrim(const std::string& s, const char* t = " \t\n\r\f\v") {
-  std::string clone{ s };
-  clone.erase(clone.find_last_not_of(t) + 1);
-  return clone;
+/// Frees a block from counted_malloc(), giving its bytes back to the subsystem it was charged to.
+static void counted_free(void* p) noexcept {
+  if (p == nullptr)
+    return;
+  auto* h = static_cast<AllocHeader*>(p) - 1;
+  if (h->size > 0)
+    mem_release(h->tag, h->size);
+  std::free(h);
 }
 
-/**
- * @brief Trims whitespace on both sides of a string
- *
- * @param s The string to trim.
- * @param t A C-string containing characters to trim (whitespace characters).
- * @return a new string, trimmed from both sides.
- */
-inline std::string trim(const std::string& s, const char* t = " \t\n\r\f\v") {
-  return rtrim(ltrim(s, t), t);
+void* operator new(std::size_t size) {
+  if (void* p = counted_malloc(size))
+    return p;
+  throw std::bad_alloc();
 }
+void* operator new[](std::size_t size) {
+  if (void* p = counted_malloc(size))
+    return p;
+  throw std::bad_alloc();
+}
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+  return counted_malloc(size);
+}
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+  return counted_malloc(size);
+}
+void operator delete(void* p) noexcept { counted_free(p); }
+void operator delete[](void* p) noexcept { counted_free(p); }
+void operator delete(void* p, std::size_t) noexcept { counted_free(p); }
+void operator delete[](void* p, std::size_t) noexcept { counted_free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { counted_free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { counted_free(p); }
 
-/// Class to parse each line, store the current state and the results.
-class CodeParser {
-private:
-  int blank_lines = 0;
-  int code_lines = 0;
-  int comment_lines = 0;
-  int doc_comment_lines = 0;
-
-  bool in_block_comment = false;
-  bool in_doc_block_comment = false;
-
-public:
-  void parse_line(const std::string& line) {
-    std::string trimmed = trim(line);
-    if (trimmed.empty()) {
-      blank_lines++;
-      return;
-    }
-
-    bool is_doc_line = false;
-    bool is_comment_line = false;
-    bool inside_string = false;
-    bool inside_char = false;
-    size_t i = 0;
-
-    // Check for Doxygen single-line comments (/// or //!)
-    if (trimmed.compare(0, 3, "///") == 0 || trimmed.compare(0, 3, "//!") == 0) {
-      doc_comment_lines++;
-      return;
-    }
-
-    // Check for Doxygen block starters (/** or /*!)
-    if (trimmed.compare(0, 3, "/**") == 0 || trimmed.compare(0, 3, "/*!") == 0) {
-      doc_comment_lines++;
-      in_doc_block_comment = true;
-      return;
-    }
-
-    // Handle in-progress Doxygen block
-    if (in_doc_block_comment) {
-      doc_comment_lines++;
-      if (trimmed.find("*/") != std::string::npos) {
-        in_doc_block_comment = false;
-      }
-      return;
-    }
-
-    // Regular comment handling (/* ... */ or //)
-    if (in_block_comment) {
-      comment_lines++;
-      if (trimmed.find("*/") != std::string::npos) {
-        in_block_comment = false;
-      }
-      return;
-    }
-
-    // Check for regular single-line comments (//)
-    if (trimmed.compare(0, 2, "//") == 0) {
-      comment_lines++;
-      return;
-    }
+//== Enumerations
 
-    // Check for regular block comments (/*)
-    if (trimmed.compare(0, 2, "/*") == 0) {
-      comment_lines++;
-      if (trimmed.find("*/", 2) == std::string::npos) {
-        in_block_comment = true;
-      }
-      return;
-    }
+/// The output formats sloc can produce.
+enum output_format_e : std::uint8_t {
+  FMT_TABLE = 0,  //!< Formatted text table.
+  FMT_ARROW,      //!< Arrow IPC stream.
+  FMT_SLOCBIN,    //!< Indexed binary result file, see slocbin.h.
+  FMT_HTML,       //!< Self-contained HTML treemap, see html_report.h.
+};
 
-    // If none of the above, it's code
-    code_lines++;
-  }
+//== Class/Struct declaration
 
-  int get_blank_lines() const { return blank_lines; }
-  int get_code_lines() const { return code_lines; }
-  int get_comment_lines() const { return comment_lines; }
-  int get_doc_comment_lines() const { return doc_comment_lines; }
+/// The running options provided via CLI.
+struct RunningOpt {
+  std::vector<std::string> input_list;  //!< This might be a list of filenames or a directories.
+  bool recursive{ false };
+  bool should_order{ false };
+  std::pair<bool, char> ordering_method;  // first = true if -s, false if -S;
+  bool huge_pages{ false };               //!< Back large file buffers with 2 MB pages.
+  unsigned n_jobs{ 1 };                   //!< # of threads reading and parsing files.
+  bool adaptive_jobs{ false };            //!< -j auto: tune readers and parsers at runtime.
+  bool stats{ false };                    //!< Print resource usage to stderr at the end.
+  bool progress{ false };                 //!< Show a live progress line on stderr.
+  std::string sqlite_path;                //!< Append the results to this SQLite database.
+  std::string history_path;               //!< Append the results to this history archive.
+  std::vector<std::string> markers;       //!< Markers to count in comment lines.
+  bool licenses{ false };                 //!< Count license headers apart from comments.
+  std::vector<ProfileRules> profiles;     //!< Extra classification profiles to count.
+  bool doc_coverage{ false };             //!< Check which declarations of headers have docs.
+  bool halstead{ false };                 //!< Count Halstead operators and operands.
+  bool complexity{ false };               //!< Cyclomatic complexity and nesting per function.
+  std::uint32_t line_index{ 0 };          //!< Lines between parser checkpoints; 0 for none.
+  std::string line_map_path;              //!< Write the category of every line to this file.
+  std::string compdb_path;                //!< Also count the files of this compilation database.
+  std::string deps_dir;                   //!< Also count the files built, per its .d/ninja deps.
+  std::string cache_path;                 //!< Reuse the counts of unchanged directories.
+  bool cache_trust_dirs{ false };         //!< Reuse files of unchanged dirs without a stat.
+  double deadline{ 0 };                   //!< Seconds until the run stops; 0 for no deadline.
+  output_format_e format{ FMT_TABLE };    //!< What is written to the output.
+  std::string output_path;                //!< Where the output goes; empty for stdout.
 };
 
 //== Aux functions
@@ -207,7 +177,17 @@ void usage(const std::string& message = "") {
     << "NAME\n"
     << "  sloc - single line of code counter.\n\n"
     << "SYNOPSIS\n"
-    << "  sloc [-h | --help] [-r] [(-s | -S) f|t|c|b|s|a] <file | directory>\n\n"
+    << "  sloc [-h | --help] [-r] [(-s | -S) f|t|c|b|s|a] [-j N|auto] [--huge-pages] [--stats]\n"
+    << "       [--progress] [--deadline S] [--sqlite out.db] [--history archive] [--licenses]\n"
+    << "       [--markers TODO,FIXME,...] [--doc-coverage] [--halstead] [--complexity]\n"
+    << "       [--profile default,no-braces+doc-as-comment,no-license,...]\n"
+    << "       [--format table|arrow|slocbin|html] [--line-index K] [--emit-line-map lines.map]\n"
+    << "       [-o file] [--cache sloc.cache [--cache-trust-dirs]]\n"
+    << "       (<file | directory> | --compdb build/compile_commands.json | --deps build)\n"
+    << "  sloc query <results.slocbin> [(-s | -S) f|t|c|d|b|s|a] [--top N] [--prefix P]\n"
+    << "       [--path P [--lines FIRST-LAST]]\n"
+    << "  sloc history <archive> [--snapshot N | --series PATH]\n"
+    << "  sloc --patch [-p N] [directory] < change.diff\n\n"
     << "EXAMPLES\n"
     << "  sloc main.cpp sloc.cpp\n"
     << "     Counts loc, comments, blanks of the source files 'main.cpp' and 'sloc.cpp'\n\n"
@@ -252,9 +232,54 @@ void validate_arguments(int argc, char* argv[], RunningOpt& run_options) {
   int c;
   int option_index{ 0 };
 
-  static struct option long_options[] = { { "help", no_argument, 0, 'h' }, { 0, 0, 0, 0 } };
+  // Long-only options get codes outside the range of the short ones.
+  enum long_opt_e : int {
+    OPT_HUGE_PAGES = 256,
+    OPT_STATS,
+    OPT_PROGRESS,
+    OPT_SQLITE,
+    OPT_HISTORY,
+    OPT_MARKERS,
+    OPT_LICENSES,
+    OPT_PROFILE,
+    OPT_DOC_COVERAGE,
+    OPT_HALSTEAD,
+    OPT_COMPLEXITY,
+    OPT_LINE_INDEX,
+    OPT_LINE_MAP,
+    OPT_COMPDB,
+    OPT_DEPS,
+    OPT_CACHE,
+    OPT_CACHE_TRUST_DIRS,
+    OPT_DEADLINE,
+    OPT_FORMAT,
+  };
+  static struct option long_options[] = { { "help", no_argument, 0, 'h' },
+                                          { "jobs", required_argument, 0, 'j' },
+                                          { "huge-pages", no_argument, 0, OPT_HUGE_PAGES },
+                                          { "stats", no_argument, 0, OPT_STATS },
+                                          { "progress", no_argument, 0, OPT_PROGRESS },
+                                          { "sqlite", required_argument, 0, OPT_SQLITE },
+                                          { "history", required_argument, 0, OPT_HISTORY },
+                                          { "markers", required_argument, 0, OPT_MARKERS },
+                                          { "licenses", no_argument, 0, OPT_LICENSES },
+                                          { "profile", required_argument, 0, OPT_PROFILE },
+                                          { "doc-coverage", no_argument, 0, OPT_DOC_COVERAGE },
+                                          { "halstead", no_argument, 0, OPT_HALSTEAD },
+                                          { "complexity", no_argument, 0, OPT_COMPLEXITY },
+                                          { "line-index", required_argument, 0, OPT_LINE_INDEX },
+                                          { "emit-line-map", required_argument, 0, OPT_LINE_MAP },
+                                          { "compdb", required_argument, 0, OPT_COMPDB },
+                                          { "deps", required_argument, 0, OPT_DEPS },
+                                          { "cache", required_argument, 0, OPT_CACHE },
+                                          { "cache-trust-dirs", no_argument, 0,
+                                            OPT_CACHE_TRUST_DIRS },
+                                          { "deadline", required_argument, 0, OPT_DEADLINE },
+                                          { "format", required_argument, 0, OPT_FORMAT },
+                                          { "output", required_argument, 0, 'o' },
+                                          { 0, 0, 0, 0 } };
 
-  while ((c = getopt_long(argc, argv, "hrs:S:", long_options, &option_index)) != -1) {
+  while ((c = getopt_long(argc, argv, "hrs:S:j:o:", long_options, &option_index)) != -1) {
     switch (c) {
     case 'h':
       usage("");
@@ -272,6 +297,112 @@ void validate_arguments(int argc, char* argv[], RunningOpt& run_options) {
       }
       run_options.ordering_method.second = optarg[0];
       break;
+    case 'j': {
+      if (strcmp(optarg, "auto") == 0) {
+        run_options.adaptive_jobs = true;
+        run_options.n_jobs = std::max(1u, std::thread::hardware_concurrency());
+        break;
+      }
+      char* end = nullptr;
+      long n = std::strtol(optarg, &end, 10);
+      if (end == optarg or *end != '\0' or n < 0) {
+        usage("Invalid number of jobs for -j");
+        break;
+      }
+      run_options.n_jobs = n == 0 ? std::max(1u, std::thread::hardware_concurrency())
+                                  : static_cast<unsigned>(n);
+      break;
+    }
+    case OPT_HUGE_PAGES:
+      run_options.huge_pages = true;
+      break;
+    case OPT_STATS:
+      run_options.stats = true;
+      break;
+    case OPT_PROGRESS:
+      run_options.progress = true;
+      break;
+    case OPT_SQLITE:
+      run_options.sqlite_path = optarg;
+      break;
+    case OPT_HISTORY:
+      run_options.history_path = optarg;
+      break;
+    case OPT_MARKERS: {
+      std::istringstream list{ optarg };
+      for (std::string marker; std::getline(list, marker, ',');) {
+        if (!marker.empty())
+          run_options.markers.push_back(marker);
+      }
+      if (run_options.markers.empty())
+        usage("Please, provide a comma-separated list of markers for --markers");
+      break;
+    }
+    case OPT_LICENSES:
+      run_options.licenses = true;
+      break;
+    case OPT_PROFILE:
+      if (!parse_profiles(optarg, run_options.profiles))
+        usage("Invalid profile for --profile (rules: default, no-braces, doc-as-comment, "
+              "no-license)");
+      break;
+    case OPT_DOC_COVERAGE:
+      run_options.doc_coverage = true;
+      break;
+    case OPT_HALSTEAD:
+      run_options.halstead = true;
+      break;
+    case OPT_COMPLEXITY:
+      run_options.complexity = true;
+      break;
+    case OPT_LINE_INDEX: {
+      char* end = nullptr;
+      unsigned long k = std::strtoul(optarg, &end, 10);
+      if (end == optarg or *end != '\0' or optarg[0] == '-' or k == 0 or k > UINT32_MAX)
+        usage("Please, provide a positive # of lines for --line-index");
+      run_options.line_index = static_cast<std::uint32_t>(k);
+      break;
+    }
+    case OPT_LINE_MAP:
+      run_options.line_map_path = optarg;
+      break;
+    case OPT_COMPDB:
+      run_options.compdb_path = optarg;
+      break;
+    case OPT_DEPS:
+      run_options.deps_dir = optarg;
+      break;
+    case OPT_CACHE:
+      run_options.cache_path = optarg;
+      break;
+    case OPT_CACHE_TRUST_DIRS:
+      run_options.cache_trust_dirs = true;
+      break;
+    case OPT_DEADLINE: {
+      char* end = nullptr;
+      run_options.deadline = std::strtod(optarg, &end);
+      if (end == optarg or *end != '\0' or !(run_options.deadline > 0)
+          or run_options.deadline > 1e8) {
+        usage("Please, provide a positive # of seconds for --deadline");
+      }
+      break;
+    }
+    case OPT_FORMAT:
+      if (strcmp(optarg, "table") == 0) {
+        run_options.format = FMT_TABLE;
+      } else if (strcmp(optarg, "arrow") == 0) {
+        run_options.format = FMT_ARROW;
+      } else if (strcmp(optarg, "slocbin") == 0) {
+        run_options.format = FMT_SLOCBIN;
+      } else if (strcmp(optarg, "html") == 0) {
+        run_options.format = FMT_HTML;
+      } else {
+        usage("Invalid output format for --format");
+      }
+      break;
+    case 'o':
+      run_options.output_path = optarg;
+      break;
     default:
       usage("Invalid option");
       break;
@@ -280,8 +411,20 @@ void validate_arguments(int argc, char* argv[], RunningOpt& run_options) {
   for (int i = optind; i < argc; ++i) {
     run_options.input_list.emplace_back(argv[i]);
   }
-  if (run_options.input_list.empty())
+  if (run_options.input_list.empty() and run_options.compdb_path.empty()
+      and run_options.deps_dir.empty())
     usage("Please, provide a source file or directory");
+  if (run_options.line_index != 0 and run_options.format != FMT_SLOCBIN)
+    usage("--line-index is stored in the slocbin output; use it with --format slocbin");
+  if (run_options.cache_trust_dirs and run_options.cache_path.empty())
+    usage("--cache-trust-dirs only applies to --cache");
+  if (!run_options.cache_path.empty()
+      and (!run_options.markers.empty() or run_options.licenses or !run_options.profiles.empty()
+           or run_options.doc_coverage or run_options.halstead or run_options.complexity
+           or run_options.line_index != 0 or !run_options.line_map_path.empty())) {
+    usage("--cache keeps the line counts only; it cannot be combined with options that read "
+          "more from each file");
+  }
 }
 
 /**
@@ -315,30 +458,6 @@ std::optional<lang_type_e> id_lang_type(const std::string& filename) {
   return std::nullopt;
 }
 
-/**
- * @brief Converts a language type enum to its corresponding string representation, to be printed
- * later.
- *
- * @param type: The language type enum value
- * @return a string representing the name of the language.
- */
-std::string lang_type_to_string(lang_type_e type) {
-  switch (type) {
-  case C:
-    return "C";
-  case CPP:
-    return "C++";
-  case H:
-    return "C Header";
-  case HPP:
-    return "C++ Header";
-  case UNDEF:
-    return "Unknown";
-  default:
-    return "Invalid";
-  }
-}
-
 /**
  * @brief Converts a string to lowercase.
  *
@@ -358,44 +477,170 @@ std::string to_lower(const std::string& str) {
  * This function traverses the provided list of paths. If a path is a directory,
  * it will recursively or non-recursively collect file names depending on the
  * recursive_search flag, collecting the supported files.
+ * The walk ends early once stop_requested().
  *
  * @param src_list: A list of file or directory paths to search through.
  * @param recursive_search: If true, searches directories recursively.
+ * @param cache: If not null, directories are walked through it, see subtree_cache.h.
  * @return a list of FileInfo objects representing the supported source files.
  */
-FileList create_list_of_src_files(const std::vector<std::string>& src_list, bool recursive_search) {
+FileList create_list_of_src_files(const std::vector<std::string>& src_list,
+                                  bool recursive_search,
+                                  SubtreeCache* cache = nullptr) {
+  MemScope scope{ mem_tag_e::TRAVERSAL };
   FileList file_list;
+  // Filenames outlive the walk, so they are charged apart from its temporaries.
+  auto add_file = [&file_list](const std::filesystem::path& path, lang_type_e type) {
+    MemScope paths{ mem_tag_e::PATHS };
+    file_list.emplace_back(path.string(), type);
+    progress_counters().discovered.fetch_add(1, std::memory_order_relaxed);
+  };
   // Traverse source list
   for (const auto& item : src_list) {
     // If it's directory, let us collect file names
-    if (std::filesystem::is_directory(item) and recursive_search) {
+    if (std::filesystem::is_directory(item) and cache != nullptr) {
+      cache->walk(item, recursive_search, file_list);
+    } else if (std::filesystem::is_directory(item) and recursive_search) {
       // Iterates over all the entries
       for (auto const& dir_entry : std::filesystem::recursive_directory_iterator{ item }) {
+        if (stop_requested())
+          break;
         // Get language type based on the file extension.
         auto lang_type = id_lang_type(to_lower(dir_entry.path().string()));
         if (lang_type.has_value()) {
-          file_list.emplace_back(dir_entry.path(), lang_type.value());
+          add_file(dir_entry.path(), lang_type.value());
         }
       }
     } else if (std::filesystem::is_directory(item)) {
       // Non recursive directory
       for (auto const& dir_entry : std::filesystem::directory_iterator{ item }) {
+        if (stop_requested())
+          break;
         // Get language type
         auto lang_type = id_lang_type(to_lower(dir_entry.path().string()));
         if (lang_type.has_value()) {
-          file_list.emplace_back(dir_entry.path(), lang_type.value());
+          add_file(dir_entry.path(), lang_type.value());
         }
       }
     } else if (std::filesystem::is_regular_file(item)) {
       auto lang_type = id_lang_type(to_lower(item));
       if (lang_type.has_value()) {
-        file_list.emplace_back(item, lang_type.value());
+        add_file(item, lang_type.value());
       }
     }
   }
   return file_list;
 }
 
+/**
+ * @brief Appends the translation units of a compilation database to a list of source files.
+ *
+ * Each file is listed once, however many entries the database has for it, and files already in
+ * the list (given on the command line too) are not added again. Files of languages sloc does
+ * not count are skipped.
+ *
+ * @param compdb: The compile_commands.json file.
+ * @param file_list: The list to append to.
+ * @param stats: Print what was read to stderr.
+ * @return false if the database could not be read.
+ */
+bool add_compdb_files(const std::string& compdb, FileList& file_list, bool stats) {
+  MemScope scope{ mem_tag_e::TRAVERSAL };
+  std::size_t n_skipped = 0, n_listed = 0;
+  // The database usually has absolute paths, the command line relative ones.
+  std::unordered_set<std::string> listed;
+  for (const auto& f : file_list) {
+    listed.insert(deps_key(f.filename));
+  }
+  CompdbStats compdb_stats;
+  std::string error;
+  bool ok = read_compdb(
+    compdb,
+    [&](const std::string& path) {
+      auto lang_type = id_lang_type(to_lower(path));
+      if (!lang_type.has_value()) {
+        n_skipped++;
+        return;
+      }
+      if (listed.count(deps_key(path)) != 0) {
+        n_listed++;
+        return;
+      }
+      MemScope paths{ mem_tag_e::PATHS };
+      file_list.emplace_back(path, lang_type.value());
+    },
+    compdb_stats, error);
+  if (!ok) {
+    std::cerr << "[ERROR] " << error << '\n';
+    return false;
+  }
+  if (stats) {
+    std::cerr << "compdb: " << compdb_stats.n_entries << " entries, "
+              << compdb_stats.n_entries - compdb_stats.n_duplicates << " files, "
+              << compdb_stats.n_duplicates << " duplicates, " << n_listed << " already listed, "
+              << n_skipped << " skipped (not C/C++)\n";
+  }
+  return true;
+}
+
+/**
+ * @brief Appends the files a build read, per its dependency files, to a list of source files.
+ *
+ * Files already in the list, or read by several translation units, are listed once. Files
+ * that no longer exist are left out. Headers without a known extension (e.g. <vector>) count as
+ * C++ headers.
+ *
+ * @param build_dir: The build directory, with .d files or a .ninja_deps log.
+ * @param file_list: The list to append to.
+ * @param graph: Receives the translation units of the build.
+ * @param file_index: Receives, for each file of `graph`, its index in `file_list`, or -1.
+ * @param stats: Print what was read to stderr.
+ * @return false if the dependencies could not be read.
+ */
+bool add_deps_files(const std::string& build_dir,
+                    FileList& file_list,
+                    DepsGraph& graph,
+                    std::vector<std::int64_t>& file_index,
+                    bool stats) {
+  MemScope scope{ mem_tag_e::TRAVERSAL };
+  std::string error;
+  if (!graph.read_build_dir(build_dir, error)) {
+    std::cerr << "[ERROR] " << error << '\n';
+    return false;
+  }
+  std::unordered_map<std::string, std::int64_t> listed;
+  for (std::size_t i = 0; i < file_list.size(); ++i) {
+    listed.emplace(deps_key(file_list[i].filename), i);
+  }
+  std::vector<bool> is_source(graph.files().size(), false);
+  for (const auto& unit : graph.units()) {
+    is_source[unit.inputs.front()] = true;
+  }
+  std::size_t n_missing = 0;
+  file_index.assign(graph.files().size(), -1);
+  for (std::size_t id = 0; id < graph.files().size(); ++id) {
+    const std::string& path = graph.files()[id];
+    if (auto it = listed.find(path); it != listed.end()) {
+      file_index[id] = it->second;
+      continue;
+    }
+    std::error_code ec;
+    if (!std::filesystem::is_regular_file(path, ec)) {
+      n_missing++;
+      continue;
+    }
+    auto lang_type = id_lang_type(to_lower(path));
+    file_index[id] = static_cast<std::int64_t>(file_list.size());
+    MemScope paths{ mem_tag_e::PATHS };
+    file_list.emplace_back(path, lang_type.value_or(is_source[id] ? CPP : HPP));
+  }
+  if (stats) {
+    std::cerr << "deps: " << graph.units().size() << " translation units, "
+              << graph.files().size() << " files, " << n_missing << " missing\n";
+  }
+  return true;
+}
+
 /**
  * @brief Sorts a list of source files based on a specified criterion and order, passed by the user.
  *
@@ -438,165 +683,644 @@ void sort_files(FileList& files, const std::pair<bool, char>& method) {
   std::sort(files.begin(), files.end(), comp);
 }
 
+/// Receives, in file order, ranges [begin, end) of files whose counters are final.
+using BatchSink = std::function<void(std::size_t begin, std::size_t end)>;
+
 /**
- * @brief Extracts the relative basename from a full file path.
+ * @brief Reads and classifies every file in the list, filling in its counters.
+ *
+ * Files are handed out to the worker threads through a shared index. Each worker keeps its own
+ * FileBuffer, so read buffers are reused across all the files it parses.
+ *
+ * If a sink is given, the list is split in batches of `batch_size` files, and the sink is
+ * called on the calling thread with each batch, in order, as soon as all its files are counted.
+ *
+ * With an adaptive pipeline (-j auto), files are read and parsed by separate threads instead,
+ * see adaptive_pipeline.h.
  *
- * This is important for the formatting of the output table to be presented.
+ * Once stop_requested(), no new file is started; the files being parsed are finished. Only the
+ * files flagged FileInfo::counted then have their counters, and the sink never gets the
+ * batches that were left incomplete.
  *
- * @param full_path: The full path to the file.
- * @param base_dir: The base directory.
- * @return the new path.
+ * @param files: The list of files to count.
+ * @param run_options: The running options (# of jobs, huge pages, markers, licenses,
+ * profiles, doc coverage, Halstead, complexity, line index, line map).
+ * @param headers: With --licenses (or a no-license profile), receives the leading comment
+ * block of each file.
+ * @param modules: With --halstead, receives the Halstead counts of each directory.
+ * @param sink: Optional consumer of finished batches.
+ * @param batch_size: # of files per batch given to the sink.
+ * @param adaptive: Optional read/parse pipeline to run the files through.
+ * @return true if every file could be read, false otherwise.
  */
+bool count_files(FileList& files,
+                 const RunningOpt& run_options,
+                 std::vector<HeaderFingerprint>& headers,
+                 HalsteadModules& modules,
+                 const BatchSink& sink = {},
+                 std::size_t batch_size = 1,
+                 AdaptivePipeline* adaptive = nullptr) {
+  std::atomic<std::size_t> next{ 0 };
+  std::atomic<bool> all_read{ true };
 
-std::string relative_basename(const std::string &full_path, const std::string &base_dir) {
-    std::filesystem::path full(full_path);
-    std::filesystem::path base(base_dir);
-    std::error_code ec;
-    std::filesystem::path rel = std::filesystem::relative(full, base, ec);
-    if (!ec) {
-        return rel.string();
+  // Files still pending in each batch; whoever counts the last one hands the batch over.
+  std::size_t n_batches = sink ? (files.size() + batch_size - 1) / batch_size : 0;
+  std::unique_ptr<std::atomic<std::size_t>[]> pending{ new std::atomic<std::size_t>[n_batches] };
+  for (std::size_t b = 0; b < n_batches; ++b) {
+    pending[b] = std::min(batch_size, files.size() - b * batch_size);
+  }
+  std::size_t n_threads = std::min<std::size_t>(run_options.n_jobs, files.size());
+  // Batches are handed over as they complete on a single thread, by this thread otherwise.
+  const bool in_order = n_threads <= 1 and adaptive == nullptr;
+  std::atomic<std::size_t> running{ adaptive ? 1 : std::max<std::size_t>(n_threads, 1) };
+  std::mutex batch_mutex;
+  std::condition_variable batch_done;
+  const MarkerScanner markers{ run_options.markers };
+  const ProfileCounter profiles{ run_options.profiles };
+  const bool fingerprint = run_options.licenses or profiles.needs_licenses();
+  if (fingerprint)
+    headers.assign(files.size(), HeaderFingerprint{});
+
+  // Marks file `i` as counted; whoever counts the last file of a batch hands it over.
+  auto counted = [&](std::size_t i) {
+    files[i].counted = true;
+    progress_counters().counted.fetch_add(1, std::memory_order_relaxed);
+    if (sink and --pending[i / batch_size] == 0) {
+      if (in_order) {
+        // Single thread: batches complete in order, hand them over right away.
+        std::size_t b = i / batch_size;
+        sink(b * batch_size, std::min(files.size(), (b + 1) * batch_size));
+      } else {
+        std::lock_guard<std::mutex> lock{ batch_mutex };
+        batch_done.notify_one();
+      }
+    }
+  };
+
+  // Classifies the lines of file `i`, whose contents are `text`, filling in its counters.
+  auto count_one = [&](std::size_t i, std::string_view text, std::string& line) {
+    FileInfo& file = files[i];
+    progress_counters().bytes.fetch_add(text.size(), std::memory_order_relaxed);
+    CodeParser parser;
+    const bool doc_coverage = run_options.doc_coverage and (file.type == H or file.type == HPP);
+    if (markers.empty() and !fingerprint and profiles.empty() and !doc_coverage
+        and !run_options.halstead and !run_options.complexity
+        and run_options.line_index == 0 and run_options.line_map_path.empty()) {
+      for_each_line(text, [&](std::string_view l) {
+        line.assign(l);
+        parser.parse_line(line);
+      });
     } else {
-        return full.string();
+      // Markers are looked for in the comments the parser found, the leading
+      // comment block is fingerprinted, the profiles are counted, the declarations of
+      // headers are checked for docs, the code lines are tokenized and scanned for decision
+      // points, the parser state is checkpointed and the line map filled, in the same pass.
+      HeaderScanner header;
+      DocCoverageScanner declarations;
+      HalsteadScanner tokens{ modules.table() };
+      ComplexityScanner complexity;
+      LineIndexBuilder checkpoints{ std::max<std::uint32_t>(run_options.line_index, 1) };
+      const char* base = text.data();
+      const bool line_map = !run_options.line_map_path.empty();
+      count_t line_no = 0;
+      bool in_header = fingerprint;
+      file.n_markers.assign(markers.markers().size(), 0);
+      file.profiles.assign(run_options.profiles.size(), ProfileCounts{});
+      for_each_line(text, [&](std::string_view l) {
+        line.assign(l);
+        line_category_e category = parser.parse_line(line);
+        if (!markers.empty() and (category == LINE_COMMENT or category == LINE_DOC))
+          markers.scan(l, file.n_markers.data());
+        else if (!markers.empty() and category == LINE_CODE)
+          markers.scan_code(l, file.n_markers.data());
+        if (in_header)
+          in_header = header.add(l, category, parser.in_comment());
+        if (!profiles.empty())
+          profiles.add(file.profiles.data(), l, category);
+        if (doc_coverage)
+          declarations.add(l, category);
+        if (run_options.halstead and category == LINE_CODE)
+          tokens.add(l);
+        if (run_options.complexity)
+          complexity.add(l, category);
+        if (run_options.line_index != 0)
+          checkpoints.add(static_cast<std::uint64_t>(l.data() + l.size() + 1 - base),
+                          parser.state());
+        if (line_map)
+          append_line_category(file.line_map, line_no++, category);
+      });
+      file.n_documented = declarations.documented();
+      file.n_undocumented = declarations.undocumented();
+      if (fingerprint)
+        headers[i] = header.fingerprint();
+      if (run_options.halstead) {
+        file.halstead = tokens.counts();
+        modules.add(std::filesystem::path{ file.filename }.parent_path().string(), tokens);
+      }
+      if (run_options.complexity) {
+        file.complexity = complexity.counts();
+        file.functions = std::move(complexity.functions());
+      }
+      file.line_index = std::move(checkpoints.index());
+      if (run_options.line_index != 0) {
+        file.indexed_size = text.size();
+        file.indexed_hash = content_hash(text);
+      }
     }
+
+    file.n_blank = parser.get_blank_lines();
+    file.n_comments = parser.get_comment_lines();
+    file.n_doc = parser.get_doc_comment_lines();
+    file.n_loc = parser.get_code_lines();
+    file.n_lines = file.n_blank + file.n_comments + file.n_doc + file.n_loc;
+    counted(i);
+  };
+
+  auto worker = [&]() {
+    MemScope scope{ mem_tag_e::PARSE };
+    FileBuffer buffer{ run_options.huge_pages };
+    std::string line;
+    for (std::size_t i = next++; i < files.size() and all_read and !stop_requested();
+         i = next++) {
+      if (files[i].cached) {
+        counted(i);
+        continue;
+      }
+      if (!buffer.load(files[i].filename)) {
+        all_read = false;
+        break;
+      }
+      count_one(i, buffer.view(), line);
+    }
+    std::lock_guard<std::mutex> lock{ batch_mutex };
+    --running;
+    batch_done.notify_one();
+  };
+
+  // The files to read when they go through the pipeline; cached ones are done already.
+  std::vector<std::size_t> to_read;
+  auto run_pipeline = [&]() {
+    bool ok = adaptive->run(
+      to_read.size(),
+      [&](std::size_t k) -> const std::string& { return files[to_read[k]].filename; },
+      [&](std::size_t k, std::string_view text) {
+        thread_local std::string line;
+        count_one(to_read[k], text, line);
+      });
+    if (!ok)
+      all_read = false;
+    std::lock_guard<std::mutex> lock{ batch_mutex };
+    --running;
+    batch_done.notify_one();
+  };
+
+  if (in_order) {
+    worker();
+  } else {
+    std::vector<std::thread> pool;
+    if (adaptive != nullptr) {
+      for (std::size_t i = 0; i < files.size(); ++i) {
+        if (files[i].cached)
+          counted(i);
+        else
+          to_read.push_back(i);
+      }
+      pool.emplace_back(run_pipeline);
+    }
+    for (std::size_t t = 0; adaptive == nullptr and t < n_threads; ++t) {
+      pool.emplace_back(worker);
+    }
+    for (std::size_t b = 0; b < n_batches; ++b) {
+      {
+        std::unique_lock<std::mutex> lock{ batch_mutex };
+        batch_done.wait(lock, [&] { return pending[b] == 0 or running == 0; });
+      }
+      if (pending[b] != 0)
+        break;  // a file could not be read, the workers gave up
+      sink(b * batch_size, std::min(files.size(), (b + 1) * batch_size));
+    }
+    for (auto& th : pool) {
+      th.join();
+    }
+  }
+  return all_read;
 }
 
 /**
- * @brief Prints a formatted table with information about each file.
+ * @brief Formats a byte count with a binary unit, e.g. "12.5 MiB".
  *
- * Displays the following columns for each file:
- * - Filename
- * - Language
- * - Number of comments (and percentage)
- * - Number of documentation comments (and percentage)
- * - Number of blank lines (and percentage)
- * - Number of lines of code (and percentage)
- * - Total number of lines
+ * @param bytes: The number of bytes.
+ * @return the formatted string.
+ */
+std::string format_bytes(std::size_t bytes) {
+  const char* units[] = { "B", "KiB", "MiB", "GiB", "TiB" };
+  double value = static_cast<double>(bytes);
+  int u = 0;
+  while (value >= 1024 and u < 4) {
+    value /= 1024;
+    ++u;
+  }
+  std::ostringstream oss;
+  oss << std::fixed << std::setprecision(u == 0 ? 0 : 1) << value << ' ' << units[u];
+  return oss.str();
+}
+
+/**
+ * @brief Prints the memory charged to each subsystem and the peak RSS of the process.
  *
- * @param files: The list of files to display.
+ * @param out: The stream the report is written to.
  */
-void print_table(const FileList& files, const std::string &base_dir) {
-  if (files.empty()) {
-    std::cout << "No files processed.\n";
-    return;
+void print_mem_stats(std::ostream& out) {
+  out << "Memory by subsystem:\n"
+      << std::left << std::setw(16) << "Subsystem" << std::setw(14) << "Current" << std::setw(14)
+      << "Peak" << std::setw(14) << "Allocated" << "Allocations\n";
+  for (std::size_t t = 0; t < static_cast<std::size_t>(mem_tag_e::N_TAGS); ++t) {
+    const auto& c = mem_counters()[t];
+    out << std::left << std::setw(16) << mem_tag_to_string(static_cast<mem_tag_e>(t))
+        << std::setw(14) << format_bytes(c.current) << std::setw(14) << format_bytes(c.peak)
+        << std::setw(14) << format_bytes(c.total) << c.allocations << '\n';
   }
+  struct rusage usage {};
+  ::getrusage(RUSAGE_SELF, &usage);
+  // ru_maxrss is in KiB on Linux.
+  out << "Peak RSS: " << format_bytes(static_cast<std::size_t>(usage.ru_maxrss) * 1024) << '\n';
+}
 
-  // Calculate maximum filename width using the relative path
-  size_t max_filename_width = 0;
-  for (const auto& f : files) {
-    std::string relName = relative_basename(f.filename, base_dir);
-    max_filename_width = std::max(max_filename_width, relName.size());
-  }
-  max_filename_width = std::max(max_filename_width, static_cast<size_t>(8)); // "Filename" header
-
-  const size_t sum_fixed_widths = 12 + 15 + 17 + 12 + 12 + 12;
-  const size_t total_separator_width = max_filename_width + sum_fixed_widths;
-  
-  std::cout << "Files processed: " << files.size() << '\n';
-  std::cout << std::string(total_separator_width, '-') << '\n';
-  
-  // Print table header
-  std::cout << std::left
-            << std::setw(max_filename_width) << "Filename"
-            << std::setw(12) << "Language"
-            << std::setw(15) << "Comments"
-            << std::setw(17) << "Doc Comments"
-            << std::setw(12) << "Blank"
-            << std::setw(12) << "Code"
-            << std::setw(12) << "# of lines"
-            << '\n';
-
-  std::cout << std::string(total_separator_width, '-') << '\n';
-
-  // Print each file's data using the relative path
-  for (const auto& f : files) {
-    count_t total = f.n_blank + f.n_comments + f.n_doc + f.n_loc;
-    auto percent = [&](count_t count) -> std::string {
-      if (total == 0)
-        return "0.0%";
-      std::ostringstream oss;
-      oss << std::fixed << std::setprecision(1) << (100.0 * count / total) << '%';
-      return oss.str();
-    };
+/**
+ * @brief Implements `sloc query`: sorts and filters a slocbin file without reading any source.
+ *
+ * The file is mapped and answered from its stored indexes: the permutation of the sort
+ * criterion gives the order, and the filename permutation resolves --prefix and --path.
+ *
+ * @param argc, argv: command line options, starting at "query".
+ * @return the exit status.
+ */
+int run_query(int argc, char* argv[]) {
+  enum query_opt_e : int { OPT_TOP = 256, OPT_PREFIX, OPT_PATH, OPT_LINES };
+  static struct option long_options[] = { { "help", no_argument, 0, 'h' },
+                                          { "top", required_argument, 0, OPT_TOP },
+                                          { "prefix", required_argument, 0, OPT_PREFIX },
+                                          { "path", required_argument, 0, OPT_PATH },
+                                          { "lines", required_argument, 0, OPT_LINES },
+                                          { 0, 0, 0, 0 } };
+  std::optional<std::pair<bool, char>> ordering;
+  std::uint64_t top = UINT64_MAX;
+  std::string prefix;
+  std::optional<std::string> exact_path;
+  std::optional<std::pair<std::uint64_t, std::uint64_t>> lines;  // 1-based, inclusive.
+  int c;
+  int option_index{ 0 };
+  while ((c = getopt_long(argc, argv, "hs:S:", long_options, &option_index)) != -1) {
+    switch (c) {
+    case 'h':
+      usage("");
+      break;
+    case 's':
+    case 'S':
+      if (strlen(optarg) != 1 or strchr(SLOCBIN_CRITERIA, optarg[0]) == nullptr) {
+        usage("Invalid character value for sorting -s -S");
+      }
+      ordering = std::make_pair(c == 's', optarg[0]);
+      break;
+    case OPT_TOP: {
+      char* end = nullptr;
+      top = std::strtoull(optarg, &end, 10);
+      if (end == optarg or *end != '\0' or optarg[0] == '-')
+        usage("Please, provide a # of rows for --top");
+      break;
+    }
+    case OPT_PREFIX:
+      prefix = optarg;
+      break;
+    case OPT_PATH:
+      exact_path = optarg;
+      break;
+    case OPT_LINES: {
+      char* end = nullptr;
+      std::uint64_t first = std::strtoull(optarg, &end, 10);
+      std::uint64_t last = *end == '-' ? std::strtoull(end + 1, &end, 10) : first;
+      if (first == 0 or last < first or *end != '\0')
+        usage("Please, provide a line range FIRST-LAST for --lines");
+      lines = std::make_pair(first, last);
+      break;
+    }
+    default:
+      usage("Invalid option");
+      break;
+    }
+  }
+  if (optind != argc - 1) {
+    usage("Please, provide one slocbin file to query");
+  }
+  if (lines and !exact_path) {
+    usage("--lines needs --path");
+  }
+
+  SlocbinReader reader;
+  std::string error;
+  if (!reader.open(argv[optind], error)) {
+    usage("Could not query results: " + error);
+  }
+
+  // Rows to show, in order.
+  std::vector<std::uint64_t> selected;
+  if (exact_path) {
+    std::uint64_t r = reader.find(*exact_path);
+    if (r < reader.size())
+      selected.push_back(r);
+  } else if (ordering) {
+    // Walk the stored permutation (backwards for descending) and stop after `top` matches.
+    const std::uint32_t* perm = reader.permutation(ordering->second);
+    for (std::uint64_t i = 0; i < reader.size() and selected.size() < top; ++i) {
+      std::uint64_t r = ordering->first ? perm[i] : perm[reader.size() - 1 - i];
+      if (reader.path(r).substr(0, prefix.size()) == prefix)
+        selected.push_back(r);
+    }
+  } else if (!prefix.empty()) {
+    auto [first, last] = reader.prefix_range(prefix);
+    for (std::uint64_t i = first; i < last and selected.size() < top; ++i) {
+      selected.push_back(reader.permutation('f')[i]);
+    }
+  } else {
+    for (std::uint64_t r = 0; r < reader.size() and selected.size() < top; ++r) {
+      selected.push_back(r);
+    }
+  }
 
-    std::ostringstream comments, doc, blank, code;
-    comments << f.n_comments << " (" << percent(f.n_comments) << ")";
-    doc << f.n_doc << " (" << percent(f.n_doc) << ")";
-    blank << f.n_blank << " (" << percent(f.n_blank) << ")";
-    code << f.n_loc << " (" << percent(f.n_loc) << ")";
-
-    std::cout << std::left
-              << std::setw(max_filename_width) << relative_basename(f.filename, base_dir)
-              << "  "
-              << std::setw(12) << lang_type_to_string(f.type)
-              << std::setw(15) << comments.str()
-              << std::setw(17) << doc.str()
-              << std::setw(12) << blank.str()
-              << std::setw(12) << code.str()
-              << std::setw(12) << total
-              << '\n';
-
-    std::cout << '\n';
-  }
-  
-  std::cout << std::string(total_separator_width, '-') << '\n';
-
-  // Print the SUM row when processing more than one file
-  if (files.size() > 1) {
-    count_t sum_comments = 0, sum_doc = 0, sum_blank = 0, sum_loc = 0, sum_lines = 0;
-    for (const auto& f : files) {
-      sum_comments += f.n_comments;
-      sum_doc += f.n_doc;
-      sum_blank += f.n_blank;
-      sum_loc += f.n_loc;
-      sum_lines += f.n_lines;
-    }
-
-    std::cout << std::left 
-              << std::setw(max_filename_width) << "SUM"
-              << std::setw(12) << ""
-              << std::setw(15) << sum_comments
-              << std::setw(17) << sum_doc
-              << std::setw(12) << sum_blank
-              << std::setw(12) << sum_loc
-              << std::setw(12) << sum_lines
-              << '\n';
-
-    std::cout << std::string(total_separator_width, '-') << '\n';
+  // Paths are stored relative to the base directory of the run; rebuild them under it so the
+  // table shows them exactly as the run that wrote the file did.
+  const std::filesystem::path base_directory{ std::string{ reader.base_dir() } };
+  FileList files;
+  files.reserve(selected.size());
+  for (std::uint64_t r : selected) {
+    const SlocbinRow& row = reader.row(r);
+    files.emplace_back((base_directory / std::string{ reader.path(r) }).lexically_normal().string(),
+                       static_cast<lang_type_e>(row.type));
+    FileInfo& f = files.back();
+    f.n_blank = row.n_blank;
+    f.n_comments = row.n_comments;
+    f.n_doc = row.n_doc;
+    f.n_loc = row.n_loc;
+    f.n_lines = row.n_lines;
+  }
+  if (lines) {
+    if (selected.empty()) {
+      usage("Could not query results: no such path " + *exact_path);
+    }
+    // Classify the lines from the nearest checkpoint; without an index, or if the file was
+    // edited since it was indexed, from the top.
+    FileBuffer buffer;
+    if (!buffer.load(files.front().filename)) {
+      usage("Could not open file " + files.front().filename);
+    }
+    static const char* const category_names[] = { "blank", "code", "comment", "doc" };
+    std::uint32_t stride = reader.line_index_stride();
+    std::string_view index = reader.line_index(selected.front());
+    if (stride != 0 and !reader.line_index_matches(selected.front(), buffer.view())) {
+      std::cerr << "[WARNING] " << files.front().filename
+                << " changed since it was indexed; classifying it from the top\n";
+      index = {};
+    }
+    classify_lines(buffer.view(), index, stride == 0 ? 1 : stride,
+                   lines->first - 1, lines->second,
+                   [](std::uint64_t line_no, line_category_e category) {
+                     std::cout << line_no + 1 << '\t' << category_names[category] << '\n';
+                   });
+    return EXIT_SUCCESS;
   }
+  if ((reader.flags() & SLOCBIN_FLAG_PARTIAL) != 0) {
+    std::cout << "PARTIAL RESULTS: " << reader.size() << " of " << reader.files_found()
+              << " files counted, the run was stopped early\n\n";
+  }
+  print_table(files, base_directory.string());
+  return EXIT_SUCCESS;
 }
 
-//== Main entry
+/**
+ * @brief Implements `sloc history`: lists the snapshots of a history archive, prints one of
+ * them as a table, or prints the counters of one file across every snapshot.
+ *
+ * @param argc, argv: command line options, starting at "history".
+ * @return the exit status.
+ */
+int run_history(int argc, char* argv[]) {
+  enum history_opt_e : int { OPT_SNAPSHOT = 256, OPT_SERIES };
+  static struct option long_options[] = { { "help", no_argument, 0, 'h' },
+                                          { "snapshot", required_argument, 0, OPT_SNAPSHOT },
+                                          { "series", required_argument, 0, OPT_SERIES },
+                                          { 0, 0, 0, 0 } };
+  std::optional<std::size_t> snapshot;
+  std::optional<std::string> series_path;
+  int c;
+  int option_index{ 0 };
+  while ((c = getopt_long(argc, argv, "h", long_options, &option_index)) != -1) {
+    switch (c) {
+    case 'h':
+      usage("");
+      break;
+    case OPT_SNAPSHOT: {
+      char* end = nullptr;
+      snapshot = std::strtoull(optarg, &end, 10);
+      if (end == optarg or *end != '\0' or optarg[0] == '-')
+        usage("Please, provide a snapshot # for --snapshot");
+      break;
+    }
+    case OPT_SERIES:
+      series_path = optarg;
+      break;
+    default:
+      usage("Invalid option");
+      break;
+    }
+  }
+  if (optind != argc - 1) {
+    usage("Please, provide one history archive");
+  }
 
-int main(int argc, char* argv[]) {
-  RunningOpt run_options;
-  validate_arguments(argc, argv, run_options);
+  HistoryReader reader;
+  std::string error;
+  if (!reader.open(argv[optind], error)) {
+    usage("Could not read history: " + error);
+  }
+  auto date = [&](std::size_t i) {
+    std::time_t t = reader.time(i);
+    std::tm tm{};
+    gmtime_r(&t, &tm);
+    char buf[32];
+    std::strftime(buf, sizeof buf, "%Y-%m-%d %H:%M:%S", &tm);
+    return std::string{ buf };
+  };
 
-  // Create the file list for processing
-  FileList files = create_list_of_src_files(run_options.input_list, run_options.recursive);
+  if (snapshot) {
+    HistoryState state;
+    if (*snapshot >= reader.size()) {
+      usage("Invalid snapshot number for --snapshot");
+    }
+    if (!reader.snapshot(*snapshot, state)) {
+      usage("Could not read history: archive is corrupt");
+    }
+    const std::filesystem::path base_directory{ reader.base_dir(*snapshot) };
+    FileList files;
+    for (std::size_t id = 0; id < state.size(); ++id) {
+      const HistoryCounts& h = state[id];
+      if (!h.present)
+        continue;
+      files.emplace_back((base_directory / reader.paths()[id]).lexically_normal().string(),
+                         static_cast<lang_type_e>(h.type));
+      FileInfo& f = files.back();
+      f.n_blank = h.n_blank;
+      f.n_comments = h.n_comments;
+      f.n_doc = h.n_doc;
+      f.n_loc = h.n_loc;
+      f.n_lines = h.n_lines;
+    }
+    print_table(files, base_directory.string());
+    return EXIT_SUCCESS;
+  }
 
-  // Parser
-  for (auto& file : files) {
-    std::ifstream in(file.filename);
-    if (!in.is_open()) {
-      usage("Could not open file");
-      continue;
+  std::cout << std::left;
+  if (series_path) {
+    std::vector<HistoryCounts> series;
+    std::size_t id = reader.find(*series_path);
+    if (id == reader.paths().size()) {
+      usage("Path not found in the history archive: " + *series_path);
     }
-    CodeParser parser;
-    std::string line;
-    while (std::getline(in, line)) {
-      parser.parse_line(line);
+    if (!reader.series(id, series)) {
+      usage("Could not read history: archive is corrupt");
+    }
+    std::cout << std::setw(10) << "Snapshot" << std::setw(21) << "Date (UTC)" << std::setw(12)
+              << "Comments" << std::setw(14) << "Doc Comments" << std::setw(12) << "Blank"
+              << std::setw(12) << "Code" << "# of lines\n";
+    for (std::size_t i = 0; i < series.size(); ++i) {
+      const HistoryCounts& h = series[i];
+      std::cout << std::setw(10) << i << std::setw(21) << date(i);
+      if (h.present) {
+        std::cout << std::setw(12) << h.n_comments << std::setw(14) << h.n_doc << std::setw(12)
+                  << h.n_blank << std::setw(12) << h.n_loc << h.n_lines << '\n';
+      } else {
+        std::cout << "-\n";
+      }
     }
+    return EXIT_SUCCESS;
+  }
 
-    file.n_blank = parser.get_blank_lines();
-    file.n_comments = parser.get_comment_lines();
-    file.n_doc = parser.get_doc_comment_lines();
-    file.n_loc = parser.get_code_lines();
-    file.n_lines = file.n_blank + file.n_comments + file.n_doc + file.n_loc;
+  // One line per snapshot, rebuilding them in order.
+  std::cout << std::setw(10) << "Snapshot" << std::setw(21) << "Date (UTC)" << std::setw(10)
+            << "Files" << std::setw(12) << "Code" << "# of lines\n";
+  HistoryState state;
+  for (std::size_t i = 0; i < reader.size(); ++i) {
+    if (!reader.apply(i, state)) {
+      usage("Could not read history: archive is corrupt");
+    }
+    count_t n_files = 0, n_loc = 0, n_lines = 0;
+    for (const HistoryCounts& h : state) {
+      n_files += h.present ? 1 : 0;
+      n_loc += h.n_loc;
+      n_lines += h.n_lines;
+    }
+    std::cout << std::setw(10) << i << std::setw(21) << date(i) << std::setw(10) << n_files
+              << std::setw(12) << n_loc << n_lines << '\n';
   }
+  return EXIT_SUCCESS;
+}
 
-  if (run_options.should_order) {
-    sort_files(files, run_options.ordering_method);
+/**
+ * @brief Implements `sloc --patch`: counts the lines a unified diff on stdin adds and removes.
+ *
+ * The paths of the diff are taken relative to the directory given (the current one by
+ * default), after dropping `-p N` leading components (1 by default, for git's a/ and b/).
+ *
+ * @param argc, argv: command line options, starting at "--patch".
+ * @return the exit status.
+ */
+int run_patch(int argc, char* argv[]) {
+  unsigned strip = 1;
+  int c;
+  while ((c = getopt(argc, argv, "hp:")) != -1) {
+    switch (c) {
+    case 'h':
+      usage("");
+      break;
+    case 'p': {
+      char* end = nullptr;
+      unsigned long n = std::strtoul(optarg, &end, 10);
+      if (end == optarg or *end != '\0' or optarg[0] == '-' or n > UINT_MAX)
+        usage("Please, provide a # of path components for -p");
+      strip = static_cast<unsigned>(n);
+      break;
+    }
+    default:
+      usage("Invalid option");
+      break;
+    }
   }
+  if (optind < argc - 1) {
+    usage("Please, provide at most one directory for --patch");
+  }
+  std::string root = optind < argc ? argv[optind] : ".";
+
+  PatchCounter counter{ root, strip, [](const std::string& path) {
+                         return id_lang_type(to_lower(path));
+                       } };
+  std::string line;
+  while (std::getline(std::cin, line)) {
+    if (!counter.add(line)) {
+      usage("Malformed hunk header in the diff: " + line);
+    }
+  }
+  counter.finish();
+  print_patch(counter.files());
+  return EXIT_SUCCESS;
+}
+
+//== Main entry
+
+int main(int argc, char* argv[]) {
+  if (argc > 1 and strcmp(argv[1], "query") == 0) {
+    return run_query(argc - 1, argv + 1);
+  }
+  if (argc > 1 and strcmp(argv[1], "history") == 0) {
+    return run_history(argc - 1, argv + 1);
+  }
+  if (argc > 1 and strcmp(argv[1], "--patch") == 0) {
+    return run_patch(argc - 1, argv + 1);
+  }
+
+  RunningOpt run_options;
+  validate_arguments(argc, argv, run_options);
+  mem_stats_enabled() = run_options.stats;
+  // Ctrl-C, SIGTERM and the deadline stop the run, which then reports what it counted.
+  if (!install_stop_handlers(run_options.deadline)) {
+    usage("Could not set the --deadline timer");
+  }
+  ProgressReporter progress;
+  if (run_options.progress)
+    progress.start();
+
+  // Create the file list for processing
+  std::optional<SubtreeCache> cache;
+  if (!run_options.cache_path.empty()) {
+    cache.emplace([](const std::string& path) { return id_lang_type(to_lower(path)); },
+                  run_options.cache_trust_dirs);
+    std::string error;
+    if (!cache->load(run_options.cache_path, error))
+      std::cerr << "[WARNING] " << error << ", starting a new one\n";
+  }
+  FileList files = create_list_of_src_files(
+    run_options.input_list, run_options.recursive, cache ? &*cache : nullptr);
+  if (!run_options.compdb_path.empty()
+      and !add_compdb_files(run_options.compdb_path, files, run_options.stats)) {
+    usage("Could not read the compilation database");
+  }
+  DepsGraph deps;
+  std::vector<std::int64_t> deps_index;
+  if (!run_options.deps_dir.empty()
+      and !add_deps_files(run_options.deps_dir, files, deps, deps_index, run_options.stats)) {
+    usage("Could not read the build dependencies");
+  }
+  progress_counters().discovered.store(files.size(), std::memory_order_relaxed);
+  RunCoverage coverage;
+  coverage.walk_complete = !stop_requested();
 
   // Determine a base directory from the input list
   std::string base_directory;
@@ -611,7 +1335,203 @@ int main(int argc, char* argv[]) {
     base_directory = ".";
   }
 
-  print_table(files, base_directory);
+  // Output goes to the -o file or to stdout.
+  std::ofstream output_file;
+  if (!run_options.output_path.empty()) {
+    output_file.open(run_options.output_path, std::ios::binary);
+    if (!output_file.is_open()) {
+      usage("Could not open output file");
+    }
+  }
+  std::ostream& out = output_file.is_open() ? output_file : std::cout;
+
+  // Columnar output is streamed while counting, unless the rows have to be sorted first. It
+  // keeps license headers in the comment counters (see all_comment_lines()), so it does not
+  // wait for them to be learned. The HTML report only keeps a per-directory roll-up, which does
+  // not depend on the order.
+  std::optional<ArrowStreamWriter> arrow;
+  std::optional<HtmlReport> html;
+  BatchSink sink;
+  std::size_t sunk = 0;  // files handed to the sink so far
+  if (run_options.format == FMT_ARROW) {
+    MemScope scope{ mem_tag_e::OUTPUT };
+    arrow.emplace(out, base_directory);
+    arrow->write_schema({ { "sloc.base_dir", base_directory } });
+    if (!run_options.should_order) {
+      sink = [&](std::size_t begin, std::size_t end) {
+        MemScope scope{ mem_tag_e::OUTPUT };
+        arrow->write_batch(files.data() + begin, files.data() + end);
+        sunk = end;
+      };
+    }
+  } else if (run_options.format == FMT_HTML) {
+    html.emplace(base_directory);
+    sink = [&](std::size_t begin, std::size_t end) {
+      MemScope scope{ mem_tag_e::OUTPUT };
+      html->add(files.data() + begin, files.data() + end);
+      sunk = end;
+    };
+  }
+
+  // Parser
+  std::vector<HeaderFingerprint> headers;
+  HalsteadModules modules;
+  // Reads wait on storage, so there can be more readers than cores.
+  std::optional<AdaptivePipeline> pipeline;
+  if (run_options.adaptive_jobs) {
+    pipeline.emplace(std::min(4 * run_options.n_jobs, 64u), run_options.n_jobs,
+                     run_options.huge_pages);
+  }
+  progress_begin_counting();
+  if (!count_files(files, run_options, headers, modules, sink, ARROW_BATCH_ROWS,
+                   pipeline ? &*pipeline : nullptr)) {
+    usage("Could not open file");
+  }
+  progress.stop();
+
+  // A stopped run reports the files it counted, and says so.
+  coverage.reason = static_cast<stop_reason_e>(stop_reason().load());
+  coverage.n_found = files.size();
+  coverage.n_counted = static_cast<std::size_t>(
+    std::count_if(files.begin(), files.end(), [](const FileInfo& f) { return f.counted; }));
+  if (coverage.partial()) {
+    std::cerr << "[WARNING] " << coverage.describe() << '\n';
+    // The files handed to the sink are all counted, so they keep their place.
+    std::vector<std::int64_t> new_index(files.size(), -1);
+    std::size_t n = 0;
+    for (std::size_t i = 0; i < files.size(); ++i) {
+      if (!files[i].counted)
+        continue;
+      new_index[i] = static_cast<std::int64_t>(n);
+      if (i != n) {
+        files[n] = std::move(files[i]);
+        if (!headers.empty())
+          headers[n] = std::move(headers[i]);
+      }
+      n++;
+    }
+    files.erase(files.begin() + static_cast<std::ptrdiff_t>(n), files.end());
+    if (!headers.empty())
+      headers.resize(n);
+    for (std::int64_t& i : deps_index) {
+      i = i < 0 ? -1 : new_index[static_cast<std::size_t>(i)];
+    }
+    for (std::size_t b = sunk; sink and b < files.size(); b += ARROW_BATCH_ROWS) {
+      sink(b, std::min(files.size(), b + ARROW_BATCH_ROWS));
+    }
+  }
+  if (!headers.empty()) {
+    auto licenses = learn_license_headers(headers);
+    if (run_options.licenses)
+      classify_license_headers(files, headers, licenses);
+    ProfileCounter{ run_options.profiles }.drop_licenses(files, headers, licenses);
+  }
+
+  // The cache and the per-unit sums index the files, so they are taken before sorting.
+  if (cache and coverage.partial()) {
+    std::cerr << "[WARNING] The run was stopped, " << run_options.cache_path
+              << " is not updated\n";
+  } else if (cache) {
+    std::string error;
+    if (!cache->save(run_options.cache_path, files, error))
+      std::cerr << "[WARNING] " << error << '\n';
+    if (run_options.stats) {
+      const auto& st = cache->stats();
+      std::cerr << "cache: " << st.n_dirs_reused << " directories reused, " << st.n_dirs_scanned
+                << " read; " << st.n_files_reused << " files reused, " << st.n_files_counted
+                << " counted\n";
+    }
+  }
+  std::vector<UnitCounts> units;
+  count_t unique_loc = 0;
+  if (!run_options.deps_dir.empty()) {
+    units = unit_counts(deps, deps_index, files);
+    for (std::int64_t i : deps_index) {
+      unique_loc += i < 0 ? 0 : files[static_cast<std::size_t>(i)].n_loc;
+    }
+  }
+
+  if (run_options.should_order) {
+    sort_files(files, run_options.ordering_method);
+  }
+
+  {
+    MemScope scope{ mem_tag_e::OUTPUT };
+    if (arrow) {
+      for (std::size_t b = 0; !sink and b < files.size(); b += ARROW_BATCH_ROWS) {
+        arrow->write_batch(files.data() + b,
+                           files.data() + std::min(files.size(), b + ARROW_BATCH_ROWS));
+      }
+      ArrowStreamWriter::Metadata partial;
+      if (coverage.partial()) {
+        char percent[16];
+        std::snprintf(percent, sizeof percent, "%.2f", coverage.percent());
+        partial = { { "sloc.partial", "true" },
+                    { "sloc.files_found", std::to_string(coverage.n_found) },
+                    { "sloc.files_counted", std::to_string(coverage.n_counted) },
+                    { "sloc.coverage", percent },
+                    { "sloc.stopped_by", coverage.reason_name() } };
+      }
+      arrow->finish(partial);
+    } else if (html) {
+      html->write(out, coverage.partial() ? coverage.describe() : std::string{});
+    } else if (run_options.format == FMT_SLOCBIN) {
+      write_slocbin(out, files, base_directory, coverage.partial() ? SLOCBIN_FLAG_PARTIAL : 0,
+                    run_options.line_index, coverage.n_found);
+    } else {
+      if (coverage.partial())
+        out << coverage.describe() << "\n\n";
+      print_table(files, base_directory, out, run_options.licenses);
+      if (!run_options.markers.empty()) {
+        print_markers(files, run_options.markers, base_directory, out);
+      }
+      if (!run_options.profiles.empty()) {
+        std::vector<std::string> names;
+        for (const auto& p : run_options.profiles) {
+          names.push_back(p.name);
+        }
+        print_profiles(files, names, base_directory, out);
+      }
+      if (run_options.doc_coverage) {
+        print_doc_coverage(files, base_directory, out);
+      }
+      if (run_options.halstead) {
+        print_halstead(files, modules.counts(), modules.n_operands(), base_directory, out);
+      }
+      if (run_options.complexity) {
+        print_complexity(files, base_directory, out);
+      }
+      if (!run_options.deps_dir.empty()) {
+        print_units(units, deps.files().size(), unique_loc, base_directory, out);
+      }
+    }
+    if (!out.flush()) {
+      usage("Could not write output");
+    }
+    std::string error;
+    if (!run_options.sqlite_path.empty()
+        and !export_sqlite(run_options.sqlite_path, files, base_directory, error, coverage)) {
+      usage("Could not write SQLite database: " + error);
+    }
+    // A snapshot missing files would read as if they had been deleted.
+    if (!run_options.history_path.empty() and coverage.partial()) {
+      std::cerr << "[WARNING] The run was stopped, no snapshot is added to "
+                << run_options.history_path << '\n';
+    } else if (!run_options.history_path.empty()
+               and !append_history(run_options.history_path, files, base_directory, error)) {
+      usage("Could not write history archive: " + error);
+    }
+    if (!run_options.line_map_path.empty()
+        and !write_line_map(run_options.line_map_path, files, base_directory, error,
+                            coverage.partial() ? LINE_MAP_FLAG_PARTIAL : 0, coverage.n_found)) {
+      usage("Could not write line map: " + error);
+    }
+  }
+  if (run_options.stats) {
+    if (pipeline)
+      pipeline->print(std::cerr);
+    print_mem_stats(std::cerr);
+  }
 
-  return 0;
+  return coverage.partial() ? coverage.exit_status() : 0;
 }